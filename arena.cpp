@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <cstring>
+#include "arena.h"
+
+const std::string Symbol::empty_string;
+
+
+Arena::Arena()
+    : blocks(NULL), pos((char*)initial), end((char*)initial + sizeof(initial)),
+      block_size(initial_size), allocated(sizeof(initial)),
+      table(NULL), first(NULL), last(&first), table_size(0), symbols(0)
+{
+}
+
+Arena::~Arena()
+{
+    for(Symbol::Entry *entry = first; entry; entry = entry->next)
+        entry->~Entry();
+
+    while(blocks)
+    {
+        Block *next = blocks->next;
+        std::free(blocks);
+        blocks = next;
+    }
+}
+
+void *Arena::allocate(size_t size)
+{
+    size = (size + alignment - 1) & ~(size_t)(alignment - 1);
+    if(size > (size_t)(end - pos))
+    {
+        // Blocks start with a header that is padded to the alignment
+        block_size *= 2;
+        size_t n = size > block_size ? size : block_size;
+        Block *block = (Block*)std::malloc(alignment + n);
+        if(block == NULL)
+            throw std::bad_alloc();
+        block->next = blocks;
+        blocks = block;
+        pos = (char*)block + alignment;
+        end = pos + n;
+        allocated += n;
+    }
+    void *p = pos;
+    pos += size;
+    return p;
+}
+
+void Arena::grow_table()
+{
+    size_t size = table_size ? 2*table_size : 64;
+    table = (Symbol::Entry**)allocate(size * sizeof(Symbol::Entry*));
+    std::memset(table, 0, size * sizeof(Symbol::Entry*));
+    table_size = size;
+
+    for(Symbol::Entry *entry = first; entry; entry = entry->next)
+    {
+        size_t n = entry->hash & (size - 1);
+        while(table[n])
+            n = (n + 1) & (size - 1);
+        table[n] = entry;
+    }
+}
+
+Symbol Arena::intern(const char *str, size_t len)
+{
+    if(len == 0)
+        return Symbol();
+
+    // FNV-1a
+    size_t hash = 2166136261u;
+    for(size_t i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+
+    if(2*(symbols + 1) > table_size)
+        grow_table();
+
+    size_t n = hash & (table_size - 1);
+    for(; table[n]; n = (n + 1) & (table_size - 1))
+    {
+        const Symbol::Entry *entry = table[n];
+        if( entry->hash == hash && entry->text.size() == len &&
+            std::memcmp(entry->text.data(), str, len) == 0 )
+        {
+            return Symbol(entry);
+        }
+    }
+
+    Symbol::Entry *entry = new (*this) Symbol::Entry;
+    entry->text.assign(str, len);
+    entry->id = ++symbols;
+    entry->hash = hash;
+    entry->next = NULL;
+    *last = entry;
+    last = &entry->next;
+    table[n] = entry;
+    return Symbol(entry);
+}
+
+Symbol Arena::intern(const std::string &str)
+{
+    return intern(str.data(), str.size());
+}
+
+size_t Arena::memory() const
+{
+    return allocated;
+}
+
+size_t Arena::symbol_count() const
+{
+    return symbols;
+}
+
+
+void *operator new(size_t size, Arena &arena)
+{
+    return arena.allocate(size);
+}
+
+void operator delete(void *, Arena &)
+{
+}
@@ -0,0 +1,230 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <string>
+
+/*
+A string interned in an Arena. Symbols of the same arena are equal if and
+only if they refer to the same entry, and each entry has a small identifier
+(starting at 1; the empty symbol has identifier 0). Symbols of different
+arenas may be compared as well, but then their strings are compared.
+
+Symbols convert to const std::string& so they can be used where strings are
+expected; they stay valid as long as their arena exists.
+*/
+class Symbol
+{
+public:
+    struct Entry
+    {
+        std::string text;
+        int id;
+        size_t hash;
+        Entry *next;        // in order of interning
+    };
+
+    inline Symbol();
+    inline explicit Symbol(const Entry *entry);
+
+    inline const std::string &str() const;
+    inline operator const std::string &() const;
+    inline const char *c_str() const;
+    inline size_t size() const;
+    inline bool empty() const;
+    inline int id() const;
+
+    inline bool operator==(const Symbol &other) const;
+
+private:
+    const Entry *entry;
+
+    static const std::string empty_string;
+};
+
+/*
+Allocates memory that is freed all at once when the arena is destroyed, and
+interns strings as symbols.
+
+Memory is taken from blocks of increasing size; the first block is part of
+the arena itself, so small arenas take no extra allocations. Objects are
+created with placement new (e.g. "new (arena) Expr(...)") and are never
+destroyed individually, so they should not own other memory, except through
+an ArenaAllocator.
+*/
+class Arena
+{
+    Arena(const Arena&);
+    Arena &operator=(const Arena&);
+
+    struct Block
+    {
+        Block *next;
+    };
+
+    enum { initial_size = 2048, alignment = sizeof(double) };
+
+    double initial[initial_size / sizeof(double)];
+    Block *blocks;
+    char *pos, *end;
+    size_t block_size, allocated;
+
+    // Interned strings: open addressing hash table
+    Symbol::Entry **table, *first, **last;
+    size_t table_size, symbols;
+
+    void grow_table();
+
+public:
+    Arena();
+    ~Arena();
+
+    void *allocate(size_t size);
+    Symbol intern(const char *str, size_t len);
+    Symbol intern(const std::string &str);
+
+    size_t memory() const;
+    size_t symbol_count() const;
+};
+
+void *operator new(size_t size, Arena &arena);
+void operator delete(void *p, Arena &arena);
+
+/* An STL allocator that takes memory from an arena. Memory is never returned
+   to the arena, so containers that grow by doubling waste at most as much
+   memory as they use. */
+template<class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    Arena *arena;
+
+    explicit ArenaAllocator(Arena &arena) : arena(&arena) { }
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) { }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    pointer allocate(size_type n, const void * = 0)
+        { return (pointer)arena->allocate(n * sizeof(T)); }
+    void deallocate(pointer, size_type) { }
+    size_type max_size() const { return size_t(-1) / sizeof(T); }
+    void construct(pointer p, const T &value) { new ((void*)p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+};
+
+template<class T, class U>
+inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena == b.arena;
+}
+
+template<class T, class U>
+inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena != b.arena;
+}
+
+
+// Implementation of Symbol inline members
+Symbol::Symbol() : entry(NULL)
+{
+}
+
+Symbol::Symbol(const Entry *entry) : entry(entry)
+{
+}
+
+const std::string &Symbol::str() const
+{
+    return entry ? entry->text : empty_string;
+}
+
+Symbol::operator const std::string &() const
+{
+    return str();
+}
+
+const char *Symbol::c_str() const
+{
+    return str().c_str();
+}
+
+size_t Symbol::size() const
+{
+    return str().size();
+}
+
+bool Symbol::empty() const
+{
+    return entry == NULL;
+}
+
+int Symbol::id() const
+{
+    return entry ? entry->id : 0;
+}
+
+bool Symbol::operator==(const Symbol &other) const
+{
+    return entry == other.entry || str() == other.str();
+}
+
+inline bool operator!=(const Symbol &a, const Symbol &b)
+{
+    return !(a == b);
+}
+
+inline bool operator==(const Symbol &a, const std::string &b)
+{
+    return a.str() == b;
+}
+
+inline bool operator==(const std::string &a, const Symbol &b)
+{
+    return a == b.str();
+}
+
+inline bool operator!=(const Symbol &a, const std::string &b)
+{
+    return a.str() != b;
+}
+
+inline bool operator!=(const std::string &a, const Symbol &b)
+{
+    return a != b.str();
+}
+
+inline std::string operator+(const std::string &a, const Symbol &b)
+{
+    return a + b.str();
+}
+
+inline std::string operator+(const char *a, const Symbol &b)
+{
+    return a + b.str();
+}
+
+inline std::string operator+(const Symbol &a, const char *b)
+{
+    return a.str() + b;
+}
+
+inline std::ostream &operator<<(std::ostream &os, const Symbol &symbol)
+{
+    return os << symbol.str();
+}
+
+#endif /* ndef ARENA_H_INCLUDED */
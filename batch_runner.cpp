@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sys/time.h>
+#include "batch_runner.h"
+#include "sparql_mapper.h"
+
+static double now()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+/* Returns the 'p'th percentile of sorted latencies (nearest rank), in
+   milliseconds. */
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    size_t rank = (size_t)std::ceil(p/100 * sorted.size());
+    return 1e3 * sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+BatchRunner::BatchRunner( const char *path, int threads, int repeat,
+                          const std::map<std::string, Node> &values,
+                          const std::set<std::string> &parameters )
+    : path(path), threads(threads), repeat(repeat), values(values),
+      parameters(parameters), elapsed(0), next(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+BatchRunner::~BatchRunner()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void BatchRunner::read(std::istream &is)
+{
+    std::string line;
+    for(int number = 1; std::getline(is, line); ++number)
+    {
+        std::string::size_type begin = line.find_first_not_of(" \t\r");
+        if(begin == std::string::npos || line[begin] == '#')
+            continue;
+        queries.push_back(line.substr(begin));
+
+        Statistics s;
+        s.line   = number;
+        s.rows   = 0;
+        s.errors = 0;
+        stats.push_back(s);
+    }
+    if(queries.empty())
+        throw "No queries in batch!";
+}
+
+/* Parses, maps and evaluates a query, and returns the number of rows. */
+long long BatchRunner::execute(sqlite3 *db, const std::string &query)
+{
+    Parser p(query.data(), query.data() + query.size());
+    std::auto_ptr<Query> q(p.parse());
+    if(!p.full())
+        throw "Extra characters at end of SPARQL query!";
+
+    SQLMapper mapper(db, *q, parameters);
+    std::string sql = mapper.sql();
+
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+    {
+        throw std::string("Unable to prepare generated SQL query: \"")
+            + sql + "\"!";
+    }
+    for( std::map<std::string, Node>::const_iterator i = values.begin();
+         i != values.end(); ++i )
+    {
+        mapper.bind(stmt, i->first, i->second);
+    }
+
+    // Retrieve all values, as a result writer would
+    long long rows = 0;
+    int result, count = sqlite3_column_count(stmt);
+    while((result = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        for(int n = 0; n < count; ++n)
+            sqlite3_column_text(stmt, n);
+        ++rows;
+        if(q->form == Query::ask)
+            break;
+    }
+    sqlite3_finalize(stmt);
+
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW && result != SQLITE_DONE)
+        throw "Unable to retrieve query results!";
+    return rows;
+}
+
+void BatchRunner::work()
+{
+    sqlite3 *db = NULL;
+    bool opened =
+        sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&mutex);
+        size_t n = next++;
+        pthread_mutex_unlock(&mutex);
+        if(n >= queries.size() * repeat)
+            break;
+
+        // Repetitions of a query are interleaved with the other queries
+        size_t query = n % queries.size();
+        long long rows = 0;
+        std::string error;
+        double start = now();
+        if(!opened)
+            error = "Unable to open database!";
+        else
+        {
+            try {
+                rows = execute(db, queries[query]);
+            } catch(const char *str) {
+                error = str;
+            } catch(const std::string &str) {
+                error = str;
+            }
+        }
+        double latency = now() - start;
+
+        pthread_mutex_lock(&mutex);
+        Statistics &s = stats[query];
+        if(error.empty())
+        {
+            s.latencies.push_back(latency);
+            s.rows += rows;
+        }
+        else
+        if(s.errors++ == 0)
+            s.error = error;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    sqlite3_close(db);
+}
+
+void *BatchRunner::run(void *arg)
+{
+    ((BatchRunner*)arg)->work();
+    return NULL;
+}
+
+void BatchRunner::run()
+{
+    next = 0;
+    double start = now();
+
+    std::vector<pthread_t> workers(threads);
+    int started = 0;
+    for(; started < threads; ++started)
+    {
+        if(pthread_create(&workers[started], NULL, run, this) != 0)
+            break;
+    }
+    if(started == 0)
+        throw "Unable to start threads!";
+    for(int n = 0; n < started; ++n)
+        pthread_join(workers[n], NULL);
+
+    elapsed = now() - start;
+    threads = started;
+}
+
+void BatchRunner::report(std::ostream &os) const
+{
+    char line[160];
+    std::vector<double> all;
+    long long rows = 0;
+    size_t errors = 0;
+
+    std::sprintf( line, "%6s %6s %6s %6s %12s %10s %10s %10s\n",
+                  "query", "line", "runs", "errors", "rows",
+                  "p50 (ms)", "p95 (ms)", "p99 (ms)" );
+    os << line;
+    for(size_t n = 0; n < stats.size(); ++n)
+    {
+        const Statistics &s = stats[n];
+        std::vector<double> sorted(s.latencies);
+        std::sort(sorted.begin(), sorted.end());
+        std::sprintf( line,
+                      "%6lu %6d %6lu %6lu %12lld %10.3f %10.3f %10.3f\n",
+                      (unsigned long)n + 1, s.line,
+                      (unsigned long)sorted.size(), (unsigned long)s.errors,
+                      s.rows, percentile(sorted, 50), percentile(sorted, 95),
+                      percentile(sorted, 99) );
+        os << line;
+
+        all.insert(all.end(), sorted.begin(), sorted.end());
+        rows += s.rows;
+        errors += s.errors;
+    }
+
+    std::sort(all.begin(), all.end());
+    std::sprintf( line,
+                  "%6s %6s %6lu %6lu %12lld %10.3f %10.3f %10.3f\n",
+                  "all", "", (unsigned long)all.size(), (unsigned long)errors,
+                  rows, percentile(all, 50), percentile(all, 95),
+                  percentile(all, 99) );
+    os << line << '\n';
+
+    double seconds = elapsed > 0 ? elapsed : 1e-6;
+    std::sprintf( line,
+                  "%d thread(s), %.3f s: %.1f queries/s, %.1f rows/s\n",
+                  threads, elapsed, all.size() / seconds, rows / seconds );
+    os << line;
+
+    for(size_t n = 0; n < stats.size(); ++n)
+    {
+        if(stats[n].errors > 0)
+            os << "line " << stats[n].line << ": " << stats[n].error << '\n';
+    }
+}
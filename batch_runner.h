@@ -0,0 +1,70 @@
+#ifndef BATCH_RUNNER_H_INCLUDED
+#define BATCH_RUNNER_H_INCLUDED
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "sparql_parser.h"
+
+/*
+Runs a batch of SPARQL queries to measure their performance.
+
+Queries are read one per line; empty lines and lines that start with '#' are
+skipped. Each query is executed 'repeat' times, by 'threads' threads that
+each have their own read-only connection to the database at 'path', and that
+take the next execution from a shared queue (so that repetitions of the same
+query are spread over the batch). Variables in 'values' are bound as with
+--bind.
+
+Results are evaluated completely, including the lexical values of nodes,
+but they are not serialized. report() writes the number of executions,
+errors and rows of each query, the 50th, 95th and 99th percentiles of their
+latency, and the same for all queries together, followed by the throughput
+in queries and rows per second.
+*/
+class BatchRunner
+{
+    BatchRunner(const BatchRunner&);
+    BatchRunner &operator=(const BatchRunner&);
+
+    struct Statistics
+    {
+        int line;
+        std::vector<double> latencies;  // in seconds
+        long long rows;
+        size_t errors;
+        std::string error;              // the first error
+    };
+
+    const char *path;
+    int threads, repeat;
+    const std::map<std::string, Node> &values;
+    const std::set<std::string> &parameters;
+    std::vector<std::string> queries;
+    std::vector<Statistics> stats;
+    double elapsed;
+
+    pthread_mutex_t mutex;
+    size_t next;
+
+    static void *run(void *arg);
+    void work();
+    long long execute(sqlite3 *db, const std::string &query);
+
+public:
+    BatchRunner( const char *path, int threads, int repeat,
+                 const std::map<std::string, Node> &values,
+                 const std::set<std::string> &parameters );
+    ~BatchRunner();
+
+    void read(std::istream &is);
+    void run();
+    void report(std::ostream &os) const;
+};
+
+#endif /* ndef BATCH_RUNNER_H_INCLUDED */
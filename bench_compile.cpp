@@ -0,0 +1,131 @@
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <libgen.h>
+#include <sys/time.h>
+#include "sqlite3.h"
+#include "sparql_mapper.h"
+
+/*
+Measures how long it takes to compile SPARQL queries, that is, to parse them
+and map them to SQL, without evaluating them. Queries are read from a file,
+one per line, as with "query --batch". Each query is compiled a number of
+times, and the average latency of parsing and of compiling is reported,
+together with the number of heap allocations (made through operator new)
+that each takes and the size of the arena of the parsed query.
+*/
+
+static unsigned long allocations;
+
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+    ++allocations;
+    void *p = std::malloc(size ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) throw()
+{
+    std::free(p);
+}
+
+static double now()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+static Query *parse(const std::string &query)
+{
+    Parser p(query.data(), query.data() + query.size());
+    Query *q = p.parse();
+    if(!p.full())
+    {
+        delete q;
+        throw "Extra characters at end of SPARQL query!";
+    }
+    return q;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 3 && argc != 4)
+    {
+        std::cout << "Usage: " << basename(argv[0])
+                  << " <database> <queries> [<iterations>]" << std::endl;
+        return 1;
+    }
+    int iterations = argc == 4 ? std::atoi(argv[3]) : 1000;
+    if(iterations < 1)
+        iterations = 1;
+
+    sqlite3 *db;
+    if(sqlite3_open_v2(argv[1], &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        std::cerr << "Unable to open database!" << std::endl;
+        return 1;
+    }
+    std::ifstream file(argv[2]);
+    if(!file)
+    {
+        std::cerr << "Unable to open file \"" << argv[2] << "\"!" << std::endl;
+        return 1;
+    }
+
+    std::printf( "%6s %12s %8s %12s %8s %8s %8s\n", "line", "parse (us)",
+                 "allocs", "compile (us)", "allocs", "arena", "symbols" );
+    std::string line;
+    for(int number = 1; std::getline(file, line); ++number)
+    {
+        std::string::size_type begin = line.find_first_not_of(" \t\r");
+        if(begin == std::string::npos || line[begin] == '#')
+            continue;
+        line.erase(0, begin);
+
+        try {
+            // Parse only
+            unsigned long start_allocations = allocations;
+            double start = now();
+            for(int n = 0; n < iterations; ++n)
+                delete parse(line);
+            double parse_time = (now() - start) / iterations;
+            double parse_allocations =
+                double(allocations - start_allocations) / iterations;
+
+            // Parse and map to SQL
+            size_t arena = 0, symbols = 0;
+            start_allocations = allocations;
+            start = now();
+            for(int n = 0; n < iterations; ++n)
+            {
+                std::auto_ptr<Query> q(parse(line));
+                SQLMapper mapper(db, *q);
+                mapper.sql();
+                arena = q->arena.memory();
+                symbols = q->arena.symbol_count();
+            }
+            double compile_time = (now() - start) / iterations;
+            double compile_allocations =
+                double(allocations - start_allocations) / iterations;
+
+            std::printf( "%6d %12.2f %8.1f %12.2f %8.1f %8lu %8lu\n", number,
+                         parse_time * 1e6, parse_allocations,
+                         compile_time * 1e6, compile_allocations,
+                         (unsigned long)arena, (unsigned long)symbols );
+        } catch(const char *str) {
+            std::printf("%6d %s\n", number, str);
+        } catch(const std::string &str) {
+            std::printf("%6d %s\n", number, str.c_str());
+        }
+    }
+
+    sqlite3_close(db);
+    return 0;
+}
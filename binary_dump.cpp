@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_dump.h"
+
+static const char magic[8] = { 'R', 'D', 'F', 'D', 'U', 'M', 'P', '1' };
+static const size_t footer_size = 48;
+static const char * const corrupt = "Corrupt dump file!";
+
+static unsigned long long read_u64(const unsigned char *p)
+{
+    unsigned long long i = 0;
+    for(int n = 7; n >= 0; --n)
+        i = (i << 8) | p[n];
+    return i;
+}
+
+static unsigned long read_u32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) |
+           ((unsigned long)p[3] << 24);
+}
+
+/* Decodes the contents of a block, which must not extend beyond 'end'. */
+struct Cursor
+{
+    const unsigned char *pos, *end;
+
+    Cursor(const unsigned char *pos, const unsigned char *end)
+        : pos(pos), end(end)
+    {
+        if(pos > end)
+            throw corrupt;
+    }
+
+    unsigned long long varint()
+    {
+        unsigned long long value = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            if(pos == end)
+                throw corrupt;
+            unsigned char byte = *pos++;
+            value |= (unsigned long long)(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0)
+                return value;
+        }
+        throw corrupt;
+    }
+
+    /* Reads a dictionary entry, which follows 'lexical'. */
+    void entry(std::string &lexical, unsigned long long &type)
+    {
+        type = varint();
+        unsigned long long shared = varint(), len = varint();
+        if(shared > lexical.size() || len > (unsigned long long)(end - pos))
+            throw corrupt;
+        lexical.resize(shared);
+        lexical.append((const char*)pos, len);
+        pos += len;
+    }
+
+    /* Reads a triple, which follows 'last' unless it is the first of its
+       block. */
+    void triple(DumpTriple &t, bool first)
+    {
+        if(first)
+        {
+            t.subj = varint();
+            t.pred = varint();
+            t.obj  = varint();
+        }
+        else
+        if(unsigned long long ds = varint())
+        {
+            t.subj += ds;
+            t.pred = varint();
+            t.obj  = varint();
+        }
+        else
+        if(unsigned long long dp = varint())
+        {
+            t.pred += dp;
+            t.obj  = varint();
+        }
+        else
+            t.obj += varint();
+    }
+};
+
+
+DumpWriter::DumpWriter(FILE *fp)
+    : out(fp, 1 << 20), offset(0), nodes(0), triples(0)
+{
+    write(magic, sizeof(magic));
+}
+
+void DumpWriter::write(const char *data, size_t len)
+{
+    out.write(data, len);
+    offset += len;
+}
+
+void DumpWriter::write_u32(unsigned long i)
+{
+    char buf[4] = { char(i), char(i >> 8), char(i >> 16), char(i >> 24) };
+    write(buf, 4);
+}
+
+void DumpWriter::write_u64(unsigned long long i)
+{
+    char buf[8];
+    for(int n = 0; n < 8; ++n, i >>= 8)
+        buf[n] = char(i);
+    write(buf, 8);
+}
+
+void DumpWriter::write_varint(unsigned long long i)
+{
+    char buf[10];
+    size_t len = 0;
+    for(; i >= 0x80; i >>= 7)
+        buf[len++] = char(i | 0x80);
+    buf[len++] = char(i);
+    write(buf, len);
+}
+
+void DumpWriter::node(const std::string &lexical, unsigned long long type)
+{
+    size_t shared = 0;
+    if(nodes % node_block == 0)
+        node_index.push_back(offset);
+    else
+    {
+        size_t max = std::min(lexical.size(), last_lexical.size());
+        while(shared < max && lexical[shared] == last_lexical[shared])
+            ++shared;
+    }
+
+    write_varint(type);
+    write_varint(shared);
+    write_varint(lexical.size() - shared);
+    write(lexical.data() + shared, lexical.size() - shared);
+    last_lexical = lexical;
+    ++nodes;
+}
+
+void DumpWriter::triple(const DumpTriple &t)
+{
+    if(triples % triple_block == 0)
+    {
+        triple_index.push_back(t.subj);
+        triple_index.push_back(offset);
+        write_varint(t.subj);
+        write_varint(t.pred);
+        write_varint(t.obj);
+    }
+    else
+    if(t.subj != last.subj)
+    {
+        write_varint(t.subj - last.subj);
+        write_varint(t.pred);
+        write_varint(t.obj);
+    }
+    else
+    {
+        write_varint(0);
+        if(t.pred != last.pred)
+        {
+            write_varint(t.pred - last.pred);
+            write_varint(t.obj);
+        }
+        else
+        {
+            write_varint(0);
+            write_varint(t.obj - last.obj);
+        }
+    }
+    last = t;
+    ++triples;
+}
+
+void DumpWriter::finish()
+{
+    unsigned long long node_index_offset = offset;
+    for(size_t n = 0; n < node_index.size(); ++n)
+        write_u64(node_index[n]);
+    unsigned long long triple_index_offset = offset;
+    for(size_t n = 0; n < triple_index.size(); ++n)
+        write_u64(triple_index[n]);
+
+    write_u64(nodes);
+    write_u64(triples);
+    write_u64(node_index_offset);
+    write_u64(triple_index_offset);
+    write_u32(node_block);
+    write_u32(triple_block);
+    write(magic, sizeof(magic));
+    out.flush();
+}
+
+
+DumpReader::DumpReader(const char *path)
+    : data(NULL), size(0)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0)
+    {
+        if(fd >= 0)
+            close(fd);
+        throw std::string("Unable to open file \"") + path + "\" for reading!";
+    }
+    size = st.st_size;
+    if(size >= sizeof(magic) + footer_size)
+    {
+        void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        data = p == MAP_FAILED ? NULL : (const unsigned char*)p;
+    }
+    close(fd);
+    if(data == NULL)
+        throw std::string("Unable to map file \"") + path + "\"!";
+
+    // Check magic and footer
+    const unsigned char *footer = data + size - footer_size;
+    if( std::memcmp(data, magic, sizeof(magic)) != 0 ||
+        std::memcmp(footer + 40, magic, sizeof(magic)) != 0 )
+    {
+        munmap((void*)data, size);
+        throw std::string("File \"") + path + "\" is not a binary dump!";
+    }
+    nodes        = read_u64(footer);
+    triple_total = read_u64(footer + 8);
+    unsigned long long node_index_offset   = read_u64(footer + 16),
+                       triple_index_offset = read_u64(footer + 24);
+    node_block   = read_u32(footer + 32);
+    triple_block = read_u32(footer + 36);
+
+    bool valid = node_block > 0 && triple_block > 0;
+    if(valid)
+    {
+        node_blocks   = (nodes + node_block - 1) / node_block;
+        triple_blocks = (triple_total + triple_block - 1) / triple_block;
+        valid = node_index_offset >= sizeof(magic) &&
+                node_index_offset + 8*node_blocks == triple_index_offset &&
+                triple_index_offset + 16*triple_blocks == size - footer_size;
+    }
+    if(!valid)
+    {
+        munmap((void*)data, size);
+        throw corrupt;
+    }
+    node_index   = data + node_index_offset;
+    triple_index = data + triple_index_offset;
+}
+
+DumpReader::~DumpReader()
+{
+    munmap((void*)data, size);
+}
+
+unsigned long long DumpReader::node_count() const
+{
+    return nodes;
+}
+
+unsigned long long DumpReader::triple_count() const
+{
+    return triple_total;
+}
+
+/* Returns the start of a block; the start of the block after the last one
+   is the end of the section. */
+const unsigned char *
+DumpReader::node_block_start(unsigned long long block) const
+{
+    if(block == node_blocks)
+        return triple_blocks > 0 ? triple_block_start(0) : node_index;
+    unsigned long long offset = read_u64(node_index + 8*block);
+    if(offset < sizeof(magic) || offset > size_t(node_index - data))
+        throw corrupt;
+    return data + offset;
+}
+
+const unsigned char *
+DumpReader::triple_block_start(unsigned long long block) const
+{
+    if(block == triple_blocks)
+        return node_index;
+    unsigned long long offset = read_u64(triple_index + 16*block + 8);
+    if(offset < sizeof(magic) || offset > size_t(node_index - data))
+        throw corrupt;
+    return data + offset;
+}
+
+unsigned long long
+DumpReader::triple_block_subject(unsigned long long block) const
+{
+    return read_u64(triple_index + 16*block);
+}
+
+int DumpReader::read_nodes(NodeHandler handler, void *arg) const
+{
+    std::string lexical;
+    unsigned long long type, id = 0;
+    for(unsigned long long block = 0; block < node_blocks; ++block)
+    {
+        Cursor cursor(node_block_start(block), node_block_start(block + 1));
+        for(unsigned long n = 0; n < node_block && id < nodes; ++n, ++id)
+        {
+            cursor.entry(lexical, type);
+            if(type >= 2 + nodes)
+                throw corrupt;
+            if(int r = handler(arg, id, lexical, type))
+                return r;
+        }
+    }
+    return 0;
+}
+
+int DumpReader::read_triples(TripleHandler handler, void *arg) const
+{
+    DumpTriple t = { 0, 0, 0 };
+    unsigned long long count = 0;
+    for(unsigned long long block = 0; block < triple_blocks; ++block)
+    {
+        Cursor cursor( triple_block_start(block),
+                       triple_block_start(block + 1) );
+        for( unsigned long n = 0; n < triple_block && count < triple_total;
+             ++n, ++count )
+        {
+            cursor.triple(t, n == 0);
+            if(t.subj >= nodes || t.pred >= nodes || t.obj >= nodes)
+                throw corrupt;
+            if(int r = handler(arg, t))
+                return r;
+        }
+    }
+    return 0;
+}
+
+void DumpReader::node( unsigned long long id, std::string &lexical,
+                       unsigned long long &type ) const
+{
+    if(id >= nodes)
+        throw "Node is not in dump!";
+    unsigned long long block = id / node_block;
+    Cursor cursor(node_block_start(block), node_block_start(block + 1));
+    lexical.clear();
+    for(unsigned long n = 0; n <= id % node_block; ++n)
+        cursor.entry(lexical, type);
+}
+
+long long DumpReader::find( const std::string &lexical,
+                            unsigned long long type ) const
+{
+    // Find the last block that starts at or before the node
+    unsigned long long low = 0, high = node_blocks;
+    std::string first;
+    unsigned long long first_type;
+    while(high - low > 1)
+    {
+        unsigned long long mid = low + (high - low) / 2;
+        node(mid * node_block, first, first_type);
+        int c = first.compare(lexical);
+        if(c < 0 || (c == 0 && first_type <= type))
+            low = mid;
+        else
+            high = mid;
+    }
+    if(node_blocks == 0)
+        return -1;
+
+    Cursor cursor(node_block_start(low), node_block_start(low + 1));
+    std::string entry;
+    unsigned long long entry_type, id = low * node_block;
+    for(unsigned long n = 0; n < node_block && id < nodes; ++n, ++id)
+    {
+        cursor.entry(entry, entry_type);
+        if(entry == lexical && entry_type == type)
+            return id;
+    }
+    return -1;
+}
+
+void DumpReader::triples( unsigned long long subj,
+                          std::vector<DumpTriple> &result ) const
+{
+    // Start in the block before the first one that starts after the subject
+    unsigned long long low = 0, high = triple_blocks;
+    while(low < high)
+    {
+        unsigned long long mid = low + (high - low) / 2;
+        if(triple_block_subject(mid) < subj)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if(low > 0)
+        --low;
+
+    DumpTriple t = { 0, 0, 0 };
+    unsigned long long count = low * triple_block;
+    for(unsigned long long block = low; block < triple_blocks; ++block)
+    {
+        Cursor cursor( triple_block_start(block),
+                       triple_block_start(block + 1) );
+        for( unsigned long n = 0; n < triple_block && count < triple_total;
+             ++n, ++count )
+        {
+            cursor.triple(t, n == 0);
+            if(t.subj > subj)
+                return;
+            if(t.subj == subj)
+                result.push_back(t);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef BINARY_DUMP_H_INCLUDED
+#define BINARY_DUMP_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "output_buffer.h"
+
+/*
+    A compact binary dump of a model, written by "export --binary" and loaded
+    by "import --binary". All integers are little-endian; "varint" denotes an
+    unsigned LEB128 integer.
+
+    File:
+        "RDFDUMP1"              magic
+        (dictionary blocks)
+        (triple blocks)
+        u64     offset          (for each dictionary block)
+        u64     subject, offset (for each triple block: its first subject)
+        footer
+
+    Footer (48 bytes):
+        u64     node count
+        u64     triple count
+        u64     offset of dictionary block index
+        u64     offset of triple block index
+        u32     nodes per dictionary block
+        u32     triples per triple block
+        "RDFDUMP1"              magic
+
+    The dictionary lists the nodes of the model, sorted by lexical form (as
+    bytes) and then by type, so a node is identified by its position. Types
+    are 0 for URIs, 1 for plain literals and 2 + n for literals with the
+    datatype URI at position n. Entries are front-coded: each block starts
+    with a complete entry, and other entries share a prefix with the entry
+    before them:
+        varint  type
+        varint  length of prefix shared with the previous entry
+        varint  length of suffix
+        (suffix bytes)
+
+    Triples are sorted by subject, predicate and object, and refer to nodes
+    by position. The first triple of a block is written as three varints;
+    subsequent triples as the difference in subject, followed by the
+    predicate and object if the subject differs, or else the difference in
+    predicate, followed by the object if the predicate differs, or else the
+    difference in object.
+
+    Both block indexes have fixed-size entries, so a mapped dump can be
+    searched for a node or the triples of a subject without decoding it all.
+*/
+
+struct DumpTriple
+{
+    unsigned long long subj, pred, obj;
+};
+
+inline bool operator<(const DumpTriple &a, const DumpTriple &b)
+{
+    return a.subj < b.subj || (a.subj == b.subj && (a.pred < b.pred ||
+        (a.pred == b.pred && a.obj < b.obj)));
+}
+
+/* Writes a dump. Nodes must be written first, in dictionary order, followed
+   by the triples in order; finish() writes the indexes and the footer. */
+class DumpWriter
+{
+    DumpWriter(const DumpWriter&);
+    DumpWriter &operator=(const DumpWriter&);
+
+    OutputBuffer out;
+    unsigned long long offset, nodes, triples;
+    std::vector<unsigned long long> node_index, triple_index;
+    std::string last_lexical;
+    DumpTriple last;
+
+    void write(const char *data, size_t len);
+    void write_u32(unsigned long i);
+    void write_u64(unsigned long long i);
+    void write_varint(unsigned long long i);
+
+public:
+    enum { node_block = 16, triple_block = 1024 };
+
+    explicit DumpWriter(FILE *fp);
+
+    void node(const std::string &lexical, unsigned long long type);
+    void triple(const DumpTriple &t);
+    void finish();
+};
+
+/*
+Reads a dump through a read-only memory mapping of the file. Nodes and
+triples can be read in order with read_nodes() and read_triples(), whose
+handlers return non-zero to stop reading; node() and find() look up single
+nodes, and triples() the triples of a subject, using the block indexes.
+
+Errors (including corrupt dumps) are thrown as strings.
+*/
+class DumpReader
+{
+    DumpReader(const DumpReader&);
+    DumpReader &operator=(const DumpReader&);
+
+    const unsigned char *data;
+    size_t size;
+    unsigned long long nodes, triple_total, node_blocks, triple_blocks;
+    unsigned long node_block, triple_block;
+    const unsigned char *node_index, *triple_index;
+
+    const unsigned char *node_block_start(unsigned long long block) const;
+    const unsigned char *triple_block_start(unsigned long long block) const;
+    unsigned long long triple_block_subject(unsigned long long block) const;
+
+public:
+    typedef int (*NodeHandler)( void *arg, unsigned long long id,
+                                const std::string &lexical,
+                                unsigned long long type );
+    typedef int (*TripleHandler)(void *arg, const DumpTriple &t);
+
+    explicit DumpReader(const char *path);
+    ~DumpReader();
+
+    unsigned long long node_count() const;
+    unsigned long long triple_count() const;
+
+    int read_nodes(NodeHandler handler, void *arg) const;
+    int read_triples(TripleHandler handler, void *arg) const;
+
+    void node( unsigned long long id, std::string &lexical,
+               unsigned long long &type ) const;
+    long long find(const std::string &lexical, unsigned long long type) const;
+    void triples( unsigned long long subj,
+                  std::vector<DumpTriple> &result ) const;
+};
+
+#endif /* ndef BINARY_DUMP_H_INCLUDED */
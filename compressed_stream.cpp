@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "compressed_stream.h"
+
+static const unsigned char gzip_magic[2] = { 0x1F, 0x8B },
+                           zstd_magic[4] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+CompressedInput::CompressedInput(FILE *fp)
+    : fp(fp), gzip(false), filled(0), consumed(0), offset(0), done(false),
+      stop(false), reported(false)
+{
+    magic_size = std::fread(magic, 1, sizeof(magic), fp);
+    if( magic_size == sizeof(zstd_magic) &&
+        std::memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0 )
+    {
+        throw std::string("Zstandard-compressed input is not supported!");
+    }
+    gzip = magic_size >= sizeof(gzip_magic) &&
+           std::memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0;
+
+    // Let the kernel read ahead further (fails harmlessly for pipes)
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for(int n = 0; n < blocks; ++n)
+        ring[n].data = new char[block_size];
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+    if(pthread_create(&thread, NULL, run, this) != 0)
+    {
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+        for(int n = 0; n < blocks; ++n)
+            delete[] ring[n].data;
+        throw std::string("Unable to start reader thread!");
+    }
+}
+
+CompressedInput::~CompressedInput()
+{
+    pthread_mutex_lock(&mutex);
+    stop = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+    for(int n = 0; n < blocks; ++n)
+        delete[] ring[n].data;
+}
+
+bool CompressedInput::compressed() const
+{
+    return gzip;
+}
+
+void *CompressedInput::run(void *arg)
+{
+    ((CompressedInput*)arg)->fill();
+    return NULL;
+}
+
+/* Reads (and decompresses) data into a block. Returns false at the end of
+   the input, or if an error occurred, which is stored in 'failure'. */
+bool CompressedInput::read_block( Block &block, z_stream &z,
+                                  unsigned char *in, size_t in_size,
+                                  bool &member, std::string &failure )
+{
+    if(!gzip)
+    {
+        block.size += std::fread( block.data + block.size, 1,
+                                  block_size - block.size, fp );
+        if(block.size == block_size)
+            return true;
+        if(std::ferror(fp))
+            failure = "Unable to read input!";
+        return false;
+    }
+
+    while(block.size < block_size)
+    {
+        if(z.avail_in == 0)
+        {
+            z.next_in = in;
+            z.avail_in = std::fread(in, 1, in_size, fp);
+            if(z.avail_in == 0)
+            {
+                if(std::ferror(fp))
+                    failure = "Unable to read input!";
+                else
+                if(member)
+                    failure = "Unexpected end of compressed input!";
+                return false;
+            }
+        }
+
+        z.next_out = (Bytef*)block.data + block.size;
+        z.avail_out = block_size - block.size;
+        int r = inflate(&z, Z_NO_FLUSH);
+        block.size = block_size - z.avail_out;
+        if(r == Z_STREAM_END)
+        {
+            // Another member may follow
+            inflateReset(&z);
+            member = false;
+        }
+        else
+        if(r == Z_OK || r == Z_BUF_ERROR)
+            member = true;
+        else
+        {
+            failure = "Corrupt compressed input!";
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Fills blocks until the end of the input, an error, or the reader stops.
+   The bytes read by the constructor are put back first: at the start of the
+   first block, or of the compressed data. */
+void CompressedInput::fill()
+{
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    std::string failure;
+    if(gzip && inflateInit2(&z, 15 + 16) != Z_OK)
+        failure = "Unable to initialize decompression!";
+
+    unsigned char in[65536];
+    size_t pending = 0;
+    if(gzip)
+    {
+        std::memcpy(in, magic, magic_size);
+        z.next_in = in;
+        z.avail_in = magic_size;
+    }
+    else
+        pending = magic_size;
+
+    bool member = true, more = failure.empty();
+    while(more)
+    {
+        pthread_mutex_lock(&mutex);
+        while(!stop && filled - consumed == blocks)
+            pthread_cond_wait(&changed, &mutex);
+        bool stopped = stop;
+        pthread_mutex_unlock(&mutex);
+        if(stopped)
+            break;
+
+        Block &block = ring[filled % blocks];
+        std::memcpy(block.data, magic, pending);
+        block.size = pending;
+        pending = 0;
+        more = read_block(block, z, in, sizeof(in), member, failure);
+
+        pthread_mutex_lock(&mutex);
+        if(block.size > 0)
+            ++filled;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    if(gzip)
+        inflateEnd(&z);
+
+    pthread_mutex_lock(&mutex);
+    error = failure;
+    done = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+}
+
+size_t CompressedInput::read(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&mutex);
+    while(filled == consumed && !done)
+        pthread_cond_wait(&changed, &mutex);
+    bool empty = filled == consumed;
+    pthread_mutex_unlock(&mutex);
+    if(empty)
+    {
+        // The thread is done, so 'error' is no longer changed
+        if(error.empty())
+            return 0;
+        if(!reported)
+            std::cerr << '\n' << error << std::flush;
+        reported = true;
+        return (size_t)-1;
+    }
+
+    const Block &block = ring[consumed % blocks];
+    size_t len = std::min(size, block.size - offset);
+    std::memcpy(buffer, block.data + offset, len);
+    offset += len;
+    if(offset == block.size)
+    {
+        offset = 0;
+        pthread_mutex_lock(&mutex);
+        ++consumed;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    return len;
+}
+
+size_t CompressedInput::reader(void *arg, char *buffer, size_t size)
+{
+    return ((CompressedInput*)arg)->read(buffer, size);
+}
+
+
+CompressedOutput::CompressedOutput(FILE *fp, int level)
+    : fp(fp), pipe_fp(NULL), fd(-1), level(level), failed(false)
+{
+    int fds[2];
+    if(pipe(fds) != 0)
+        throw std::string("Unable to create pipe!");
+    if((pipe_fp = fdopen(fds[1], "w")) == NULL)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        throw std::string("Unable to create pipe!");
+    }
+    fd = fds[0];
+    std::setvbuf(pipe_fp, NULL, _IOFBF, 65536);
+    if(pthread_create(&thread, NULL, run, this) != 0)
+    {
+        std::fclose(pipe_fp);
+        close(fd);
+        throw std::string("Unable to start compression thread!");
+    }
+}
+
+CompressedOutput::~CompressedOutput()
+{
+    if(pipe_fp == NULL)
+        return;
+    std::fclose(pipe_fp);
+    pthread_join(thread, NULL);
+    close(fd);
+}
+
+FILE *CompressedOutput::file() const
+{
+    return pipe_fp;
+}
+
+void *CompressedOutput::run(void *arg)
+{
+    ((CompressedOutput*)arg)->compress();
+    return NULL;
+}
+
+/* Compresses the contents of the pipe until it is closed. After an error
+   the pipe is still drained, so that writers do not block. */
+void CompressedOutput::compress()
+{
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    failed = deflateInit2( &z, level, Z_DEFLATED, 15 + 16, 8,
+                           Z_DEFAULT_STRATEGY ) != Z_OK;
+
+    unsigned char in[65536], out[65536];
+    for(;;)
+    {
+        ssize_t len = ::read(fd, in, sizeof(in));
+        if(len < 0)
+        {
+            failed = true;
+            break;
+        }
+        if(failed)
+        {
+            if(len == 0)
+                break;
+            continue;
+        }
+
+        z.next_in = in;
+        z.avail_in = len;
+        int flush = len == 0 ? Z_FINISH : Z_NO_FLUSH, r;
+        do
+        {
+            z.next_out = out;
+            z.avail_out = sizeof(out);
+            r = deflate(&z, flush);
+            size_t size = sizeof(out) - z.avail_out;
+            if(r == Z_STREAM_ERROR || std::fwrite(out, 1, size, fp) != size)
+                failed = true;
+        } while( !failed && (z.avail_out == 0 ||
+                             (flush == Z_FINISH && r != Z_STREAM_END)) );
+        if(len == 0)
+            break;
+    }
+    deflateEnd(&z);
+    if(std::fflush(fp) != 0)
+        failed = true;
+}
+
+void CompressedOutput::finish()
+{
+    bool closed = std::fclose(pipe_fp) == 0;
+    pipe_fp = NULL;
+    pthread_join(thread, NULL);
+    close(fd);
+    if(!closed || failed)
+        throw std::string("Unable to write output!");
+}
@@ -0,0 +1,100 @@
+#ifndef COMPRESSED_STREAM_H_INCLUDED
+#define COMPRESSED_STREAM_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <pthread.h>
+#include <zlib.h>
+
+/*
+Reads a file that may be gzip-compressed, for parse_turtle(): pass reader()
+as the reader function, with the CompressedInput as its argument.
+
+A separate thread reads the file ahead into a ring of 'blocks' buffers of
+'block_size' bytes, so that reading from disk overlaps with parsing, and the
+kernel is advised that the file is read sequentially. The format is detected
+from the first bytes of the file; gzip-compressed data is decompressed by the
+same thread. Files of concatenated gzip members (as written by pigz or cat)
+are read as one. Zstandard-compressed files are recognized, but not
+supported.
+
+The constructor throws a string if the format is not supported or the
+thread cannot be started; read errors are reported on std::cerr, after
+which reader() returns (size_t)-1.
+*/
+class CompressedInput
+{
+    CompressedInput(const CompressedInput&);
+    CompressedInput &operator=(const CompressedInput&);
+
+    enum { block_size = 1 << 20, blocks = 4 };
+
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    FILE *fp;
+    bool gzip;
+    unsigned char magic[4];         // first bytes, read to detect the format
+    size_t magic_size;
+
+    Block ring[blocks];
+    size_t filled, consumed;        // blocks filled and consumed in total
+    size_t offset;                  // in the block being consumed
+    bool done, stop;
+    std::string error;
+    bool reported;                  // if the error was written to std::cerr
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+
+    static void *run(void *arg);
+    void fill();
+    bool read_block( Block &block, z_stream &z, unsigned char *in,
+                     size_t in_size, bool &member, std::string &failure );
+
+public:
+    explicit CompressedInput(FILE *fp);
+    ~CompressedInput();
+
+    bool compressed() const;
+    size_t read(char *buffer, size_t size);
+
+    static size_t reader(void *arg, char *buffer, size_t size);
+};
+
+/*
+Writes gzip-compressed data to 'fp'. Output is written to file(), a pipe
+whose contents are compressed on a separate thread, so that any code that
+writes to a FILE* can produce compressed output, and compression overlaps
+with formatting the output.
+
+finish() must be called after the last write; it closes file(), waits for
+the compressed data to be written, and throws a string if this failed. The
+destructor finishes the output (ignoring errors) if this was not done.
+*/
+class CompressedOutput
+{
+    CompressedOutput(const CompressedOutput&);
+    CompressedOutput &operator=(const CompressedOutput&);
+
+    FILE *fp, *pipe_fp;
+    int fd;
+    int level;
+    bool failed;
+    pthread_t thread;
+
+    static void *run(void *arg);
+    void compress();
+
+public:
+    explicit CompressedOutput(FILE *fp, int level = Z_DEFAULT_COMPRESSION);
+    ~CompressedOutput();
+
+    FILE *file() const;
+    void finish();
+};
+
+#endif /* ndef COMPRESSED_STREAM_H_INCLUDED */
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdio>
+#include "construct_writer.h"
+
+ConstructWriter::ConstructWriter( sqlite3 *db, const Pattern::Quads &tmpl,
+                                  TripleWriter *out )
+    : tmpl(tmpl), out(out), cache(db), columns(0)
+{
+}
+
+ConstructWriter::~ConstructWriter()
+{
+    delete out;
+}
+
+bool ConstructWriter::wants_ids() const
+{
+    return true;
+}
+
+void ConstructWriter::head(const std::vector<std::string> &vars)
+{
+    columns = vars.size();
+    slots.clear();
+    for( Pattern::Quads::const_iterator i = tmpl.begin();
+         i != tmpl.end(); ++i )
+    {
+        for(int f = 1; f < 4; ++f)
+        {
+            const Node &node = (*i)[f];
+            Slot slot;
+            slot.column = -1;
+            slot.literal = node.type == Node::literal;
+            slot.lexical = node.lexical;
+            slot.datatype = node.datatype;
+            if(node.type == Node::variable)
+            {
+                std::vector<std::string>::const_iterator j =
+                    std::find(vars.begin(), vars.end(), node.lexical);
+                slot.column = j == vars.end() ? vars.size() : j - vars.begin();
+            }
+            slots.push_back(slot);
+        }
+    }
+}
+
+void ConstructWriter::result(const Term *terms)
+{
+    for(size_t n = 0; n < slots.size(); n += 3)
+    {
+        const char *lexical[3], *datatype[3];
+        bool literal[3];
+        int k = 0;
+        for(; k < 3; ++k)
+        {
+            const Slot &slot = slots[n + k];
+            if(slot.column < 0)
+            {
+                literal[k] = slot.literal;
+                lexical[k] = slot.lexical.c_str();
+                datatype[k] = slot.datatype.c_str();
+                continue;
+            }
+
+            nid_t id = size_t(slot.column) < columns ? terms[slot.column].id : -1;
+            if(id < 0)
+                break;
+            const TermCache::Entry &entry = cache.lookup(id);
+            literal[k] = entry.literal;
+            lexical[k] = entry.lexical.c_str();
+            datatype[k] = entry.datatype.c_str();
+        }
+
+        if(k == 3 && !literal[0] && !literal[1])
+            out->triple( lexical[0], lexical[1], lexical[2],
+                         literal[2] ? datatype[2] : NULL );
+    }
+    cache.trim();
+}
+
+void ConstructWriter::end()
+{
+    out->end();
+}
+
+void ConstructWriter::error(const char *msg)
+{
+    out->end();
+    std::fprintf(stderr, "%s\n", msg);
+}
@@ -0,0 +1,52 @@
+#ifndef CONSTRUCT_WRITER_H_INCLUDED
+#define CONSTRUCT_WRITER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "sparql_parser.h"
+#include "result_writer.h"
+#include "term_decoder.h"
+#include "turtle_writer.h"
+
+/*
+Instantiates the template of a CONSTRUCT query for each solution, and writes
+the resulting triples to a TripleWriter.
+
+Solutions are received as node identifiers of the variables in the template
+(see Query::projection), and nodes are only decoded when a triple is written.
+Triples in which a variable is unbound, the subject is a literal, or the
+predicate is not a resource, are skipped. Errors are written to standard
+error, as RDF serializations cannot report them in-band.
+*/
+class ConstructWriter : public ResultWriter
+{
+    /* A position in the template: either the index of a variable in the
+       solution, or a constant. Variables that the pattern does not bind
+       are never bound. */
+    struct Slot
+    {
+        int column;             // or -1 for constants
+        bool literal;
+        std::string lexical, datatype;
+    };
+
+    const Pattern::Quads &tmpl;
+    TripleWriter *out;
+    TermCache cache;
+    std::vector<Slot> slots;
+    size_t columns;
+
+public:
+    ConstructWriter( sqlite3 *db, const Pattern::Quads &tmpl,
+                     TripleWriter *out );
+    ~ConstructWriter();
+
+    bool wants_ids() const;
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+};
+
+#endif /* ndef CONSTRUCT_WRITER_H_INCLUDED */
@@ -18,6 +18,13 @@ CREATE INDEX Quad_spo ON Quad (s, p, o);
 CREATE INDEX Quad_po  ON Quad (p, o);
 CREATE INDEX Quad_o   ON QUAD (o);
 
+-- Native values of typed literals (see typed_value.h)
+-- n: node (references Node.rowid)
+-- t: value class (3: numeric, 4: dateTime)
+-- v: value (integer or real)
+CREATE TABLE Value (n INTEGER PRIMARY KEY, t, v);
+CREATE INDEX Value_tv ON Value (t, v);
+
 -- Node identifiers for built-in datatypes
 INSERT INTO Node (oid, l, d) VALUES ( 0, NULL,           0); -- uri
 INSERT INTO Node (oid, l, d) VALUES ( 1, '',             0); -- lexical
@@ -1,11 +1,16 @@
 #include <algorithm>
-#include <iostream>
-#include <sstream>
-#include <string>
-#include <map>
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
 #include <libgen.h>
+#include <sstream>
 #include <sqlite3.h>
+#include <vector>
+#include "turtle_writer.h"
+#include "term_decoder.h"
+#include "parallel_export.h"
+#include "binary_dump.h"
+#include "compressed_stream.h"
 
 /* FIXME
     This tool assumes the database is consistent (ie. subject is never NULL);
@@ -15,17 +20,13 @@
 /* TODO
     - support for blank nodes
     - convert built-in types
-    - test generation of namespace prefixes longer than 1 character
 
     Needs command line options for:
         - disabling automatic URI abbreviation
-        - outputing in (a variant of) NTRIPLES format
         - listing all models in the database
         - (maybe: dropping all models in the database)
 */
 
-typedef long long int nid_t;
-
 sqlite3_stmt *prepare(sqlite3 *db, const char *sql)
 {
     sqlite3_stmt *stmt;
@@ -38,177 +39,439 @@ sqlite3_stmt *prepare(sqlite3 *db, const char *sql)
     return stmt;
 }
 
-void write_escaped( std::ostream &os, const char *str, char extra )
+/* Reads rows of (subject, predicate, object) node identifiers from 'stmt',
+   decodes them through 'cache' (looking up the nodes of 'batch_rows' rows at
+   a time) and passes them to 'writer'. */
+int list_triples(TripleWriter &writer, sqlite3_stmt *stmt, TermCache &cache)
 {
-    while(true)
+    const size_t batch_rows = 4096;
+    std::vector<nid_t> ids;
+    int r = SQLITE_ROW;
+    while(r == SQLITE_ROW)
     {
-        switch(*str)
+        ids.clear();
+        while( ids.size() < 3*batch_rows &&
+               (r = sqlite3_step(stmt)) == SQLITE_ROW )
         {
-        case 0x00:
-            return;
-        case 0x09:
-            os.write("\\t", 2);
-            break;
-        case 0x0A:
-            os.write("\\n", 2);
-            break;
-        case 0x0D:
-            os.write("\\r", 2);
-            break;
-        case 0x5C:
-            os.write("\\\\", 2);
-            break;
-        default:
-            if(*str == extra)
-                os.put('\\');
-            os.put(*str);
+            for(int col = 0; col < 3; ++col)
+                ids.push_back(sqlite3_column_int64(stmt, col));
         }
-        ++str;
-    }
-}
 
-void write_uri(std::ostream &os, const char *uri)
-{
-    os.put('<');
-    write_escaped(os, uri, '>');
-    os.put('>');
+        cache.trim();
+        cache.prefetch(ids);
+        for(size_t n = 0; n < ids.size(); n += 3)
+        {
+            const TermCache::Entry &s = cache.lookup(ids[n]),
+                                   &p = cache.lookup(ids[n + 1]),
+                                   &o = cache.lookup(ids[n + 2]);
+            writer.triple( s.lexical.c_str(), p.lexical.c_str(),
+                           o.lexical.c_str(),
+                           o.literal ? o.datatype.c_str() : NULL );
+        }
+    }
+    writer.end();
+    return r;
 }
 
-void write_string(std::ostream &os, const char *str)
+/* Returns true if the statement returns a row, or false if it does not;
+   other results are returned in 'r'. */
+static bool exists(sqlite3_stmt *stmt, int &r)
 {
-    os.put('"');
-    write_escaped(os, str, '"');
-    os.put('"');
+    r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if(r == SQLITE_ROW)
+    {
+        r = SQLITE_DONE;
+        return true;
+    }
+    return false;
 }
 
-int list_ntriples(std::ostream &os, sqlite3_stmt *stmt)
+/* Returns the namespaces (URIs up to the first '#') used by the resources
+   and datatypes of a model, sorted. Candidates are the namespaces of all URIs
+   and datatypes in the database, which are few; each is then checked for a
+   URI that is used by the model, which usually succeeds on the first URI it
+   tries. (The unary '+' operators make sure these checks use the indexes on
+   the nodes rather than scanning all quads of the model.) */
+static int find_namespaces( sqlite3 *db, nid_t model_nid,
+                            std::vector<std::string> &namespaces )
 {
-    int r;
-    while((r = sqlite3_step(stmt)) == SQLITE_ROW)
+    sqlite3_stmt *candidates = prepare( db,
+        "SELECT DISTINCT substr(l, 1, instr(l, '#')) FROM Node "
+        "WHERE d=0 AND instr(l, '#') > 0" );
+    sqlite3_stmt *used = prepare( db,
+        "SELECT 1 FROM Node n WHERE n.l >= ?2 AND n.l < ?3 AND n.d=0 AND "
+        "(EXISTS (SELECT 1 FROM Quad WHERE m=?1 AND s=+n.oid) OR "
+        "EXISTS (SELECT 1 FROM Quad WHERE p=+n.oid AND +m=?1) OR "
+        "EXISTS (SELECT 1 FROM Quad WHERE o=+n.oid AND +m=?1)) LIMIT 1" );
+    sqlite3_stmt *datatypes = prepare( db,
+        "SELECT oid, l FROM Node WHERE oid IN "
+        "(SELECT DISTINCT d FROM Node WHERE d > 1)" );
+    sqlite3_stmt *typed = prepare( db,
+        "SELECT 1 FROM Node n, Quad q "
+        "WHERE n.d=?2 AND q.o=+n.oid AND +q.m=?1 LIMIT 1" );
+    int r = SQLITE_ABORT;
+    if(candidates && used && datatypes && typed)
     {
-        const char *subj = (const char*)sqlite3_column_text(stmt, 0),
-                   *pred = (const char*)sqlite3_column_text(stmt, 1),
-                   *obj  = (const char*)sqlite3_column_text(stmt, 2),
-                   *type = (const char*)sqlite3_column_text(stmt, 3);
-        write_uri(os, subj);
-        os.put(' ');
-        write_uri(os, pred);
-        os.put(' ');
-        if(type == NULL)
-            write_uri(os, obj);
-        else
+        sqlite3_bind_int64(used, 1, model_nid);
+        while((r = sqlite3_step(candidates)) == SQLITE_ROW)
         {
-            write_string(os, obj);
-            if(*type)
-            {
-                os.write("^^", 2);
-                write_uri(os, type);
-            }
+            // URIs in the namespace sort before it with '#' replaced by '$'
+            std::string ns((const char*)sqlite3_column_text(candidates, 0),
+                           sqlite3_column_bytes(candidates, 0));
+            std::string next(ns);
+            next[next.size() - 1] = '$';
+            sqlite3_bind_text(used, 2, ns.data(), ns.size(), SQLITE_STATIC);
+            sqlite3_bind_text( used, 3, next.data(), next.size(),
+                               SQLITE_STATIC );
+            if(exists(used, r))
+                namespaces.push_back(ns);
+            else
+            if(r != SQLITE_DONE)
+                break;
         }
-        os.write(".\n", 2);
     }
+    if(r == SQLITE_DONE)
+    {
+        sqlite3_bind_int64(typed, 1, model_nid);
+        while((r = sqlite3_step(datatypes)) == SQLITE_ROW)
+        {
+            const char *uri = (const char*)sqlite3_column_text(datatypes, 1);
+            const char *p = uri ? std::strchr(uri, '#') : NULL;
+            if(p == NULL)
+                continue;
+            sqlite3_bind_int64(typed, 2, sqlite3_column_int64(datatypes, 0));
+            if(exists(typed, r))
+                namespaces.push_back(std::string(uri, p + 1));
+            else
+            if(r != SQLITE_DONE)
+                break;
+        }
+    }
+    sqlite3_finalize(candidates);
+    sqlite3_finalize(used);
+    sqlite3_finalize(datatypes);
+    sqlite3_finalize(typed);
+
+    std::sort(namespaces.begin(), namespaces.end());
+    namespaces.erase( std::unique(namespaces.begin(), namespaces.end()),
+                      namespaces.end() );
     return r;
 }
 
-void write_resource(
-    std::ostream &os_statement,
-    std::ostream &os_prefix,
-    std::map<std::string, std::string> &abbreviations,
-    const char *uri )
+/* Writes the contents of a model in Turtle format, grouped by subject, with
+   the prefixes of all namespaces declared up front. */
+int export_turtle(sqlite3 *db, nid_t model_nid, FILE *fp)
 {
-    const char *p = strchr(uri, '#');
-    if(p == NULL)
-        write_uri(os_statement, uri);
-    else
-    {
-        std::string ns(uri, ++p);
-        std::string &abbr = abbreviations[ns];
-        if(abbr.empty())
-        {
-            // Pick a new abbreviation
-            for(int id = abbreviations.size(); id != 0; id /= 26)
-                abbr += char('a' + id - 1);
-            std::reverse(abbr.begin(), abbr.end());
-            os_prefix << "@prefix " << abbr << ": ";
-            write_uri(os_prefix, ns.c_str());
-            os_prefix << ".\n";
-        }
-        os_statement << abbr << ':' << p;
+    std::vector<std::string> namespaces;
+    int r = find_namespaces(db, model_nid, namespaces);
+    if(r != SQLITE_DONE)
+        return r;
+
+    sqlite3_stmt *stmt = prepare( db,
+        "SELECT s, p, o FROM Quad WHERE m=?1 ORDER BY s, p, o" );
+    if(stmt == NULL)
+        return SQLITE_ABORT;
+    sqlite3_bind_int64(stmt, 1, model_nid);
+
+    try {
+        TermCache cache(db);
+        TurtleWriter writer(fp, namespaces);
+        r = list_triples(writer, stmt, cache);
+    } catch(...) {
+        sqlite3_finalize(stmt);
+        throw;
     }
+    sqlite3_finalize(stmt);
+    return r;
 }
 
-int list_turtle(std::ostream &os, sqlite3_stmt *stmt)
+/* A node of a model, as written to a binary dump. Its 'type' is 0 for
+   URIs, 1 for plain literals and 2 + the position of its datatype in the
+   (oid-ordered) nodes for typed literals. */
+struct DumpNode
 {
-    std::map<std::string, std::string> abbreviations;
-    std::ostringstream oss;
-    std::string last_subj, last_pred;
+    nid_t oid, datatype;
+    size_t type;
+    std::string lexical;
+};
 
-    int r;
-    while((r = sqlite3_step(stmt)) == SQLITE_ROW)
+static bool operator<(const DumpNode &node, nid_t oid)
+{
+    return node.oid < oid;
+}
+
+/* Returns the position of a node in 'nodes', which are sorted by oid, or
+   the number of nodes if it is missing. */
+static size_t find(const std::vector<DumpNode> &nodes, nid_t oid)
+{
+    std::vector<DumpNode>::const_iterator i =
+        std::lower_bound(nodes.begin(), nodes.end(), oid);
+    return i == nodes.end() || i->oid != oid ? nodes.size() : i - nodes.begin();
+}
+
+static size_t position(const std::vector<DumpNode> &nodes, nid_t oid)
+{
+    size_t n = find(nodes, oid);
+    if(n == nodes.size())
+        throw "Node is missing from dump!";
+    return n;
+}
+
+/* Orders the positions of nodes as in the dictionary of a binary dump: by
+   lexical form, then URIs before plain literals before typed literals, which
+   are ordered by datatype URI. */
+struct DumpOrder
+{
+    const std::vector<DumpNode> &nodes;
+
+    DumpOrder(const std::vector<DumpNode> &nodes) : nodes(nodes) { }
+
+    bool operator()(size_t a, size_t b) const
     {
-        const char *subj = (char*)sqlite3_column_text(stmt, 0),
-                   *pred = (char*)sqlite3_column_text(stmt, 1),
-                   *obj  = (char*)sqlite3_column_text(stmt, 2),
-                   *type = (char*)sqlite3_column_text(stmt, 3);
+        const DumpNode &x = nodes[a], &y = nodes[b];
+        if(int c = x.lexical.compare(y.lexical))
+            return c < 0;
+        if(x.type < 2 || y.type < 2 || x.type == y.type)
+            return x.type < y.type;
+        return nodes[x.type - 2].lexical < nodes[y.type - 2].lexical;
+    }
+};
 
-        if(last_subj != subj)
-        {
-            if(!oss.str().empty())
-                (os << oss.str()).write(".\n", 2);
-            oss.str("");
-            last_subj.assign(subj);
-            last_pred.assign(pred);
-
-            // Write subject and predicate
-            write_resource(oss, os, abbreviations, subj);
-            oss.put(' ');
-            write_resource(oss, os, abbreviations, pred);
-        }
-        else
-        if(last_pred != pred)
-        {
-            oss.write(";\n\t", 3);
-            last_pred.assign(pred);
+static DumpNode read_node(sqlite3_stmt *stmt)
+{
+    DumpNode node;
+    node.oid = sqlite3_column_int64(stmt, 0);
+    const char *l = (const char*)sqlite3_column_text(stmt, 1);
+    node.lexical.assign(l ? l : "", sqlite3_column_bytes(stmt, 1));
+    node.datatype = sqlite3_column_int64(stmt, 2);
+    node.type = 0;
+    return node;
+}
 
-            // Write predicate
-            write_resource(oss, os, abbreviations, pred);
-        }
-        else
+/* Appends the nodes with the identifiers in 'ids', which are sorted, to
+   'nodes'. If the identifiers are dense (as for a model that makes up most
+   of the database) their range of the Node table is scanned, otherwise they
+   are looked up 'batch_size' at a time. */
+static int read_nodes( sqlite3 *db, const std::vector<nid_t> &ids,
+                       std::vector<DumpNode> &nodes )
+{
+    const size_t batch_size = 256;
+    if(!ids.empty() && ids.back() - ids.front() < nid_t(4*ids.size()))
+    {
+        sqlite3_stmt *stmt = prepare( db,
+            "SELECT oid, l, d FROM Node WHERE oid BETWEEN ?1 AND ?2" );
+        if(stmt == NULL)
+            return SQLITE_ABORT;
+        sqlite3_bind_int64(stmt, 1, ids.front());
+        sqlite3_bind_int64(stmt, 2, ids.back());
+        std::vector<nid_t>::const_iterator i = ids.begin();
+        int r;
+        while((r = sqlite3_step(stmt)) == SQLITE_ROW)
         {
-            oss.put(',');
+            nid_t oid = sqlite3_column_int64(stmt, 0);
+            while(*i < oid)
+                ++i;
+            if(*i == oid)
+                nodes.push_back(read_node(stmt));
         }
+        sqlite3_finalize(stmt);
+        return r;
+    }
 
-        // Write object
-        oss.put(' ');
-        if(type == NULL)
-            write_resource(oss, os, abbreviations, obj);
-        else
+    std::ostringstream sql;
+    sql << "SELECT oid, l, d FROM Node WHERE oid IN (";
+    for(size_t n = 1; n <= batch_size; ++n)
+        sql << (n == 1 ? "?" : ", ?") << n;
+    sql << ')';
+    sqlite3_stmt *stmt = prepare(db, sql.str().c_str());
+    if(stmt == NULL)
+        return SQLITE_ABORT;
+
+    int r = SQLITE_DONE;
+    for( size_t first = 0; first < ids.size() && r == SQLITE_DONE;
+         first += batch_size )
+    {
+        for(size_t n = 0; n < batch_size; ++n)
         {
-            write_string(oss, obj);
-            if(*type)
-            {
-                oss.write("^^", 2);
-                write_resource(oss, os, abbreviations, type);
-            }
+            if(first + n < ids.size())
+                sqlite3_bind_int64(stmt, n + 1, ids[first + n]);
+            else
+                sqlite3_bind_null(stmt, n + 1);
         }
+        while((r = sqlite3_step(stmt)) == SQLITE_ROW)
+            nodes.push_back(read_node(stmt));
+        sqlite3_reset(stmt);
     }
-    
-    // Write final statement
-    if(!oss.str().empty())
-        (os << oss.str()).write(".\n", 2);
-    
+    sqlite3_finalize(stmt);
     return r;
 }
 
+static bool oid_order(const DumpNode &a, const DumpNode &b)
+{
+    return a.oid < b.oid;
+}
+
+/* Writes the contents of a model as a binary dump (see binary_dump.h). */
+int export_binary(sqlite3 *db, nid_t model_nid, FILE *fp)
+{
+    // Read triples of node identifiers
+    sqlite3_stmt *stmt = prepare(db, "SELECT s, p, o FROM Quad WHERE m=?1");
+    if(stmt == NULL)
+        return SQLITE_ABORT;
+    sqlite3_bind_int64(stmt, 1, model_nid);
+    std::vector<DumpTriple> triples;
+    std::vector<nid_t> ids;
+    int r;
+    while((r = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        DumpTriple t = { (unsigned long long)sqlite3_column_int64(stmt, 0),
+                         (unsigned long long)sqlite3_column_int64(stmt, 1),
+                         (unsigned long long)sqlite3_column_int64(stmt, 2) };
+        triples.push_back(t);
+        ids.push_back(t.subj);
+        ids.push_back(t.pred);
+        ids.push_back(t.obj);
+    }
+    sqlite3_finalize(stmt);
+    if(r != SQLITE_DONE)
+        return r;
+
+    // Read their nodes, and then the datatypes of their literals
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::vector<DumpNode> nodes;
+    if((r = read_nodes(db, ids, nodes)) != SQLITE_DONE)
+        return r;
+    ids.clear();
+    for(size_t n = 0; n < nodes.size(); ++n)
+    {
+        if(nodes[n].datatype > 1)
+            ids.push_back(nodes[n].datatype);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::sort(nodes.begin(), nodes.end(), oid_order);
+    std::vector<nid_t> datatypes;
+    for(size_t n = 0; n < ids.size(); ++n)
+    {
+        if(find(nodes, ids[n]) == nodes.size())
+            datatypes.push_back(ids[n]);
+    }
+    size_t read = nodes.size();
+    if((r = read_nodes(db, datatypes, nodes)) != SQLITE_DONE)
+        return r;
+    std::sort(nodes.begin() + read, nodes.end(), oid_order);
+    std::inplace_merge( nodes.begin(), nodes.begin() + read, nodes.end(),
+                        oid_order );
+    for(size_t n = 0; n < nodes.size(); ++n)
+    {
+        DumpNode &node = nodes[n];
+        node.type = node.datatype < 2 ? node.datatype
+                                      : 2 + position(nodes, node.datatype);
+    }
+
+    // Number nodes in dictionary order
+    std::vector<size_t> order(nodes.size());
+    for(size_t n = 0; n < order.size(); ++n)
+        order[n] = n;
+    std::sort(order.begin(), order.end(), DumpOrder(nodes));
+    std::vector<unsigned long long> rank(nodes.size());
+    for(size_t n = 0; n < order.size(); ++n)
+        rank[order[n]] = n;
+
+    // Renumber triples, and sort them by their new numbers
+    for(size_t n = 0; n < triples.size(); ++n)
+    {
+        DumpTriple &t = triples[n];
+        t.subj = rank[position(nodes, t.subj)];
+        t.pred = rank[position(nodes, t.pred)];
+        t.obj  = rank[position(nodes, t.obj)];
+    }
+    std::sort(triples.begin(), triples.end());
+
+    // Write dump
+    DumpWriter writer(fp);
+    for(size_t n = 0; n < order.size(); ++n)
+    {
+        const DumpNode &node = nodes[order[n]];
+        writer.node( node.lexical, node.type < 2 ? node.type
+                                                 : 2 + rank[node.type - 2] );
+    }
+    for(size_t n = 0; n < triples.size(); ++n)
+        writer.triple(triples[n]);
+    writer.finish();
+    if(std::ferror(fp))
+        throw "Unable to write output!";
+    return SQLITE_DONE;
+}
+
+void usage(char *argv0, bool fatal = true)
+{
+    std::cout << "Usage: " << basename(argv0)
+              << " [-f|--format turtle|ntriples|nquads|binary]\n"
+                 "\t[-b|--binary] [-j|--jobs <threads>] [-z|--gzip]"
+                 " <database> <model uri>\n"
+                 "   or: " << basename(argv0)
+              << " --all [-j|--jobs <threads>] [-z|--gzip] <database>"
+              << std::endl;
+    exit(fatal ? 1 : 0);
+}
+
 int main(int argc, char *argv[])
 {
-    if(argc != 3)
+    if(argc < 3)
+        usage(argv[0], argc != 1);
+
+    // Parse command line options
+    char *argv0 = *(argv++);
+    std::string format;
+    bool all = false, gzip = false;
+    int jobs = 1;
+    --argc;
+    while(argc > 1 && **argv == '-')
     {
-        std::cout << "Usage: " << basename(argv[0]) << " <database> <model uri>" << std::endl;
-        return 0;
+        std::string opt = *(argv++);
+        --argc;
+        if(opt == "-f" || opt == "--format")
+            format = *(argv++), --argc;
+        else
+        if(opt == "-j" || opt == "--jobs")
+        {
+            jobs = std::atoi(*(argv++)), --argc;
+            if(jobs < 1)
+                usage(argv0);
+        }
+        else
+        if(opt == "-a" || opt == "--all")
+            all = true;
+        else
+        if(opt == "-b" || opt == "--binary")
+            format = "binary";
+        else
+        if(opt == "-z" || opt == "--gzip")
+            gzip = true;
+        else
+            usage(argv0);
     }
-    const char *database_path = argv[1], *model_uri = argv[2];
-    
+    if(argc != (all ? 1 : 2))
+        usage(argv0);
+    const char *database_path = argv[0], *model_uri = all ? NULL : argv[1];
+
+    if(format.empty())
+        format = all ? "nquads" : "turtle";
+    if( format != "turtle" && format != "ntriples" && format != "nquads" &&
+        format != "binary" )
+    {
+        std::cerr << "Unknown format \"" << format << "\"!" << std::endl;
+        return 1;
+    }
+    if(all && format != "nquads")
+    {
+        std::cerr << "All models can only be exported as N-Quads!" << std::endl;
+        return 1;
+    }
+
     // Initialize sqlite
     sqlite3 *db;
     if(sqlite3_open(database_path, &db) != SQLITE_OK)
@@ -219,6 +482,7 @@ int main(int argc, char *argv[])
     
     // Get model node
     nid_t model_nid = -1;
+    if(!all)
     {
         sqlite3_stmt *stmt =
             prepare(db, "SELECT oid FROM Node WHERE l=?1 AND d=0");
@@ -248,28 +512,46 @@ int main(int argc, char *argv[])
         }
     }
 
-    // List contents of model
-    sqlite3_stmt *stmt = prepare( db,
-        "SELECT "
-        "(SELECT l FROM Node WHERE oid=s), "
-        "(SELECT l FROM Node WHERE oid=p), "
-        "(SELECT l FROM Node WHERE oid=o), "
-        "(SELECT d.l FROM Node n JOIN Node d ON n.d = d.oid WHERE n.oid=o) "
-        "FROM Quad WHERE m=?1" );
-    if(stmt == NULL)
-    {
-        sqlite3_close(db);
-        return 1;
+    // List contents of model(s)
+    int r = SQLITE_DONE;
+    CompressedOutput *compressed = NULL;
+    try {
+        FILE *fp = stdout;
+        if(gzip)
+        {
+            compressed = new CompressedOutput(stdout);
+            fp = compressed->file();
+        }
+
+        if(format == "turtle")
+            r = export_turtle(db, model_nid, fp);
+        else
+        if(format == "binary")
+            r = export_binary(db, model_nid, fp);
+        else
+        {
+            // Line-oriented formats can be written in parallel
+            ParallelExport exporter( database_path, model_nid,
+                                     format == "nquads", jobs );
+            exporter.execute(db, fp);
+        }
+
+        if(compressed)
+            compressed->finish();
+    } catch(const char *msg) {
+        std::cerr << msg << std::endl;
+        r = SQLITE_ABORT;
+    } catch(const std::string &msg) {
+        std::cerr << msg << std::endl;
+        r = SQLITE_ABORT;
     }
-    sqlite3_bind_int64(stmt, 1, model_nid);
-    int r = list_turtle(std::cout, stmt);
+    delete compressed;
     if(r == SQLITE_BUSY)
         std::cerr << "Database is busy!" << std::endl;
     else
-    if(r != SQLITE_DONE)
+    if(r != SQLITE_DONE && r != SQLITE_ABORT)
         std::cerr << "Database error!\nsqlite: "
                   << sqlite3_errmsg(db) << std::endl;
-    sqlite3_finalize(stmt);
     sqlite3_close(db);
     return (r == SQLITE_DONE) ? 0 : 1;
 }
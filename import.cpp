@@ -1,43 +1,26 @@
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <deque>
 #include <vector>
 #include <sqlite3.h>
 #include <libgen.h>
 #include "turtle_parser.h"
+#include "typed_value.h"
+#include "binary_dump.h"
+#include "compressed_stream.h"
+#include "import_pipeline.h"
 
 /* TODO
     - support for anonymous URI's
-    - convert built-in types
 */
 
-typedef long long int nid_t;
-
-
-/* Built-in datatypes */
-#define TYPE_URI        (0ll)
-#define TYPE_LITERAL    (1ll)
-#define TYPE_BOOLEAN    (2ll)
-#define TYPE_INTEGER    (3ll)
-#define TYPE_DATE_TIME  (4ll)
-#define TYPE_FLOAT      (5ll)
-#define TYPE_DOUBLE     (6ll)
-
-struct Triple
-{
-    nid_t subj, pred, obj;
-};
-
-inline bool operator< (const Triple &q, const Triple &r);
-inline bool operator== (const Triple &q, const Triple &r);
-inline bool operator!= (const Triple &q, const Triple &r);
-
 
 /*
  * SQL statements used.
  */
 
-#define STATEMENTS 5
+#define STATEMENTS 6
 
 static const char * const statements[STATEMENTS] = {
 #define SQL_FIND_NODE               ( 0)
@@ -55,6 +38,9 @@ static const char * const statements[STATEMENTS] = {
 
 #define SQL_LIST_QUADS              ( 4)
     "SELECT oid, s, p, o FROM Quad WHERE m=?1 ORDER BY s ASC, p ASC, o ASC",
+
+#define SQL_ADD_VALUE               ( 5)
+    "INSERT OR REPLACE INTO Value (n, t, v) VALUES (?1, ?2, ?3)",
 };
 
 static sqlite3 *db;
@@ -64,24 +50,38 @@ static std::deque<Triple> triples;
 static std::deque<Triple> added;
 static std::deque<nid_t> removed;
 
-bool operator< (const Triple &q, const Triple &r)
-{
-    return q.subj < r.subj || (q.subj == r.subj && (q.pred < r.pred ||
-        (q.pred == r.pred && q.obj < r.obj)));
-}
-
-bool operator== (const Triple &q, const Triple &r)
-{
-    return q.subj == r.subj && q.pred == r.pred && q.obj == r.obj;
-}
 
-bool operator!= (const Triple &q, const Triple &r)
+/* Stores the native value of a typed literal, if it has one. Numbers that
+   the parser has already decoded are not parsed again. */
+static bool add_value( nid_t id, const char *datatype, const char *lexical,
+                       const turtle_value *native )
 {
-    return q.subj != r.subj || q.pred != r.pred || q.obj != r.obj;
+    TypedValue value;
+    if(native != NULL && native->type != TURTLE_VALUE_BOOLEAN)
+    {
+        value.type    = VALUE_NUMERIC;
+        value.integer = native->type == TURTLE_VALUE_INTEGER;
+        value.i       = native->integer;
+        value.d       = native->real;
+    }
+    else
+    if(native != NULL || !parse_typed_value(datatype, lexical, value))
+        return true;
+
+    sqlite3_stmt *stmt = stmts[SQL_ADD_VALUE];
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_int  (stmt, 2, value.type);
+    bind_typed_value  (stmt, 3, value);
+    int r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return r == SQLITE_DONE;
 }
 
-
-static nid_t nid(const char *lexical, nid_t datatype)
+/* Returns the identifier of a node, which is added if it does not exist yet.
+   For literals, 'type_uri' is the datatype URI of new nodes, so that their
+   native values can be stored; 'native' is the value decoded by the parser. */
+static nid_t nid( const char *lexical, nid_t datatype,
+                  const char *type_uri = NULL, const turtle_value *native = NULL )
 {
     nid_t id = -1;
 
@@ -102,6 +102,10 @@ static nid_t nid(const char *lexical, nid_t datatype)
         if(sqlite3_step(stmt) == SQLITE_DONE)
             id = sqlite3_last_insert_rowid(db);
         sqlite3_reset(stmt);
+
+        if(id != -1 && type_uri != NULL &&
+            !add_value(id, type_uri, lexical, native))
+            id = -1;
     }
 
     if(id == -1)
@@ -114,30 +118,117 @@ static nid_t nid(const char *lexical, nid_t datatype)
     return id;
 }
 
-static int triple_handler( void *arg,
-    const char *subject, const char *predicate, const char *object,
-    const char *lexical, const char *datatype, const char *language )
+static int dump_node_handler( void *arg, unsigned long long id,
+                              const std::string &lexical,
+                              unsigned long long type )
 {
-    nid_t object_type;
-    if(object == NULL)
-        if(datatype == NULL)
-            object_type = TYPE_LITERAL;
-        else
-            object_type = nid(datatype, TYPE_URI);
-    else
-        object_type = TYPE_URI;
-
-    // Generate triple
-    Triple t = { nid(subject, TYPE_URI),
-                 nid(predicate, TYPE_URI),
-                 nid(object ? object : lexical, object_type) };
-    if(t.subj < 0 || t.pred < 0 || t.obj < 0)
-        return 1; // Unable to generate node ID's; abort parsing.
+    sqlite3_stmt *stmt = (sqlite3_stmt*)arg;
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_text (stmt, 2, lexical.data(), lexical.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, type);
+    int r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return r != SQLITE_DONE;
+}
 
-    triples.push_back(t);
+static int dump_triple_handler(void *arg, const DumpTriple &t)
+{
+    const std::vector<nid_t> &ids = *(const std::vector<nid_t>*)arg;
+    Triple triple = { ids[t.subj], ids[t.pred], ids[t.obj] };
+    triples.push_back(triple);
     return 0;
 }
 
+/* Reads the triples of a binary dump. Instead of looking up its nodes one
+   by one, the dictionary is loaded into a temporary table (created by
+   initialize_sqlite(), as schema changes would invalidate the prepared
+   statements), from which missing nodes are added and identifiers are
+   assigned with a few statements: first for URIs and plain literals, then
+   for typed literals, whose datatypes have identifiers by then. */
+static int read_dump(const DumpReader &dump)
+{
+    static const char * const resolve_sql =
+        "INSERT OR IGNORE INTO Node (l, d) "
+        "SELECT l, t FROM temp.Dump WHERE t < 2;"
+        "UPDATE temp.Dump SET n = "
+        "(SELECT oid FROM Node WHERE l = Dump.l AND d = Dump.t) WHERE t < 2;"
+        "INSERT OR IGNORE INTO Node (l, d) SELECT a.l, b.n "
+        "FROM temp.Dump a JOIN temp.Dump b ON b.i = a.t - 2 WHERE a.t >= 2;"
+        "UPDATE temp.Dump SET n = (SELECT Node.oid FROM Node, temp.Dump b "
+        "WHERE b.i = Dump.t - 2 AND Node.l = Dump.l AND Node.d = b.n) "
+        "WHERE t >= 2;";
+
+    sqlite3_stmt *insert = NULL, *select = NULL;
+    std::vector<nid_t> ids;
+    nid_t last = 0;
+    bool ok = true, reported = false;
+    try {
+        // Load dictionary
+        ok = sqlite3_prepare( db,
+            "INSERT INTO temp.Dump (i, l, t) VALUES (?1, ?2, ?3)",
+            -1, &insert, NULL ) == SQLITE_OK &&
+            dump.read_nodes(dump_node_handler, insert) == 0;
+
+        // Add missing nodes; new nodes have identifiers beyond 'last'
+        ok = ok && sqlite3_prepare( db,
+            "SELECT coalesce(max(oid), 0) FROM Node",
+            -1, &select, NULL ) == SQLITE_OK &&
+            sqlite3_step(select) == SQLITE_ROW;
+        if(ok)
+            last = sqlite3_column_int64(select, 0);
+        sqlite3_finalize(select);
+        select = NULL;
+        ok = ok && sqlite3_exec(db, resolve_sql, NULL, NULL, NULL) == SQLITE_OK;
+
+        // Store native values of new typed literals
+        ok = ok && sqlite3_prepare( db,
+            "SELECT a.n, b.l, a.l FROM temp.Dump a JOIN temp.Dump b "
+            "ON b.i = a.t - 2 WHERE a.t >= 2 AND a.n > ?1",
+            -1, &select, NULL ) == SQLITE_OK;
+        if(ok)
+        {
+            sqlite3_bind_int64(select, 1, last);
+            int r = SQLITE_DONE;
+            while(ok && (r = sqlite3_step(select)) == SQLITE_ROW)
+            {
+                ok = add_value( sqlite3_column_int64(select, 0),
+                                (const char*)sqlite3_column_text(select, 1),
+                                (const char*)sqlite3_column_text(select, 2),
+                                NULL );
+            }
+            ok = ok && r == SQLITE_DONE;
+        }
+        sqlite3_finalize(select);
+        select = NULL;
+
+        // Collect identifiers in dictionary order
+        ok = ok && sqlite3_prepare( db,
+            "SELECT n FROM temp.Dump ORDER BY i", -1, &select, NULL ) == SQLITE_OK;
+        int r = SQLITE_DONE;
+        while(ok && (r = sqlite3_step(select)) == SQLITE_ROW)
+        {
+            ok = sqlite3_column_type(select, 0) != SQLITE_NULL;
+            ids.push_back(sqlite3_column_int64(select, 0));
+        }
+        ok = ok && r == SQLITE_DONE && ids.size() == dump.node_count();
+
+        // Read triples
+        ok = ok && dump.read_triples(dump_triple_handler, &ids) == 0;
+    } catch(const char *msg) {
+        std::cerr << '\n' << msg;
+        ok = false, reported = true;
+    } catch(const std::string &msg) {
+        std::cerr << '\n' << msg;
+        ok = false, reported = true;
+    }
+    if(!ok && !reported)
+        std::cerr << "\nsqlite: " << sqlite3_errmsg(db);
+    sqlite3_finalize(insert);
+    sqlite3_finalize(select);
+    sqlite3_exec(db, "DELETE FROM temp.Dump;", NULL, NULL, NULL);
+    return ok ? 0 : 1;
+}
+
 static int compare_triples()
 {
     sqlite3_stmt *stmt = stmts[SQL_LIST_QUADS];
@@ -209,6 +300,24 @@ static int update_triples()
     return 0;
 }
 
+/* Increments the user_version of the database, which identifies the current
+   generation of its contents to result caches (see result_cache.h). */
+static int increment_generation()
+{
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, "PRAGMA user_version", -1, &stmt, NULL) != SQLITE_OK)
+        return 1;
+    int r = sqlite3_step(stmt);
+    long long generation = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    if(r != SQLITE_ROW)
+        return 1;
+
+    std::ostringstream sql;
+    sql << "PRAGMA user_version=" << (generation + 1) << ';';
+    return sqlite3_exec(db, sql.str().c_str(), NULL, NULL, NULL) != SQLITE_OK;
+}
+
 static void finalize_sqlite()
 {
     sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
@@ -217,7 +326,50 @@ static void finalize_sqlite()
     sqlite3_close(db);
 }
 
-static bool initialize_sqlite(const char *database_path, const char *model_uri)
+/* Creates the Value table in databases that predate it, and fills it with
+   the values of the typed literals in the Node table. */
+static bool create_value_table()
+{
+    if(has_value_table(db))
+        return true;
+
+    sqlite3_stmt *select = NULL, *insert = NULL;
+    bool ok =
+        sqlite3_exec(db, "BEGIN;" VALUE_TABLE_SQL, NULL, NULL, NULL) == SQLITE_OK &&
+        sqlite3_prepare(db, "SELECT n.oid, d.l, n.l FROM Node n"
+                            " JOIN Node d ON d.oid=n.d WHERE n.d > 1",
+                        -1, &select, NULL) == SQLITE_OK &&
+        sqlite3_prepare(db, statements[SQL_ADD_VALUE], -1, &insert, NULL) == SQLITE_OK;
+
+    int r = SQLITE_DONE;
+    while(ok && (r = sqlite3_step(select)) == SQLITE_ROW)
+    {
+        const char *datatype = (const char*)sqlite3_column_text(select, 1),
+                   *lexical  = (const char*)sqlite3_column_text(select, 2);
+        TypedValue value;
+        if(datatype && lexical && parse_typed_value(datatype, lexical, value))
+        {
+            sqlite3_bind_int64(insert, 1, sqlite3_column_int64(select, 0));
+            sqlite3_bind_int  (insert, 2, value.type);
+            bind_typed_value  (insert, 3, value);
+            ok = sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_reset(insert);
+        }
+    }
+    ok = ok && r == SQLITE_DONE;
+    sqlite3_finalize(select);
+    sqlite3_finalize(insert);
+
+    if(!ok || sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return false;
+    }
+    return true;
+}
+
+static bool initialize_sqlite( const char *database_path, const char *model_uri,
+                               bool binary )
 {
     // Initialize sqlite
     if(sqlite3_open(database_path, &db) != SQLITE_OK)
@@ -226,6 +378,26 @@ static bool initialize_sqlite(const char *database_path, const char *model_uri)
         return false;
     }
 
+    // Upgrade schema
+    if(!create_value_table())
+    {
+        std::cerr << "Unable to create value table!\n"
+                  << "sqlite: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    // Create table for the dictionary of a binary dump
+    if( binary && sqlite3_exec( db,
+            "CREATE TEMP TABLE Dump (i INTEGER PRIMARY KEY, l, t, n);",
+            NULL, NULL, NULL ) != SQLITE_OK )
+    {
+        std::cerr << "Unable to create temporary table!\n"
+                  << "sqlite: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
     // Prepare statements
     for(int n = 0; n < STATEMENTS; ++n)
         if(sqlite3_prepare(db, statements[n], -1, &stmts[n], NULL) != SQLITE_OK)
@@ -261,33 +433,68 @@ static bool initialize_sqlite(const char *database_path, const char *model_uri)
 
 int main(int argc, char *argv[])
 {
+    bool binary = argc > 1 && ( std::string(argv[1]) == "-b" ||
+                                std::string(argv[1]) == "--binary" );
+    if(binary)
+        ++argv, --argc;
     if(argc != 4)
     {
-        std::cout << "Usage: " << basename(argv[0]) << " <database> <model uri> <model path>" << std::endl;
+        std::cout << "Usage: " << basename(argv[0]) << " [-b|--binary] <database> <model uri> <model path>" << std::endl;
         return 0;
     }
     const char *database_path = argv[1], *model_uri = argv[2], *model_path = argv[3];
 
     // Open source file
-    FILE *fp = std::fopen(model_path, "r");
-    if(fp == NULL)
+    FILE *fp = NULL;
+    CompressedInput *input = NULL;
+    ImportPipeline *pipeline = NULL;
+    DumpReader *dump = NULL;
+    if(binary)
+    {
+        try {
+            dump = new DumpReader(model_path);
+        } catch(const char *msg) {
+            std::cerr << msg << std::endl;
+            return 1;
+        } catch(const std::string &msg) {
+            std::cerr << msg << std::endl;
+            return 1;
+        }
+    }
+    else
+    if((fp = std::fopen(model_path, "r")) == NULL)
     {
         std::cerr << "Unable to open file \"" << model_path
                   << "\" for reading!" << std::endl;
         return 1;
     }
+    else
+    {
+        try {
+            input = new CompressedInput(fp);
+        } catch(const std::string &msg) {
+            std::cerr << msg << std::endl;
+            return 1;
+        }
+        pipeline = new ImportPipeline(CompressedInput::reader, input, nid);
+    }
 
     // Initialize sqlite
-    if(!initialize_sqlite(database_path, model_uri))
+    if(!initialize_sqlite(database_path, model_uri, binary))
         return 1;
 
     std::cerr << "Reading model <" << model_uri << ">"
               << " from file \"" << model_path << "\"... " << std::flush;
 
     // Step 1: read quads from input file
-    if(parse_turtle(fp_reader, (void*)fp, triple_handler, NULL) != 0)
+    int r = binary ? read_dump(*dump) : pipeline->run();
+    delete dump;
+    delete input;
+    if(r != 0)
     {
-        std::cerr << "\nParsing failed!" << std::endl;
+        std::cerr << (binary ? "\nLoading failed!" : "\nParsing failed!")
+                  << std::endl;
+        delete pipeline;
         finalize_sqlite();
         return 1;
     }
@@ -299,13 +506,19 @@ int main(int argc, char *argv[])
         finalize_sqlite();
         return 1;
     }
-    std::cerr << "done.\n\t" << triples.size() << " triples read." << std::endl;
+    std::cerr << "done.\n\t" << (pipeline ? pipeline->size() : triples.size())
+              << " triples read." << std::endl;
 
-    // Step 2: sort and remove duplicates
+    // Step 2: sort (or merge the sorted runs of the pipeline) and remove
+    // duplicates
     std::cerr << "Sorting... " << std::flush;
     size_t dups = 0;
     {
-        std::sort(triples.begin(), triples.end());
+        if(pipeline)
+            pipeline->sorted(triples);
+        else
+            std::sort(triples.begin(), triples.end());
+        delete pipeline;
         std::deque<Triple>::iterator i =
             std::unique(triples.begin(), triples.end());
         if(i != triples.end())
@@ -338,7 +551,8 @@ int main(int argc, char *argv[])
 
     // Step 4: update database
     std::cerr << "Updating database... " << std::flush;
-    if(update_triples() != 0)
+    if( update_triples() != 0 ||
+        ((!removed.empty() || !added.empty()) && increment_generation() != 0) )
     {
         std::cerr << "\nUnable to write updates to database!\n"
                   << "sqlite: " << sqlite3_errmsg(db) << std::endl;
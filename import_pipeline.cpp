@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstring>
+#include "import_pipeline.h"
+
+ImportPipeline::ImportPipeline( TurtleTokenizer::Reader reader,
+                                void *reader_arg, Resolver resolver )
+    : reader(reader), reader_arg(reader_arg), resolver(resolver),
+      batch(new Batch), cache(cache_slots), aborted(false), parse_result(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&parsed.changed, NULL);
+    pthread_cond_init(&resolved.changed, NULL);
+    for(size_t n = 0; n < cache.size(); ++n)
+        cache[n].id = -1;
+    runs.push_back(0);
+}
+
+ImportPipeline::~ImportPipeline()
+{
+    delete batch;
+    for(size_t n = 0; n < parsed.batches.size(); ++n)
+        delete parsed.batches[n];
+    for(size_t n = 0; n < resolved.batches.size(); ++n)
+        delete resolved.batches[n];
+    pthread_cond_destroy(&resolved.changed);
+    pthread_cond_destroy(&parsed.changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+/* Adds a batch to a queue, waiting while it is full. Returns false (and
+   deletes the batch) if the import was aborted. The end of the batches is
+   always added. */
+bool ImportPipeline::push(Queue &queue, Batch *batch)
+{
+    pthread_mutex_lock(&mutex);
+    while(batch && !aborted && queue.batches.size() >= queue_batches)
+        pthread_cond_wait(&queue.changed, &mutex);
+    bool ok = batch == NULL || !aborted;
+    if(ok)
+        queue.batches.push_back(batch);
+    pthread_cond_broadcast(&queue.changed);
+    pthread_mutex_unlock(&mutex);
+    if(!ok)
+        delete batch;
+    return ok;
+}
+
+ImportPipeline::Batch *ImportPipeline::pop(Queue &queue)
+{
+    pthread_mutex_lock(&mutex);
+    while(queue.batches.empty())
+        pthread_cond_wait(&queue.changed, &mutex);
+    Batch *batch = queue.batches.front();
+    queue.batches.pop_front();
+    pthread_cond_broadcast(&queue.changed);
+    pthread_mutex_unlock(&mutex);
+    return batch;
+}
+
+/* Builds the cache key of a term: its lexical form, followed by a NUL
+   character and its kind ('<' for URIs, '"' for plain literals and '^' and
+   the datatype URI for typed literals). */
+void ImportPipeline::make_key( const Batch &batch, const Term &term,
+                               std::string &key )
+{
+    key.assign(batch.text.c_str() + term.lexical);
+    key += '\0';
+    if(term.type == TYPE_URI)
+        key += '<';
+    else
+    if(term.type == TYPE_LITERAL)
+        key += '"';
+    else
+    {
+        key += '^';
+        key += batch.text.c_str() + term.datatype;
+    }
+}
+
+/* FNV-1a */
+size_t ImportPipeline::hash(const std::string &key)
+{
+    size_t h = 2166136261u;
+    for(size_t n = 0; n < key.size(); ++n)
+        h = (h ^ (unsigned char)key[n]) * 16777619u;
+    return h;
+}
+
+void ImportPipeline::add_term( const char *lexical, nid_t type,
+                               const char *datatype,
+                               const turtle_value *value )
+{
+    Term term;
+    term.lexical = std::string::npos;
+    if(lexical != NULL)
+    {
+        term.lexical = batch->text.size();
+        batch->text.append(lexical, std::strlen(lexical) + 1);
+    }
+    term.type = type;
+    term.datatype = 0;
+    if(type < 0)
+    {
+        term.datatype = batch->text.size();
+        batch->text.append(datatype, std::strlen(datatype) + 1);
+    }
+    term.value = -1;
+    if(value != NULL)
+    {
+        term.value = batch->values.size();
+        batch->values.push_back(*value);
+    }
+    term.id = -1;
+    batch->terms.push_back(term);
+}
+
+int ImportPipeline::triple_handler( void *arg,
+    const char *subject, const char *predicate, const char *object,
+    const char *lexical, const char *datatype, const char *language,
+    const turtle_value *value )
+{
+    ImportPipeline &pipeline = *(ImportPipeline*)arg;
+    pipeline.add_term(subject, TYPE_URI, NULL, NULL);
+    pipeline.add_term(predicate, TYPE_URI, NULL, NULL);
+    if(object != NULL)
+        pipeline.add_term(object, TYPE_URI, NULL, NULL);
+    else
+    if(datatype == NULL)
+        pipeline.add_term(lexical, TYPE_LITERAL, NULL, NULL);
+    else
+        pipeline.add_term(lexical, -1, datatype, value);
+
+    if(pipeline.batch->terms.size() < 3*batch_triples)
+        return 0;
+    bool ok = pipeline.push(pipeline.parsed, pipeline.batch);
+    pipeline.batch = new Batch;
+    return ok ? 0 : 1;
+}
+
+void *ImportPipeline::run_parser(void *arg)
+{
+    ImportPipeline &pipeline = *(ImportPipeline*)arg;
+    int r = parse_turtle_values( pipeline.reader, pipeline.reader_arg,
+                                 triple_handler, arg );
+    if(r == 0 && !pipeline.batch->terms.empty())
+    {
+        pipeline.push(pipeline.parsed, pipeline.batch);
+        pipeline.batch = new Batch;
+    }
+    pipeline.parse_result = r;
+    pipeline.push(pipeline.parsed, NULL);
+    return NULL;
+}
+
+void *ImportPipeline::run_resolver(void *arg)
+{
+    ImportPipeline &pipeline = *(ImportPipeline*)arg;
+    while(Batch *batch = pipeline.pop(pipeline.parsed))
+    {
+        pipeline.resolve(*batch);
+        pipeline.push(pipeline.resolved, batch);
+    }
+    pipeline.push(pipeline.resolved, NULL);
+    return NULL;
+}
+
+/* Looks up the terms of a batch in the cache, and lists those not found. */
+void ImportPipeline::resolve(Batch &batch)
+{
+    std::string key;
+    pthread_mutex_lock(&mutex);
+    for(size_t n = 0; n < batch.terms.size(); ++n)
+    {
+        Term &term = batch.terms[n];
+        if(term.lexical == std::string::npos)
+        {
+            batch.missing.push_back(n);
+            continue;
+        }
+        make_key(batch, term, key);
+        term.hash = hash(key);
+        const Slot &slot = cache[term.hash % cache_slots];
+        if(slot.key == key)
+            term.id = slot.id;
+        else
+            batch.missing.push_back(n);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/* Returns the identifier of the node with the given cache key, resolving it
+   (and adding it to the cache) if it is not in the cache. Only the writer
+   changes the cache, so it reads it without locking. */
+nid_t ImportPipeline::lookup( const std::string &key, size_t hash,
+                              const char *lexical, nid_t type,
+                              const char *type_uri,
+                              const turtle_value *value )
+{
+    Slot &slot = cache[hash % cache_slots];
+    if(slot.key == key)
+        return slot.id;
+
+    nid_t id = resolver(lexical, type, type_uri, value);
+    if(id >= 0)
+    {
+        pthread_mutex_lock(&mutex);
+        slot.key = key;
+        slot.id = id;
+        pthread_mutex_unlock(&mutex);
+    }
+    return id;
+}
+
+/* Resolves the missing terms of a batch (which may have been added to the
+   cache since it was resolved), and adds its triples to the current run. */
+bool ImportPipeline::write(Batch &batch)
+{
+    for(size_t n = 0; n < batch.missing.size(); ++n)
+    {
+        Term &term = batch.terms[batch.missing[n]];
+        const char *lexical = NULL, *datatype = NULL;
+        if(term.lexical != std::string::npos)
+            lexical = batch.text.c_str() + term.lexical;
+        nid_t type = term.type;
+        if(type < 0)
+        {
+            datatype = batch.text.c_str() + term.datatype;
+            type_key.assign(datatype);
+            type_key += '\0';
+            type_key += '<';
+            type = lookup( type_key, hash(type_key), datatype, TYPE_URI,
+                           NULL, NULL );
+            if(type < 0)
+                return false;
+        }
+
+        const turtle_value *value =
+            term.value < 0 ? NULL : &batch.values[term.value];
+        if(lexical == NULL)
+            term.id = resolver(lexical, type, datatype, value);
+        else
+        {
+            make_key(batch, term, key);
+            term.id = lookup(key, term.hash, lexical, type, datatype, value);
+        }
+        if(term.id < 0)
+            return false;
+    }
+
+    for(size_t n = 0; n < batch.terms.size(); n += 3)
+    {
+        Triple t = { batch.terms[n].id, batch.terms[n + 1].id,
+                     batch.terms[n + 2].id };
+        triples.push_back(t);
+    }
+    if(triples.size() - runs.back() >= run_triples)
+        end_run();
+    return true;
+}
+
+/* Sorts the triples added since the end of the last run. */
+void ImportPipeline::end_run()
+{
+    if(triples.size() == runs.back())
+        return;
+    std::sort(triples.begin() + runs.back(), triples.end());
+    runs.push_back(triples.size());
+}
+
+int ImportPipeline::run()
+{
+    pthread_t parser, resolver_thread;
+    if(pthread_create(&parser, NULL, run_parser, this) != 0)
+        return -1;
+    if(pthread_create(&resolver_thread, NULL, run_resolver, this) != 0)
+    {
+        pthread_mutex_lock(&mutex);
+        aborted = true;
+        pthread_cond_broadcast(&parsed.changed);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(parser, NULL);
+        return -1;
+    }
+
+    bool ok = true;
+    while(Batch *batch = pop(resolved))
+    {
+        ok = write(*batch);
+        delete batch;
+        if(!ok)
+        {
+            pthread_mutex_lock(&mutex);
+            aborted = true;
+            pthread_cond_broadcast(&parsed.changed);
+            pthread_cond_broadcast(&resolved.changed);
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+    }
+
+    // The threads stop at the end of the input, or when they see 'aborted'
+    pthread_join(parser, NULL);
+    pthread_join(resolver_thread, NULL);
+    end_run();
+    return ok ? parse_result : 1;
+}
+
+size_t ImportPipeline::size() const
+{
+    return triples.size();
+}
+
+/* Merges the sorted runs of triples into 'result', in pairs. */
+void ImportPipeline::sorted(std::deque<Triple> &result)
+{
+    while(runs.size() > 2)
+    {
+        std::vector<size_t> merged(1, 0);
+        for(size_t n = 1; n < runs.size(); n += 2)
+        {
+            if(n + 1 < runs.size())
+            {
+                std::inplace_merge( triples.begin() + runs[n - 1],
+                                    triples.begin() + runs[n],
+                                    triples.begin() + runs[n + 1] );
+            }
+            merged.push_back(runs[std::min(n + 1, runs.size() - 1)]);
+        }
+        runs.swap(merged);
+    }
+    result.assign(triples.begin(), triples.end());
+    std::vector<Triple>().swap(triples);
+}
@@ -0,0 +1,161 @@
+#ifndef IMPORT_PIPELINE_H_INCLUDED
+#define IMPORT_PIPELINE_H_INCLUDED
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "turtle_parser.h"
+
+typedef long long int nid_t;
+
+/* Built-in datatypes */
+#define TYPE_URI        (0ll)
+#define TYPE_LITERAL    (1ll)
+#define TYPE_BOOLEAN    (2ll)
+#define TYPE_INTEGER    (3ll)
+#define TYPE_DATE_TIME  (4ll)
+#define TYPE_FLOAT      (5ll)
+#define TYPE_DOUBLE     (6ll)
+
+struct Triple
+{
+    nid_t subj, pred, obj;
+};
+
+inline bool operator< (const Triple &q, const Triple &r)
+{
+    return q.subj < r.subj || (q.subj == r.subj && (q.pred < r.pred ||
+        (q.pred == r.pred && q.obj < r.obj)));
+}
+
+inline bool operator== (const Triple &q, const Triple &r)
+{
+    return q.subj == r.subj && q.pred == r.pred && q.obj == r.obj;
+}
+
+inline bool operator!= (const Triple &q, const Triple &r)
+{
+    return q.subj != r.subj || q.pred != r.pred || q.obj != r.obj;
+}
+
+/*
+Reads the triples of a Turtle document into node identifiers, in three
+stages that run at the same time:
+
+    parse:      a thread parses the input into batches of 'batch_triples'
+                triples of terms;
+    resolve:    a second thread looks up the identifiers of these terms in a
+                cache, and lists the terms it did not find;
+    write:      the calling thread, which owns the database connection, finds
+                or adds the nodes of the listed terms through 'resolver'
+                (which returns -1 on failure), and adds them to the cache.
+
+The stages are connected by queues of at most 'queue_batches' batches, so
+memory use does not depend on the size of the input, and each stage waits for
+the others only when a queue is full or empty; queues and the cache are locked
+once per batch rather than per term (except that the writer locks the cache
+for each node it adds). The cache is direct-mapped, with 'cache_slots'
+entries, and only remembers recent nodes.
+
+The writer collects the resolved triples in runs of 'run_triples' triples,
+which are sorted as they fill up, so that sorted() only has to merge them.
+
+run() returns 0 on success, -1 if parsing failed, or 1 if a node could not
+be resolved.
+*/
+class ImportPipeline
+{
+    ImportPipeline(const ImportPipeline&);
+    ImportPipeline &operator=(const ImportPipeline&);
+
+public:
+    typedef nid_t (*Resolver)( const char *lexical, nid_t datatype,
+                               const char *type_uri,
+                               const turtle_value *native );
+
+    enum { batch_triples = 4096, queue_batches = 8, cache_slots = 1 << 18,
+           run_triples = 1 << 16 };
+
+private:
+    /* A term of a triple. Typed literals refer to their datatype URI, which
+       is stored in the batch text like lexical forms. The parser passes no
+       lexical form for empty literals; such terms are not cached. */
+    struct Term
+    {
+        size_t lexical, datatype;   // offsets in the batch text, or npos
+        nid_t type;                 // TYPE_URI, TYPE_LITERAL or -1 if typed
+        int value;                  // index of the native value, or -1
+        size_t hash;
+        nid_t id;                   // -1 until resolved
+    };
+
+    struct Batch
+    {
+        std::string text;           // NUL-terminated strings
+        std::vector<Term> terms;    // subject, predicate, object per triple
+        std::vector<turtle_value> values;
+        std::vector<size_t> missing;    // terms not found in the cache
+    };
+
+    /* A queue of batches; a NULL batch marks the end. */
+    struct Queue
+    {
+        std::deque<Batch*> batches;
+        pthread_cond_t changed;
+    };
+
+    struct Slot
+    {
+        std::string key;
+        nid_t id;
+    };
+
+    TurtleTokenizer::Reader reader;
+    void *reader_arg;
+    Resolver resolver;
+
+    Batch *batch;                   // being filled by the parser
+    Queue parsed, resolved;
+    std::vector<Slot> cache;
+    std::string key, type_key;      // scratch keys of the writer
+    bool aborted;
+    int parse_result;
+    pthread_mutex_t mutex;
+
+    std::vector<Triple> triples;
+    std::vector<size_t> runs;       // ends of sorted runs in 'triples'
+
+    bool push(Queue &queue, Batch *batch);
+    Batch *pop(Queue &queue);
+
+    static void make_key(const Batch &batch, const Term &term,
+                         std::string &key);
+    static size_t hash(const std::string &key);
+
+    static int triple_handler( void *arg,
+        const char *subject, const char *predicate, const char *object,
+        const char *lexical, const char *datatype, const char *language,
+        const turtle_value *value );
+    void add_term( const char *lexical, nid_t type, const char *datatype,
+                   const turtle_value *value );
+    static void *run_parser(void *arg);
+    static void *run_resolver(void *arg);
+    void resolve(Batch &batch);
+    nid_t lookup( const std::string &key, size_t hash, const char *lexical,
+                  nid_t type, const char *type_uri,
+                  const turtle_value *value );
+    bool write(Batch &batch);
+    void end_run();
+
+public:
+    ImportPipeline( TurtleTokenizer::Reader reader, void *reader_arg,
+                    Resolver resolver );
+    ~ImportPipeline();
+
+    int run();
+    size_t size() const;
+    void sorted(std::deque<Triple> &result);
+};
+
+#endif /* ndef IMPORT_PIPELINE_H_INCLUDED */
@@ -0,0 +1,899 @@
+#include <algorithm>
+#include <set>
+#include <tr1/unordered_map>
+#include "native_engine.h"
+#include "term_decoder.h"
+#include "typed_value.h"
+
+/* Estimates of scan sizes are capped at this number of rows. */
+#define ESTIMATE_LIMIT 100000
+
+/* A pattern is evaluated with a bind join if it is expected to match this
+   many times as many rows as the intermediate result it is joined with. */
+#define BIND_JOIN_FACTOR 16
+
+static const char * const field_names[4] = { "m", "s", "p", "o" };
+
+struct NativeEngine::Scan
+{
+    std::string var[4];     // variable in each field, or empty
+    nid_t value[4];         // value of constant fields
+    bool constant[4];
+    long long estimate;
+    std::string text;
+
+    std::vector<std::string> vars() const;
+};
+
+struct NativeEngine::Table
+{
+    std::vector<std::string> vars;
+    std::vector<nid_t> data;
+    size_t rows;
+    int sorted;             // column on which rows are sorted, or -1
+
+    Table() : rows(0), sorted(-1) { }
+
+    int column(const std::string &var) const;
+    inline const nid_t *row(size_t r) const;
+    inline void append( const nid_t *left, size_t n,
+                        const nid_t *right, const std::vector<int> &cols );
+    void swap(Table &t);
+};
+
+struct NativeEngine::Step
+{
+    enum Kind { scan, cross_join, merge_join, bind_join, hash_join,
+                left_join } kind;
+    size_t index;           // scan index, or optional plan index
+    std::string key;        // variable to sort (initial scan) or merge on
+    long long estimate;     // estimated size of the intermediate result
+    long long examined;     // quads retrieved by the step, once executed
+    long long produced;     // actual size of the intermediate result
+};
+
+struct NativeEngine::Plan
+{
+    std::vector<Scan> scans;
+    std::vector<Step> steps;
+    std::vector<Plan*> optionals;
+
+    ~Plan();
+};
+
+
+std::vector<std::string> NativeEngine::Scan::vars() const
+{
+    std::vector<std::string> result;
+    for(int f = 0; f < 4; ++f)
+    {
+        if( !var[f].empty() &&
+            std::find(result.begin(), result.end(), var[f]) == result.end() )
+        {
+            result.push_back(var[f]);
+        }
+    }
+    return result;
+}
+
+int NativeEngine::Table::column(const std::string &var) const
+{
+    for(size_t n = 0; n < vars.size(); ++n)
+        if(vars[n] == var)
+            return n;
+    return -1;
+}
+
+const nid_t *NativeEngine::Table::row(size_t r) const
+{
+    return vars.empty() ? NULL : &data[r*vars.size()];
+}
+
+/* Appends a row consisting of the 'n' values in 'left' followed by the
+   values of 'right' in columns 'cols' (or -1 if 'right' is NULL). */
+void NativeEngine::Table::append( const nid_t *left, size_t n,
+                                  const nid_t *right, const std::vector<int> &cols )
+{
+    data.insert(data.end(), left, left + n);
+    for(size_t c = 0; c < cols.size(); ++c)
+        data.push_back(right ? right[cols[c]] : -1);
+    ++rows;
+}
+
+void NativeEngine::Table::swap(Table &t)
+{
+    vars.swap(t.vars);
+    data.swap(t.data);
+    std::swap(rows, t.rows);
+    std::swap(sorted, t.sorted);
+}
+
+NativeEngine::Plan::~Plan()
+{
+    for( std::vector<Plan*>::const_iterator i = optionals.begin();
+         i != optionals.end(); ++i )
+    {
+        delete *i;
+    }
+}
+
+
+static sqlite3_stmt *prepare(sqlite3 *db, const std::string &sql)
+{
+    sqlite3_stmt *stmt;
+    int result = sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL);
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_OK)
+        throw std::string("Unable to prepare statement: \"") + sql + "\"!";
+    return stmt;
+}
+
+static int step(sqlite3_stmt *stmt)
+{
+    int result = sqlite3_step(stmt);
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW && result != SQLITE_DONE)
+        throw "Unable to retrieve quads!";
+    return result;
+}
+
+/* Generates the WHERE clause of a scan, in which the variables in 'bound'
+   are compared to parameters ?1, ?2, etc. */
+std::string NativeEngine::where_clause( const Scan &scan,
+                                        const std::vector<std::string> &bound )
+{
+    std::ostringstream os;
+    int constraint = 0;
+    for(int f = 0; f < 4; ++f)
+    {
+        if(scan.constant[f])
+        {
+            os << (constraint++ ? " AND " : " WHERE ")
+               << field_names[f] << '=' << scan.value[f];
+            continue;
+        }
+        if(scan.var[f].empty())
+            continue;
+
+        std::vector<std::string>::const_iterator i =
+            std::find(bound.begin(), bound.end(), scan.var[f]);
+        if(i != bound.end())
+        {
+            os << (constraint++ ? " AND " : " WHERE ")
+               << field_names[f] << "=?" << (i - bound.begin() + 1);
+            continue;
+        }
+
+        for(int g = 0; g < f; ++g)
+            if(scan.var[g] == scan.var[f])
+            {
+                // Repeated variable
+                os << (constraint++ ? " AND " : " WHERE ")
+                   << field_names[f] << '=' << field_names[g];
+                break;
+            }
+    }
+    return os.str();
+}
+
+/* Generates the SQL statement for a scan that selects the variables not in
+   'bound' (which are stored in 'columns') ordered by variable 'order'. */
+std::string NativeEngine::scan_sql( const Scan &scan,
+                                    const std::vector<std::string> &bound,
+                                    const std::string &order,
+                                    std::vector<std::string> &columns )
+{
+    std::ostringstream os;
+    os << "SELECT";
+    columns.clear();
+    for(int f = 0; f < 4; ++f)
+    {
+        const std::string &var = scan.var[f];
+        if( var.empty() ||
+            std::find(bound.begin(), bound.end(), var) != bound.end() ||
+            std::find(columns.begin(), columns.end(), var) != columns.end() )
+        {
+            continue;
+        }
+        os << (columns.empty() ? " " : ", ") << field_names[f];
+        columns.push_back(var);
+    }
+    if(columns.empty())
+        os << " 1";
+    os << " FROM Quad" << where_clause(scan, bound);
+
+    for(int f = 0; f < 4; ++f)
+        if(!order.empty() && scan.var[f] == order)
+        {
+            os << " ORDER BY " << field_names[f];
+            break;
+        }
+
+    return os.str();
+}
+
+
+NativeEngine::NativeEngine( sqlite3 *db, const Query &query, SQLMapper &mapper,
+                            const std::map<std::string, nid_t> &parameters )
+    : db(db), query(query), parameters(parameters), root(new Plan),
+      examined(0)
+{
+    if(!query.aggregates.empty() || !query.group_by.empty())
+    {
+        delete root;
+        throw "The native engine does not support aggregates!";
+    }
+    try {
+        plan_pattern(*root, *query.pattern, mapper);
+    } catch(...) {
+        delete root;
+        throw;
+    }
+}
+
+NativeEngine::~NativeEngine()
+{
+    delete root;
+}
+
+long long NativeEngine::estimate(const Scan &scan)
+{
+    std::ostringstream os;
+    os << "SELECT COUNT(*) FROM (SELECT 1 FROM Quad"
+       << where_clause(scan, std::vector<std::string>())
+       << " LIMIT " << ESTIMATE_LIMIT << ")";
+    sqlite3_stmt *stmt = prepare(db, os.str());
+    long long count = 0;
+    try {
+        if(step(stmt) == SQLITE_ROW)
+            count = sqlite3_column_int64(stmt, 0);
+    } catch(...) {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+void NativeEngine::plan_pattern(Plan &plan, const Pattern &pattern, SQLMapper &mapper)
+{
+    // Create scans for triple patterns
+    if(!pattern.paths.empty())
+        throw "The native engine does not support property paths!";
+    if(!pattern.filters.empty())
+        throw "The native engine does not support filters!";
+
+    for( Pattern::Quads::const_iterator i = pattern.mandatory_quads.begin();
+         i != pattern.mandatory_quads.end(); ++i )
+    {
+        Scan scan;
+        std::ostringstream text;
+        for(int f = 0; f < 4; ++f)
+        {
+            const Node &node = (*i)[f];
+            scan.constant[f] = false;
+            scan.value[f] = -1;
+
+            if(node.type == Node::unbound)
+                continue;
+            if(f > 1)
+                text << ' ';
+
+            if(node.type == Node::variable)
+            {
+                text << '?' << node.lexical;
+                std::map<std::string, nid_t>::const_iterator j =
+                    parameters.find(node.lexical);
+                if(j == parameters.end())
+                {
+                    scan.var[f] = node.lexical;
+                }
+                else
+                {
+                    scan.constant[f] = true;
+                    scan.value[f] = j->second;
+                }
+            }
+            else
+            if(node.type == Node::resource)
+            {
+                text << '<' << node.lexical << '>';
+                scan.constant[f] = true;
+                scan.value[f] = mapper.nid(node.lexical, TYPE_URI);
+            }
+            else
+            if(node.type == Node::literal)
+            {
+                text << '"' << node.lexical << '"';
+                if(!node.datatype.empty())
+                    text << "^^<" << node.datatype << '>';
+                nid_t datatype = node.datatype.empty() ? TYPE_LITERAL
+                    : mapper.nid(node.datatype, TYPE_URI);
+                scan.constant[f] = true;
+                scan.value[f] = mapper.nid(node.lexical, datatype);
+            }
+        }
+        scan.text = text.str();
+        scan.estimate = estimate(scan);
+        plan.scans.push_back(scan);
+    }
+
+    // Determine join order and strategy
+    std::set<std::string> bound;
+    std::vector<bool> used(plan.scans.size(), false);
+    long long rows = 1;
+    std::string sorted;
+    for(size_t k = 0; k < plan.scans.size(); ++k)
+    {
+        int best = -1;
+        bool best_shares = false;
+        for(size_t n = 0; n < plan.scans.size(); ++n)
+        {
+            if(used[n])
+                continue;
+
+            std::vector<std::string> vars = plan.scans[n].vars();
+            bool shares = false;
+            for(size_t v = 0; v < vars.size(); ++v)
+                shares = shares || bound.count(vars[v]);
+
+            if( best < 0 || (shares && !best_shares) ||
+                ( shares == best_shares &&
+                  plan.scans[n].estimate < plan.scans[best].estimate ) )
+            {
+                best = n;
+                best_shares = shares;
+            }
+        }
+        used[best] = true;
+
+        const Scan &scan = plan.scans[best];
+        std::vector<std::string> vars = scan.vars(), shared;
+        for(size_t v = 0; v < vars.size(); ++v)
+            if(bound.count(vars[v]))
+                shared.push_back(vars[v]);
+
+        Step step;
+        step.index = best;
+        step.examined = step.produced = -1;
+        if(k == 0)
+        {
+            // Sort on the variable that occurs in most other patterns
+            size_t most = 0;
+            for(size_t v = 0; v < vars.size(); ++v)
+            {
+                size_t occurrences = 0;
+                for(size_t n = 0; n < plan.scans.size(); ++n)
+                {
+                    std::vector<std::string> other = plan.scans[n].vars();
+                    occurrences += std::count(other.begin(), other.end(), vars[v]);
+                }
+                if(v == 0 || occurrences > most)
+                {
+                    step.key = vars[v];
+                    most = occurrences;
+                }
+            }
+            step.kind = Step::scan;
+            sorted = step.key;
+            rows = scan.estimate;
+        }
+        else
+        if(shared.empty())
+        {
+            step.kind = Step::cross_join;
+            rows = std::min( rows*scan.estimate,
+                             (long long)ESTIMATE_LIMIT*ESTIMATE_LIMIT );
+        }
+        else
+        if(rows*BIND_JOIN_FACTOR < scan.estimate)
+        {
+            step.kind = Step::bind_join;
+        }
+        else
+        if(shared.size() == 1 && shared[0] == sorted)
+        {
+            step.kind = Step::merge_join;
+            step.key = sorted;
+            rows = std::min(rows, scan.estimate);
+        }
+        else
+        {
+            step.kind = Step::hash_join;
+            rows = std::min(rows, scan.estimate);
+        }
+        step.estimate = rows;
+        plan.steps.push_back(step);
+
+        bound.insert(vars.begin(), vars.end());
+    }
+
+    // Add optional patterns
+    for( Pattern::Patterns::const_iterator i = pattern.optional_patterns.begin();
+         i != pattern.optional_patterns.end(); ++i )
+    {
+        Step step;
+        step.kind = Step::left_join;
+        step.examined = step.produced = -1;
+        step.index = plan.optionals.size();
+        step.estimate = rows;
+        plan.optionals.push_back(new Plan);
+        plan_pattern(*plan.optionals.back(), **i, mapper);
+        plan.steps.push_back(step);
+    }
+}
+
+void NativeEngine::write_plan(std::ostream &os, const Plan &plan, int indent) const
+{
+    for( std::vector<Step>::const_iterator i = plan.steps.begin();
+         i != plan.steps.end(); ++i )
+    {
+        os << std::string(indent, ' ');
+        switch(i->kind)
+        {
+        case Step::scan:
+            os << "scan";
+            break;
+        case Step::cross_join:
+            os << "cross join";
+            break;
+        case Step::merge_join:
+            os << "merge join on ?" << i->key << " with";
+            break;
+        case Step::bind_join:
+            os << "bind join with";
+            break;
+        case Step::hash_join:
+            os << "hash join with";
+            break;
+        case Step::left_join:
+            os << "left hash join with optional";
+            if(i->produced >= 0)
+                os << " (produced " << i->produced << " rows)";
+            os << ":\n";
+            write_plan(os, *plan.optionals[i->index], indent + 4);
+            continue;
+        }
+
+        const Scan &scan = plan.scans[i->index];
+        os << ' ' << scan.text << " (" << scan.estimate
+           << (scan.estimate == ESTIMATE_LIMIT ? "+" : "") << " rows)";
+        if(i->kind == Step::scan && !i->key.empty())
+            os << " ordered by ?" << i->key;
+        if(i->produced >= 0)
+        {
+            os << " (examined " << i->examined << ", produced "
+               << i->produced << " rows)";
+        }
+        os << '\n';
+    }
+}
+
+std::string NativeEngine::plan() const
+{
+    std::ostringstream os;
+    write_plan(os, *root, 0);
+    return os.str();
+}
+
+
+void NativeEngine::scan(const Scan &scan, const std::string &order, Table &result)
+{
+    std::vector<std::string> columns;
+    sqlite3_stmt *stmt = prepare(db,
+        scan_sql(scan, std::vector<std::string>(), order, columns) );
+
+    result = Table();
+    result.vars = columns;
+    result.sorted = result.column(order);
+    try {
+        while(step(stmt) == SQLITE_ROW)
+        {
+            for(size_t c = 0; c < columns.size(); ++c)
+                result.data.push_back(sqlite3_column_int64(stmt, c));
+            ++result.rows;
+            ++examined;
+        }
+    } catch(...) {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+    sqlite3_finalize(stmt);
+}
+
+void NativeEngine::merge_join( const Table &left, const Scan &scan,
+                               const std::string &key, Table &result )
+{
+    Table right;
+    this->scan(scan, key, right);
+
+    const size_t lk = left.column(key), rk = right.column(key);
+    const size_t lw = left.vars.size(), rw = right.vars.size();
+    std::vector<int> cols;
+    result.vars = left.vars;
+    for(size_t c = 0; c < rw; ++c)
+        if(c != rk)
+        {
+            cols.push_back(c);
+            result.vars.push_back(right.vars[c]);
+        }
+    result.sorted = left.sorted;
+
+    size_t i = 0, j = 0;
+    while(i < left.rows && j < right.rows)
+    {
+        nid_t a = left.data[i*lw + lk], b = right.data[j*rw + rk];
+        if(a < b)
+            ++i;
+        else
+        if(b < a)
+            ++j;
+        else
+        {
+            size_t i_end = i, j_end = j;
+            while(i_end < left.rows && left.data[i_end*lw + lk] == a)
+                ++i_end;
+            while(j_end < right.rows && right.data[j_end*rw + rk] == a)
+                ++j_end;
+            for(size_t x = i; x < i_end; ++x)
+                for(size_t y = j; y < j_end; ++y)
+                    result.append(left.row(x), lw, right.row(y), cols);
+            i = i_end;
+            j = j_end;
+        }
+    }
+}
+
+void NativeEngine::bind_join(const Table &left, const Scan &scan, Table &result)
+{
+    // Variables bound by the intermediate result
+    std::vector<std::string> bound, columns;
+    std::vector<int> bound_cols;
+    std::vector<std::string> vars = scan.vars();
+    for(size_t v = 0; v < vars.size(); ++v)
+    {
+        int c = left.column(vars[v]);
+        if(c >= 0)
+        {
+            bound.push_back(vars[v]);
+            bound_cols.push_back(c);
+        }
+    }
+
+    sqlite3_stmt *stmt = prepare(db, scan_sql(scan, bound, "", columns));
+
+    const size_t lw = left.vars.size();
+    std::vector<int> cols;
+    for(size_t c = 0; c < columns.size(); ++c)
+        cols.push_back(c);
+    result.vars = left.vars;
+    result.vars.insert(result.vars.end(), columns.begin(), columns.end());
+    result.sorted = left.sorted;
+
+    // Scan once for each distinct combination of values of bound variables
+    typedef std::map<std::vector<nid_t>, std::vector<nid_t> > matches_t;
+    matches_t matches;
+    std::vector<nid_t> key(bound.size());
+    try {
+        for(size_t r = 0; r < left.rows; ++r)
+        {
+            const nid_t *row = left.row(r);
+            for(size_t k = 0; k < key.size(); ++k)
+                key[k] = row[bound_cols[k]];
+
+            matches_t::iterator i = matches.find(key);
+            if(i == matches.end())
+            {
+                i = matches.insert(std::make_pair(key, std::vector<nid_t>())).first;
+                for(size_t k = 0; k < key.size(); ++k)
+                    sqlite3_bind_int64(stmt, k + 1, key[k]);
+                while(step(stmt) == SQLITE_ROW)
+                {
+                    for(size_t c = 0; c < columns.size(); ++c)
+                        i->second.push_back(sqlite3_column_int64(stmt, c));
+                    if(columns.empty())
+                        i->second.push_back(-1);
+                    ++examined;
+                }
+                sqlite3_reset(stmt);
+            }
+
+            const size_t width = std::max(columns.size(), size_t(1));
+            for(size_t m = 0; m < i->second.size(); m += width)
+                result.append(row, lw, &i->second[m], cols);
+        }
+    } catch(...) {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+    sqlite3_finalize(stmt);
+}
+
+void NativeEngine::hash_join( const Table &left, const Table &right,
+                              bool outer, Table &result )
+{
+    // Determine shared and new columns
+    std::vector<int> left_keys, right_keys, cols;
+    for(size_t c = 0; c < right.vars.size(); ++c)
+    {
+        int l = left.column(right.vars[c]);
+        if(l >= 0)
+        {
+            left_keys.push_back(l);
+            right_keys.push_back(c);
+        }
+        else
+        {
+            cols.push_back(c);
+        }
+    }
+    result.vars = left.vars;
+    for(size_t c = 0; c < cols.size(); ++c)
+        result.vars.push_back(right.vars[cols[c]]);
+    result.sorted = left.sorted;
+
+    // Build hash table on right-hand side
+    typedef std::tr1::unordered_multimap<nid_t, size_t> hash_t;
+    hash_t hash;
+    for(size_t r = 0; r < right.rows; ++r)
+    {
+        nid_t h = 0;
+        const nid_t *row = right.row(r);
+        for(size_t k = 0; k < right_keys.size(); ++k)
+            h = h*1000003 ^ row[right_keys[k]];
+        hash.insert(std::make_pair(h, r));
+    }
+
+    // Probe with left-hand side, preserving its order
+    const size_t lw = left.vars.size();
+    for(size_t r = 0; r < left.rows; ++r)
+    {
+        nid_t h = 0;
+        const nid_t *row = left.row(r);
+        for(size_t k = 0; k < left_keys.size(); ++k)
+            h = h*1000003 ^ row[left_keys[k]];
+
+        bool matched = false;
+        std::pair<hash_t::const_iterator, hash_t::const_iterator>
+            range = hash.equal_range(h);
+        for(hash_t::const_iterator i = range.first; i != range.second; ++i)
+        {
+            const nid_t *other = right.row(i->second);
+            size_t k = 0;
+            while(k < left_keys.size() && row[left_keys[k]] == other[right_keys[k]])
+                ++k;
+            if(k == left_keys.size())
+            {
+                result.append(row, lw, other, cols);
+                matched = true;
+            }
+        }
+        if(outer && !matched)
+            result.append(row, lw, NULL, cols);
+    }
+}
+
+void NativeEngine::evaluate(Plan &plan, Table &result)
+{
+    // Start with a single empty solution
+    result = Table();
+    result.rows = 1;
+
+    for( std::vector<Step>::iterator i = plan.steps.begin();
+         i != plan.steps.end(); ++i )
+    {
+        Table next, right;
+        long long start = examined;
+        switch(i->kind)
+        {
+        case Step::scan:
+            scan(plan.scans[i->index], i->key, next);
+            break;
+
+        case Step::cross_join:
+        case Step::hash_join:
+            scan(plan.scans[i->index], "", right);
+            hash_join(result, right, false, next);
+            break;
+
+        case Step::merge_join:
+            merge_join(result, plan.scans[i->index], i->key, next);
+            break;
+
+        case Step::bind_join:
+            bind_join(result, plan.scans[i->index], next);
+            break;
+
+        case Step::left_join:
+            evaluate(*plan.optionals[i->index], right);
+            hash_join(result, right, true, next);
+            break;
+        }
+        i->examined = examined - start;
+        i->produced = next.rows;
+        result.swap(next);
+    }
+}
+
+
+namespace {
+
+/* The sort key of a node: its native value, if it has one, and its lexical
+   value. */
+struct OrderKey
+{
+    bool valued;
+    TypedValue value;
+    std::string lexical;
+};
+
+/* Orders rows of a table by a list of columns, in the same order as
+   SQLMapper: nodes without a native value first, then on the class and the
+   native value, and then on lexical values. */
+class RowOrder
+{
+    const std::vector<nid_t> &data;
+    size_t width;
+    const std::vector<int> &cols;
+    const std::vector<bool> &desc;
+    const std::map<nid_t, OrderKey> &keys;
+
+    static int compare(const TypedValue &a, const TypedValue &b)
+    {
+        if(a.type != b.type)
+            return a.type < b.type ? -1 : 1;
+        if(a.integer && b.integer)
+            return a.i < b.i ? -1 : a.i > b.i ? 1 : 0;
+        double x = a.integer ? (double)a.i : a.d,
+               y = b.integer ? (double)b.i : b.d;
+        return x < y ? -1 : x > y ? 1 : 0;
+    }
+
+    int compare(nid_t a, nid_t b) const
+    {
+        if(a == b)
+            return 0;
+        if(a < 0 || b < 0)
+            return a < 0 ? -1 : 1;      // unbound values first
+        const OrderKey &p = keys.find(a)->second, &q = keys.find(b)->second;
+        if(p.valued != q.valued)
+            return p.valued ? 1 : -1;
+        if(p.valued)
+            if(int d = compare(p.value, q.value))
+                return d;
+        return p.lexical.compare(q.lexical);
+    }
+
+public:
+    RowOrder( const std::vector<nid_t> &data, size_t width,
+              const std::vector<int> &cols, const std::vector<bool> &desc,
+              const std::map<nid_t, OrderKey> &keys )
+        : data(data), width(width), cols(cols), desc(desc), keys(keys)
+    {
+    }
+
+    bool operator() (size_t r, size_t s) const
+    {
+        for(size_t k = 0; k < cols.size(); ++k)
+        {
+            int d = compare(data[r*width + cols[k]], data[s*width + cols[k]]);
+            if(d != 0)
+                return desc[k] ? d > 0 : d < 0;
+        }
+        return false;
+    }
+};
+
+}
+
+size_t NativeEngine::execute(std::vector<nid_t> &rows)
+{
+    Table table;
+    evaluate(*root, table);
+
+    std::vector<size_t> order(table.rows);
+    for(size_t r = 0; r < table.rows; ++r)
+        order[r] = r;
+
+    // Solution modifier: ORDER BY
+    if(!query.order.empty())
+    {
+        std::vector<int> cols;
+        std::vector<bool> desc;
+        for( Query::OrderConds::const_iterator i = query.order.begin();
+             i != query.order.end(); ++i )
+        {
+            const Expr &expr = *(*i)->expr;
+            if(expr.op != Expr::value || expr.node->type != Node::variable)
+                throw "The native engine can only order by variables!";
+            int c = table.column(expr.node->lexical);
+            if(c < 0)
+            {
+                throw std::string("Variable \"") + expr.node->lexical +
+                    "\" not used in graph pattern!";
+            }
+            cols.push_back(c);
+            desc.push_back((*i)->desc);
+        }
+
+        TermDecoder decoder(db);
+        sqlite3_stmt *values = has_value_table(db)
+            ? prepare(db, "SELECT t, v FROM Value WHERE n=?") : NULL;
+        std::map<nid_t, OrderKey> keys;
+        try {
+            for(size_t r = 0; r < table.rows; ++r)
+                for(size_t k = 0; k < cols.size(); ++k)
+                {
+                    nid_t id = table.row(r)[cols[k]], datatype;
+                    if(id < 0 || keys.count(id))
+                        continue;
+                    OrderKey &key = keys[id];
+                    decoder.decode(id, key.lexical, datatype);
+                    key.valued = false;
+                    if(values == NULL)
+                        continue;
+                    sqlite3_bind_int64(values, 1, id);
+                    if(step(values) == SQLITE_ROW)
+                    {
+                        key.valued = true;
+                        key.value.type = sqlite3_column_int(values, 0);
+                        key.value.integer =
+                            sqlite3_column_type(values, 1) == SQLITE_INTEGER;
+                        key.value.i = sqlite3_column_int64(values, 1);
+                        key.value.d = sqlite3_column_double(values, 1);
+                    }
+                    sqlite3_reset(values);
+                }
+        } catch(...) {
+            sqlite3_finalize(values);
+            throw;
+        }
+        sqlite3_finalize(values);
+
+        std::stable_sort( order.begin(), order.end(),
+            RowOrder(table.data, table.vars.size(), cols, desc, keys) );
+    }
+
+    // Projection
+    std::vector<int> cols;
+    std::vector<nid_t> row;
+    for( std::vector<std::string>::const_iterator i = query.projection.begin();
+         i != query.projection.end(); ++i )
+    {
+        int c = table.column(*i);
+        std::map<std::string, nid_t>::const_iterator j = parameters.find(*i);
+        if(c < 0 && j == parameters.end())
+        {
+            throw std::string("Variable \"") + *i +
+                "\" not used in graph pattern!";
+        }
+        cols.push_back(c);
+        row.push_back(c < 0 ? j->second : -1);
+    }
+
+    // Solution modifiers: DISTINCT, OFFSET and LIMIT
+    std::set<std::vector<nid_t> > seen;
+    long long skip = query.offset > 0 ? query.offset : 0, count = 0;
+    rows.clear();
+    for(size_t r = 0; r < table.rows; ++r)
+    {
+        if(query.limit >= 0 && count == query.limit)
+            break;
+
+        for(size_t c = 0; c < cols.size(); ++c)
+            if(cols[c] >= 0)
+                row[c] = table.row(order[r])[cols[c]];
+        if(query.distinct && !seen.insert(row).second)
+            continue;
+        if(skip > 0)
+        {
+            --skip;
+            continue;
+        }
+        rows.insert(rows.end(), row.begin(), row.end());
+        ++count;
+    }
+    return count;
+}
@@ -0,0 +1,84 @@
+#ifndef NATIVE_ENGINE_H_INCLUDED
+#define NATIVE_ENGINE_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "sparql_mapper.h"
+
+/*
+Evaluates queries on node identifiers in memory, as an alternative to the SQL
+generated by SQLMapper.
+
+Every triple pattern is evaluated by a separate scan of the Quad table that
+uses the constants in the pattern as index keys. Scans are joined in order of
+estimated cardinality, starting with the smallest and preferring patterns that
+share a variable with those joined so far, using one of these strategies:
+
+    merge join  if the intermediate result is sorted on the (single) shared
+                variable; the pattern is then scanned in the same order.
+    bind join   if the intermediate result is expected to be much smaller
+                than the pattern; the pattern is then scanned once for each
+                distinct value of the shared variables, using the indexes.
+    hash join   otherwise.
+
+OPTIONAL groups are evaluated separately and then combined with the mandatory
+part using a left outer hash join. Solution modifiers are applied to the final
+result; ORDER BY is only supported on variables, which are ordered on their
+native values like SQLMapper orders them.
+
+Query parameters (see SQLMapper) are treated as constants, with the node
+identifiers given in 'parameters'.
+*/
+class NativeEngine
+{
+    NativeEngine(const NativeEngine&);
+    NativeEngine &operator=(const NativeEngine&);
+
+    struct Scan;
+    struct Table;
+    struct Step;
+    struct Plan;
+
+    sqlite3 *db;
+    const Query &query;
+    std::map<std::string, nid_t> parameters;
+    Plan *root;
+    long long examined;
+
+    static std::string where_clause( const Scan &scan,
+                                     const std::vector<std::string> &bound );
+    static std::string scan_sql( const Scan &scan,
+                                 const std::vector<std::string> &bound,
+                                 const std::string &order,
+                                 std::vector<std::string> &columns );
+
+    void plan_pattern(Plan &plan, const Pattern &pattern, SQLMapper &mapper);
+    long long estimate(const Scan &scan);
+    void write_plan(std::ostream &os, const Plan &plan, int indent) const;
+
+    void evaluate(Plan &plan, Table &result);
+    void scan(const Scan &scan, const std::string &order, Table &result);
+    void merge_join(const Table &left, const Scan &scan,
+                    const std::string &key, Table &result);
+    void bind_join(const Table &left, const Scan &scan, Table &result);
+    void hash_join( const Table &left, const Table &right,
+                    bool outer, Table &result );
+
+public:
+    NativeEngine( sqlite3 *db, const Query &query, SQLMapper &mapper,
+                  const std::map<std::string, nid_t> &parameters );
+    ~NativeEngine();
+
+    /* Describes the query plan; after execute(), this includes the number of
+       quads examined and rows produced by each step. */
+    std::string plan() const;
+
+    /* Evaluates the query and stores the node identifiers of the projected
+       variables (or -1 for unbound variables) in 'rows', row by row, and
+       returns the number of solutions. */
+    size_t execute(std::vector<nid_t> &rows);
+};
+
+#endif /* ndef NATIVE_ENGINE_H_INCLUDED */
@@ -0,0 +1,131 @@
+#include "output_buffer.h"
+
+/* The vectorized scan reads whole aligned blocks, which may extend beyond
+   the end of the string (but never into another page); AddressSanitizer
+   would report these reads, so it gets the plain version. */
+#if defined(__SSE2__) && !defined(__SANITIZE_ADDRESS__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+OutputBuffer::OutputBuffer(FILE *fp, size_t size)
+    : fp(fp), rows(0), next_flush(1)
+{
+    pos = buffer = new char[size];
+    end = buffer + size;
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+    delete[] buffer;
+}
+
+/* Makes room for 'len' bytes that do not fit, and writes them. */
+void OutputBuffer::overflow(const char *str, size_t len)
+{
+    if(fp == NULL)
+    {
+        // Grow the buffer
+        size_t used = pos - buffer, size = end - buffer;
+        while(size - used < len)
+            size *= 2;
+        char *grown = new char[size];
+        std::memcpy(grown, buffer, used);
+        delete[] buffer;
+        buffer = grown;
+        pos = buffer + used;
+        end = buffer + size;
+    }
+    else
+    {
+        flush();
+        if(size_t(end - pos) < len)
+        {
+            std::fwrite(str, 1, len, fp);
+            return;
+        }
+    }
+    std::memcpy(pos, str, len);
+    pos += len;
+}
+
+void OutputBuffer::write_escaped(const char *str, char quote, Escape escape)
+{
+    for(;;)
+    {
+        const char *special = find_special(str, quote);
+        write(str, special - str);
+        if(*special == '\0')
+            return;
+
+        const char *esc = escape(*special);
+        if(esc)
+            write(esc);
+        else
+            put(*special);
+        str = special + 1;
+    }
+}
+
+void OutputBuffer::row()
+{
+    if(++rows == next_flush)
+    {
+        flush();
+        next_flush *= 2;
+    }
+}
+
+void OutputBuffer::flush()
+{
+    if(fp == NULL)
+        return;
+    std::fwrite(buffer, 1, pos - buffer, fp);
+    std::fflush(fp);
+    pos = buffer;
+}
+
+
+#ifdef USE_SSE2
+/* Returns a mask with a bit set for each byte in 'block' that is special. */
+static inline unsigned special_mask(__m128i block, __m128i quote)
+{
+    const __m128i control = _mm_set1_epi8(0x1F),
+                  backslash = _mm_set1_epi8('\\');
+
+    // Bytes are unsigned, so compare max(c, 0x1F) == 0x1F for c <= 0x1F
+    __m128i special = _mm_or_si128(
+        _mm_cmpeq_epi8(_mm_max_epu8(block, control), control),
+        _mm_or_si128( _mm_cmpeq_epi8(block, backslash),
+                      _mm_cmpeq_epi8(block, quote) ) );
+    return _mm_movemask_epi8(special);
+}
+
+const char *find_special(const char *str, char quote)
+{
+    const __m128i q = _mm_set1_epi8(quote);
+
+    // Start with the aligned block that contains 'str'
+    size_t offset = (size_t)str & 15;
+    const __m128i *block = (const __m128i*)(str - offset);
+    unsigned mask = special_mask(_mm_load_si128(block), q) >> offset;
+    if(mask != 0)
+        return str + __builtin_ctz(mask);
+
+    for(;;)
+    {
+        ++block;
+        mask = special_mask(_mm_load_si128(block), q);
+        if(mask != 0)
+            return (const char*)block + __builtin_ctz(mask);
+    }
+}
+#else
+const char *find_special(const char *str, char quote)
+{
+    while((unsigned char)*str >= 0x20 && *str != '\\' && *str != quote)
+        ++str;
+    return str;
+}
+#endif
@@ -0,0 +1,95 @@
+#ifndef OUTPUT_BUFFER_H_INCLUDED
+#define OUTPUT_BUFFER_H_INCLUDED
+
+#include <cstdio>
+#include <cstring>
+
+/*
+Buffers output written to a stdio stream. The buffer is flushed when full,
+and additionally after rows 1, 2, 4, 8, etc. (as counted by row()) so the
+first results reach the client quickly. A buffer without a stream keeps
+everything written to it in memory (growing as needed), until clear() is
+called; its contents are available through data() and size().
+
+write_escaped() writes a zero-terminated string, replacing characters for
+which 'escape' returns a non-NULL string with that string. Only control
+characters, backslashes and 'quote' are passed to 'escape'; this covers the
+escaping rules of all formats we write. The string is scanned for these
+characters 16 bytes at a time where SSE2 is available, and the runs of
+characters between them are copied into the buffer in bulk.
+*/
+class OutputBuffer
+{
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer &operator=(const OutputBuffer&);
+
+    FILE *fp;
+    char *buffer, *pos, *end;
+    size_t rows, next_flush;
+
+    void overflow(const char *str, size_t len);
+
+public:
+    typedef const char *(*Escape)(char c);
+
+    explicit OutputBuffer(FILE *fp, size_t size = 65536);
+    ~OutputBuffer();
+
+    inline void put(char c);
+    inline void write(const char *str, size_t len);
+    inline void write(const char *str);
+    void write_escaped(const char *str, char quote, Escape escape);
+    void row();
+    void flush();
+
+    inline const char *data() const;
+    inline size_t size() const;
+    inline void clear();
+};
+
+/* Returns the first character in 'str' that is a control character (which
+   includes the terminating zero), a backslash or 'quote'. */
+const char *find_special(const char *str, char quote);
+
+
+// Implementation of OutputBuffer inline members
+void OutputBuffer::put(char c)
+{
+    if(pos == end)
+        overflow(&c, 1);
+    else
+        *pos++ = c;
+}
+
+void OutputBuffer::write(const char *str, size_t len)
+{
+    if(size_t(end - pos) < len)
+        overflow(str, len);
+    else
+    {
+        std::memcpy(pos, str, len);
+        pos += len;
+    }
+}
+
+void OutputBuffer::write(const char *str)
+{
+    write(str, std::strlen(str));
+}
+
+const char *OutputBuffer::data() const
+{
+    return buffer;
+}
+
+size_t OutputBuffer::size() const
+{
+    return pos - buffer;
+}
+
+void OutputBuffer::clear()
+{
+    pos = buffer;
+}
+
+#endif /* ndef OUTPUT_BUFFER_H_INCLUDED */
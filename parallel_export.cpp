@@ -0,0 +1,217 @@
+#include <algorithm>
+#include "parallel_export.h"
+#include "turtle_writer.h"
+
+ParallelExport::ParallelExport( const char *path, nid_t model, bool quads,
+                                int jobs )
+    : path(path), model(model), quads(quads), jobs(jobs), next(0), written(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+}
+
+ParallelExport::~ParallelExport()
+{
+    for(size_t n = 0; n < chunks.size(); ++n)
+        delete chunks[n].text;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+/* Splits the range of subjects into chunks. Small ranges are split into at
+   least four chunks per thread, so that all threads have work. */
+void ParallelExport::split(sqlite3 *db)
+{
+    const char *sql = model < 0
+        ? "SELECT (SELECT min(s) FROM Quad), (SELECT max(s) FROM Quad)"
+        : "SELECT (SELECT min(s) FROM Quad WHERE m=?1), "
+          "(SELECT max(s) FROM Quad WHERE m=?1)";
+
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+        throw std::string("Unable to prepare statement: \"") + sql + "\"!";
+    if(model >= 0)
+        sqlite3_bind_int64(stmt, 1, model);
+
+    int result = sqlite3_step(stmt);
+    bool found = result == SQLITE_ROW &&
+                 sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    nid_t low = 0, high = 0;
+    if(found)
+    {
+        low  = sqlite3_column_int64(stmt, 0);
+        high = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW)
+        throw "Unable to determine range of subjects!";
+    if(!found)
+        return;
+
+    nid_t size = std::min<nid_t>(chunk_size, (high - low) / (4*jobs) + 1);
+    Chunk chunk;
+    chunk.text = NULL;
+    for(chunk.low = low; chunk.low <= high; chunk.low += size)
+    {
+        chunk.high = std::min(high, chunk.low + size - 1);
+        chunks.push_back(chunk);
+    }
+}
+
+/* Formats the quads of a chunk, decoding the nodes of 'batch_rows' quads
+   at a time. */
+void ParallelExport::format( sqlite3_stmt *stmt, TermCache &cache,
+                             const Chunk &chunk, OutputBuffer &out )
+{
+    sqlite3_bind_int64(stmt, 1, chunk.low);
+    sqlite3_bind_int64(stmt, 2, chunk.high);
+
+    std::vector<nid_t> ids;
+    int result = SQLITE_ROW;
+    while(result == SQLITE_ROW)
+    {
+        ids.clear();
+        while( ids.size() < 4*batch_rows &&
+               (result = sqlite3_step(stmt)) == SQLITE_ROW )
+        {
+            for(int col = 0; col < 4; ++col)
+                ids.push_back(sqlite3_column_int64(stmt, col));
+        }
+
+        cache.trim();
+        cache.prefetch(ids);
+        for(size_t n = 0; n < ids.size(); n += 4)
+        {
+            const TermCache::Entry &m = cache.lookup(ids[n]),
+                                   &s = cache.lookup(ids[n + 1]),
+                                   &p = cache.lookup(ids[n + 2]),
+                                   &o = cache.lookup(ids[n + 3]);
+            write_statement( out, s.lexical.c_str(), p.lexical.c_str(),
+                             o.lexical.c_str(),
+                             o.literal ? o.datatype.c_str() : NULL,
+                             quads ? m.lexical.c_str() : NULL );
+        }
+    }
+    sqlite3_reset(stmt);
+
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_DONE)
+        throw "Unable to retrieve quads!";
+}
+
+void ParallelExport::work()
+{
+    const char *sql = model < 0
+        ? "SELECT m, s, p, o FROM Quad WHERE s BETWEEN ?1 AND ?2 "
+          "ORDER BY s, p, o"
+        : "SELECT m, s, p, o FROM Quad WHERE m=?3 AND s BETWEEN ?1 AND ?2 "
+          "ORDER BY s, p, o";
+
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    TermCache *cache = NULL;
+    std::string failure;
+    if(sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+        failure = "Unable to open database!";
+    else
+    if(sqlite3_prepare(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+        failure = std::string("Unable to prepare statement: \"") + sql + "\"!";
+    else
+    {
+        if(model >= 0)
+            sqlite3_bind_int64(stmt, 3, model);
+        try {
+            cache = new TermCache(db);
+        } catch(const std::string &msg) {
+            failure = msg;
+        }
+    }
+
+    pthread_mutex_lock(&mutex);
+    for(;;)
+    {
+        if(!failure.empty() && error.empty())
+            error = failure;
+        while( error.empty() && next < chunks.size() &&
+               next >= written + 2*jobs )
+        {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        if(!error.empty() || next == chunks.size())
+            break;
+        Chunk &chunk = chunks[next++];
+        pthread_mutex_unlock(&mutex);
+
+        OutputBuffer *text = new OutputBuffer(NULL);
+        try {
+            format(stmt, *cache, chunk, *text);
+        } catch(const char *msg) {
+            failure = msg;
+        } catch(const std::string &msg) {
+            failure = msg;
+        }
+
+        pthread_mutex_lock(&mutex);
+        chunk.text = text;
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+
+    delete cache;
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+void *ParallelExport::run(void *arg)
+{
+    ((ParallelExport*)arg)->work();
+    return NULL;
+}
+
+void ParallelExport::execute(sqlite3 *db, FILE *fp)
+{
+    split(db);
+
+    std::vector<pthread_t> workers(jobs);
+    int started = 0;
+    for(; started < jobs; ++started)
+    {
+        if(pthread_create(&workers[started], NULL, run, this) != 0)
+            break;
+    }
+    if(started == 0)
+        throw "Unable to start threads!";
+
+    // Write chunks in order as they are completed
+    pthread_mutex_lock(&mutex);
+    while(error.empty() && written < chunks.size())
+    {
+        OutputBuffer *text = chunks[written].text;
+        if(text == NULL)
+        {
+            pthread_cond_wait(&changed, &mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&mutex);
+
+        std::fwrite(text->data(), 1, text->size(), fp);
+        delete text;
+
+        pthread_mutex_lock(&mutex);
+        chunks[written++].text = NULL;
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for(int n = 0; n < started; ++n)
+        pthread_join(workers[n], NULL);
+    std::fflush(fp);
+    if(!error.empty())
+        throw error;
+    if(std::ferror(fp))
+        throw "Unable to write output!";
+}
@@ -0,0 +1,64 @@
+#ifndef PARALLEL_EXPORT_H_INCLUDED
+#define PARALLEL_EXPORT_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "output_buffer.h"
+#include "term_decoder.h"
+
+/*
+Exports quads in a line-oriented format (N-Triples, or N-Quads if 'quads' is
+set) using several threads.
+
+The range of subject identifiers of the model (or of all quads in the
+database, if 'model' is -1) is split into chunks of at most 'chunk_size'
+identifiers. 'jobs' threads, each with its own read-only connection to the
+database at 'path', take the next chunk and format its quads in memory,
+while the calling thread writes the formatted chunks in order. Workers stay
+at most two chunks per thread ahead of the output, so memory use does not
+depend on the size of the model.
+
+Quads are written ordered by subject, predicate and object, so the output
+does not depend on the number of threads.
+*/
+class ParallelExport
+{
+    ParallelExport(const ParallelExport&);
+    ParallelExport &operator=(const ParallelExport&);
+
+    struct Chunk
+    {
+        nid_t low, high;
+        OutputBuffer *text;     // NULL until formatted
+    };
+
+    const char *path;
+    nid_t model;
+    bool quads;
+    int jobs;
+
+    std::vector<Chunk> chunks;
+    size_t next, written;
+    std::string error;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+
+    static void *run(void *arg);
+    void work();
+    void format( sqlite3_stmt *stmt, TermCache &cache, const Chunk &chunk,
+                 OutputBuffer &out );
+    void split(sqlite3 *db);
+
+public:
+    enum { chunk_size = 4096, batch_rows = 4096 };
+
+    ParallelExport(const char *path, nid_t model, bool quads, int jobs);
+    ~ParallelExport();
+
+    void execute(sqlite3 *db, FILE *fp);
+};
+
+#endif /* ndef PARALLEL_EXPORT_H_INCLUDED */
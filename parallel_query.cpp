@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <pthread.h>
+#include "parallel_query.h"
+
+struct ParallelQuery::Partition
+{
+    const ParallelQuery *owner;
+    std::string sql;
+    nid_t low, high;
+    pthread_t thread;
+    bool started;
+    std::string error;
+
+    // Results: 'columns' values per row, followed by the ORDER BY keys
+    size_t columns, rows, next;
+    std::vector<std::string> values;
+    std::vector<char> nulls;
+
+    void evaluate();
+    const std::string *value(size_t col) const;
+};
+
+
+void ParallelQuery::Partition::evaluate()
+{
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    if(sqlite3_open_v2(owner->path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        error = "Unable to open database!";
+        sqlite3_close(db);
+        return;
+    }
+    if(owner->budget)
+        owner->budget->watch(db);
+
+    if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+    {
+        error = "Unable to prepare generated SQL query: \"" + sql + "\"!";
+        sqlite3_close(db);
+        return;
+    }
+
+    int index = owner->parameters.size() + 1;
+    owner->bind(stmt);
+    sqlite3_bind_int64(stmt, index,     low);
+    sqlite3_bind_int64(stmt, index + 1, high);
+
+    int result, count = sqlite3_column_count(stmt) - 1;
+    while((result = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        for(int n = 0; n < count; ++n)
+        {
+            const char *text = (const char*)sqlite3_column_text(stmt, n);
+            nulls.push_back(text == NULL);
+            values.push_back(text ? std::string(text, sqlite3_column_bytes(stmt, n))
+                                  : std::string());
+        }
+        ++rows;
+    }
+    if(result == SQLITE_BUSY)
+        error = "Database is busy!";
+    else
+    if(result != SQLITE_DONE)
+        error = "Unable to retrieve query results!";
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+const std::string *ParallelQuery::Partition::value(size_t col) const
+{
+    size_t n = (next * (values.size() / rows)) + col;
+    return nulls[n] ? NULL : &values[n];
+}
+
+void *ParallelQuery::run(void *arg)
+{
+    ((Partition*)arg)->evaluate();
+    return NULL;
+}
+
+
+ParallelQuery::ParallelQuery( sqlite3 *db, const char *path, const Query &query,
+                              const SQLMapper &mapper,
+                              const std::map<std::string, nid_t> &parameters,
+                              int jobs, QueryBudget *budget )
+    : db(db), path(path), query(query), mapper(mapper),
+      parameters(parameters), jobs(jobs), budget(budget)
+{
+    if(mapper.partition_variable().empty())
+        throw "Query can not be partitioned!";
+}
+
+void ParallelQuery::bind(sqlite3_stmt *stmt) const
+{
+    for( std::map<std::string, nid_t>::const_iterator i = parameters.begin();
+         i != parameters.end(); ++i )
+    {
+        sqlite3_bind_int64(stmt, mapper.parameter(i->first), i->second);
+    }
+}
+
+bool ParallelQuery::range(nid_t &low, nid_t &high) const
+{
+    std::string sql = mapper.range_sql();
+
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+        throw std::string("Unable to prepare statement: \"") + sql + "\"!";
+    bind(stmt);
+
+    int result = sqlite3_step(stmt);
+    bool found = result == SQLITE_ROW &&
+                 sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    if(found)
+    {
+        low  = sqlite3_column_int64(stmt, 0);
+        high = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW)
+        throw "Unable to determine partition range!";
+    return found;
+}
+
+/* Compares the current rows of two partitions on the ORDER BY keys, which
+   SQLite compares as numbers or as text with the binary collation (NULL
+   first). */
+int ParallelQuery::compare(const Partition &a, const Partition &b) const
+{
+    for(size_t key = 0; key < mapper.order_keys(); ++key)
+    {
+        const std::string *x = a.value(a.columns + key),
+                          *y = b.value(b.columns + key);
+        int c;
+        if(x == NULL || y == NULL)
+            c = x == NULL ? (y == NULL ? 0 : -1) : 1;
+        else
+        if(mapper.numeric(key))
+        {
+            double u = std::strtod(x->c_str(), NULL),
+                   v = std::strtod(y->c_str(), NULL);
+            c = u < v ? -1 : u > v ? 1 : 0;
+        }
+        else
+        {
+            c = std::memcmp(x->data(), y->data(), std::min(x->size(), y->size()));
+            if(c == 0)
+                c = x->size() < y->size() ? -1 : x->size() > y->size() ? 1 : 0;
+        }
+        if(c != 0)
+            return mapper.descending(key) ? -c : c;
+    }
+    return 0;
+}
+
+long long ParallelQuery::execute(ResultWriter &writer)
+{
+    bool ids = writer.wants_ids();
+    const std::vector<std::string> &vars = query.projection;
+
+    // Determine result columns
+    size_t columns = 0;
+    std::vector<bool> is_resource;
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+         i != vars.end(); ++i )
+    {
+        is_resource.push_back(mapper.resource(*i));
+        columns += ids || is_resource.back() ? 1 : 2;
+    }
+
+    // Split range of partition column
+    nid_t low, high;
+    std::vector<Partition> parts;
+    if(range(low, high))
+    {
+        nid_t size = (high - low) / jobs + 1;
+        Partition part;
+        part.owner   = this;
+        part.sql     = mapper.partition_sql(ids);
+        part.started = false;
+        part.columns = columns;
+        part.rows    = 0;
+        part.next    = 0;
+        for(part.low = low; part.low <= high; part.low += size)
+        {
+            part.high = std::min(high, part.low + size - 1);
+            parts.push_back(part);
+        }
+    }
+
+    // Evaluate partitions
+    for(size_t n = 0; n < parts.size(); ++n)
+    {
+        parts[n].started =
+            pthread_create(&parts[n].thread, NULL, run, &parts[n]) == 0;
+    }
+    for(size_t n = 0; n < parts.size(); ++n)
+    {
+        if(parts[n].started)
+            pthread_join(parts[n].thread, NULL);
+        else
+            parts[n].evaluate();
+    }
+    for(size_t n = 0; n < parts.size(); ++n)
+    {
+        if(!parts[n].error.empty())
+            throw parts[n].error;
+    }
+
+    // Duplicates can only occur in different partitions if the partition
+    // variable is not projected.
+    bool dedupe = query.distinct && std::find(vars.begin(), vars.end(),
+        mapper.partition_variable()) == vars.end();
+    std::set<std::string> seen;
+
+    // Merge results
+    writer.head(vars);
+    std::vector<Term> terms(vars.size());
+    long long skip = query.offset > 0 ? query.offset : 0, count = 0;
+    while(query.limit < 0 || count < query.limit)
+    {
+        Partition *part = NULL;
+        for(size_t n = 0; n < parts.size(); ++n)
+        {
+            if(parts[n].next == parts[n].rows)
+                continue;
+            if(part == NULL)
+                part = &parts[n];
+            else
+            if(mapper.order_keys() == 0)
+                break;
+            else
+            if(compare(parts[n], *part) < 0)
+                part = &parts[n];
+        }
+        if(part == NULL)
+            break;
+
+        if(dedupe)
+        {
+            std::string key;
+            for(size_t col = 0; col < columns; ++col)
+            {
+                const std::string *value = part->value(col);
+                key += value ? '\1' : '\0';
+                if(value)
+                    key.append(*value).append(1, '\0');
+            }
+            if(!seen.insert(key).second)
+            {
+                ++part->next;
+                continue;
+            }
+        }
+
+        if(skip > 0)
+        {
+            --skip;
+            ++part->next;
+            continue;
+        }
+
+        size_t col = 0;
+        for(size_t n = 0; n < terms.size(); ++n)
+        {
+            Term &term = terms[n];
+            if(ids)
+            {
+                const std::string *value = part->value(col++);
+                term.id = value ? std::strtoll(value->c_str(), NULL, 10) : -1;
+                continue;
+            }
+
+            const std::string *datatype = NULL, *lexical;
+            if(!is_resource[n])
+                datatype = part->value(col++);
+            lexical = part->value(col++);
+            term.lexical  = lexical ? lexical->c_str() : NULL;
+            term.datatype = datatype ? datatype->c_str() : NULL;
+            term.kind = lexical == NULL ? Term::unbound :
+                        datatype ? Term::literal : Term::uri;
+        }
+        writer.result(terms.empty() ? NULL : &terms[0]);
+
+        ++part->next;
+        ++count;
+    }
+    writer.end();
+    return count;
+}
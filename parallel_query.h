@@ -0,0 +1,58 @@
+#ifndef PARALLEL_QUERY_H_INCLUDED
+#define PARALLEL_QUERY_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "sparql_mapper.h"
+#include "result_writer.h"
+#include "query_budget.h"
+
+/*
+Evaluates the SQL generated by SQLMapper in several threads at once.
+
+The range of node identifiers in the partition column of the mapper (see
+SQLMapper::partition_sql()) is split into 'jobs' parts of equal size, and
+each part is evaluated on a separate read-only connection to the database at
+'path'. The partial results are then merged in the main thread: in order of
+the ORDER BY keys if the query has any, or else in order of the partitions.
+DISTINCT, OFFSET and LIMIT are applied to the merged results.
+
+Query parameters are bound to the node identifiers in 'parameters', as with
+NativeEngine. If a budget is given, it watches the connections of all
+partitions.
+*/
+class ParallelQuery
+{
+    ParallelQuery(const ParallelQuery&);
+    ParallelQuery &operator=(const ParallelQuery&);
+
+    struct Partition;
+
+    sqlite3 *db;
+    const char *path;
+    const Query &query;
+    const SQLMapper &mapper;
+    std::map<std::string, nid_t> parameters;
+    int jobs;
+    QueryBudget *budget;
+
+    static void *run(void *arg);
+
+    void bind(sqlite3_stmt *stmt) const;
+    bool range(nid_t &low, nid_t &high) const;
+    int compare(const Partition &a, const Partition &b) const;
+
+public:
+    ParallelQuery( sqlite3 *db, const char *path, const Query &query,
+                   const SQLMapper &mapper,
+                   const std::map<std::string, nid_t> &parameters, int jobs,
+                   QueryBudget *budget = NULL );
+
+    /* Evaluates the query and writes its results; returns the number of
+       solutions written. */
+    long long execute(ResultWriter &writer);
+};
+
+#endif /* ndef PARALLEL_QUERY_H_INCLUDED */
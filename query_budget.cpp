@@ -0,0 +1,137 @@
+#include <sys/time.h>
+#include "query_budget.h"
+
+static double now()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+QueryBudget::QueryBudget( double timeout, long long max_steps,
+                          long long max_rows, sqlite3_int64 max_memory )
+    : timeout(timeout), deadline(0), max_steps(max_steps), max_rows(max_rows),
+      steps(0), rows(0), interval(1000), max_memory(max_memory), reason(NULL)
+{
+    pthread_mutex_init(&mutex, NULL);
+    if(max_steps > 0 && max_steps < interval)
+        interval = (int)max_steps;
+
+    // Let SQLite shrink its page cache before the limit is reached (for the
+    // whole process, as the memory limit is process-wide)
+    if(max_memory > 0)
+        sqlite3_soft_heap_limit64(max_memory);
+}
+
+QueryBudget::~QueryBudget()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+bool QueryBudget::limited() const
+{
+    return timeout > 0 || max_steps > 0 || max_rows > 0 || max_memory > 0;
+}
+
+void QueryBudget::start()
+{
+    deadline = timeout > 0 ? now() + timeout : 0;
+}
+
+void QueryBudget::watch(sqlite3 *db)
+{
+    if(timeout > 0 || max_steps > 0 || max_memory > 0)
+        sqlite3_progress_handler(db, interval, progress, this);
+}
+
+/* Returns whether the budget still holds; the caller must hold the mutex. */
+bool QueryBudget::check()
+{
+    if(reason)
+        return false;
+    if(deadline > 0 && now() > deadline)
+        reason = "Query exceeded its time limit!";
+    else
+    if(max_steps > 0 && steps > max_steps)
+        reason = "Query exceeded its limit on evaluation steps!";
+    else
+    if(max_rows > 0 && rows > max_rows)
+        reason = "Query exceeded its limit on result rows!";
+    else
+    if(max_memory > 0 && sqlite3_memory_used() > max_memory)
+        reason = "Query exceeded its memory limit!";
+    return reason == NULL;
+}
+
+int QueryBudget::progress(void *arg)
+{
+    QueryBudget *budget = (QueryBudget*)arg;
+    pthread_mutex_lock(&budget->mutex);
+    budget->steps += budget->interval;
+    bool interrupt = !budget->check();
+    pthread_mutex_unlock(&budget->mutex);
+    return interrupt;
+}
+
+bool QueryBudget::row()
+{
+    pthread_mutex_lock(&mutex);
+    ++rows;
+    bool ok = check();
+    pthread_mutex_unlock(&mutex);
+    return ok;
+}
+
+const char *QueryBudget::exceeded() const
+{
+    return reason;
+}
+
+
+BudgetWriter::BudgetWriter(ResultWriter *writer, QueryBudget &budget)
+    : writer(writer), budget(budget)
+{
+}
+
+BudgetWriter::~BudgetWriter()
+{
+    delete writer;
+}
+
+bool BudgetWriter::wants_ids() const
+{
+    return writer->wants_ids();
+}
+
+void BudgetWriter::link(const std::string &href)
+{
+    writer->link(href);
+}
+
+void BudgetWriter::head(const std::vector<std::string> &vars)
+{
+    writer->head(vars);
+}
+
+void BudgetWriter::result(const Term *terms)
+{
+    if(!budget.row())
+        throw budget.exceeded();
+    writer->result(terms);
+}
+
+void BudgetWriter::end()
+{
+    writer->end();
+}
+
+void BudgetWriter::error(const char *msg)
+{
+    writer->error(msg);
+}
+
+void BudgetWriter::boolean(bool value)
+{
+    writer->boolean(value);
+}
@@ -0,0 +1,81 @@
+#ifndef QUERY_BUDGET_H_INCLUDED
+#define QUERY_BUDGET_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "result_writer.h"
+
+/*
+Limits the resources that the evaluation of a query may use: wall time (in
+seconds, from start()), SQLite virtual machine instructions, result rows and
+memory allocated by SQLite (in bytes). Limits of zero are not enforced.
+
+watch() installs a progress handler on a connection, which interrupts the
+statement that is being evaluated once the time, instruction or memory limit
+is exceeded; a connection may be watched from any thread. The handler runs
+every 'interval' instructions: every 1000, or every 'max_steps' if that is
+smaller, so that small instruction limits are enforced as well.
+
+Rows are counted with row(), which BudgetWriter calls for each solution. Once
+a limit has been exceeded, exceeded() returns a message describing it, which
+should be reported instead of the error that the interrupted statement
+caused.
+
+The memory limit is process-wide rather than per query: it is checked
+against all memory allocated by SQLite (sqlite3_memory_used()), and is also
+set as the soft heap limit of SQLite. It therefore includes the memory used
+by other connections, such as the partitions of a parallel query, and by
+other queries evaluated by the same process.
+*/
+class QueryBudget
+{
+    QueryBudget(const QueryBudget&);
+    QueryBudget &operator=(const QueryBudget&);
+
+    double timeout, deadline;
+    long long max_steps, max_rows, steps, rows;
+    int interval;                   // instructions between checks
+    sqlite3_int64 max_memory;
+    const char *reason;
+    pthread_mutex_t mutex;
+
+    static int progress(void *arg);
+    bool check();
+
+public:
+    QueryBudget( double timeout, long long max_steps, long long max_rows,
+                 sqlite3_int64 max_memory );
+    ~QueryBudget();
+
+    bool limited() const;
+    void start();
+    void watch(sqlite3 *db);
+    bool row();
+    const char *exceeded() const;
+};
+
+/* Passes results on to another writer (which it deletes when it is deleted),
+   counting them against the row and time limits of a budget. Once the
+   budget is exceeded, result() throws the message of QueryBudget::exceeded()
+   instead. */
+class BudgetWriter : public ResultWriter
+{
+    ResultWriter *writer;
+    QueryBudget &budget;
+
+public:
+    BudgetWriter(ResultWriter *writer, QueryBudget &budget);
+    ~BudgetWriter();
+
+    bool wants_ids() const;
+    void link(const std::string &href);
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+    void boolean(bool value);
+};
+
+#endif /* ndef QUERY_BUDGET_H_INCLUDED */
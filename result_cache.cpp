@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
+#include "result_cache.h"
+
+static const char magic[4] = { 'S', 'R', 'C', '1' };
+
+/* Size of the file header and of the header of each entry */
+#define HEADER_SIZE (4 + 8 + 8)
+#define ENTRY_SIZE  (8 + 4 + 8)
+
+struct ResultCache::Entry
+{
+    unsigned long long used;
+    std::string key;
+    unsigned long long ids;
+    long offset;            // file offset of the identifiers
+
+    size_t size() const { return ENTRY_SIZE + key.size() + ids * sizeof(nid_t); }
+    bool operator< (const Entry &e) const { return used > e.used; }
+};
+
+template<class T>
+static inline bool read(FILE *fp, T &value)
+{
+    return std::fread(&value, sizeof(value), 1, fp) == 1;
+}
+
+template<class T>
+static inline bool write(FILE *fp, const T &value)
+{
+    return std::fwrite(&value, sizeof(value), 1, fp) == 1;
+}
+
+/* Reads the header of the next entry in the cache file, and leaves the file
+   positioned after it. */
+static bool read_entry( FILE *fp, unsigned long long &used, std::string &key,
+                        unsigned long long &ids )
+{
+    unsigned size;
+    if(!read(fp, used) || !read(fp, size) || !read(fp, ids))
+        return false;
+    key.resize(size);
+    return size == 0 || std::fread(&key[0], size, 1, fp) == 1;
+}
+
+static bool write_entry( FILE *fp, unsigned long long used,
+                         const std::string &key, unsigned long long ids )
+{
+    unsigned size = key.size();
+    return write(fp, used) && write(fp, size) && write(fp, ids) &&
+           std::fwrite(key.data(), 1, size, fp) == size;
+}
+
+
+ResultCache::ResultCache( const std::string &path, size_t capacity,
+                          long long generation )
+    : path(path), capacity(capacity), generation_(generation)
+{
+}
+
+long long ResultCache::generation(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, "PRAGMA user_version", -1, &stmt, NULL) != SQLITE_OK)
+        throw "Unable to prepare statement: \"PRAGMA user_version\"!";
+
+    int result = sqlite3_step(stmt);
+    long long generation = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW)
+        throw "Unable to determine database generation!";
+    return generation;
+}
+
+/* Opens the cache file and reads its header. Returns NULL if the file does
+   not exist or holds results of a different generation. */
+FILE *ResultCache::open(const char *mode, unsigned long long &clock) const
+{
+    FILE *fp = std::fopen(path.c_str(), mode);
+    if(fp == NULL)
+        return NULL;
+
+    char buf[4];
+    long long generation;
+    if( std::fread(buf, 4, 1, fp) != 1 || std::memcmp(buf, magic, 4) != 0 ||
+        !read(fp, generation) || generation != generation_ ||
+        !read(fp, clock) )
+    {
+        std::fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+bool ResultCache::lookup(const std::string &key, std::vector<nid_t> &rows)
+{
+    unsigned long long clock;
+    FILE *fp = open("r+b", clock);
+    if(fp == NULL)
+        return false;
+
+    unsigned long long used, ids;
+    std::string k;
+    bool found = false;
+    while(!found && read_entry(fp, used, k, ids))
+    {
+        if(k != key)
+        {
+            if(std::fseek(fp, ids * sizeof(nid_t), SEEK_CUR) != 0)
+                break;
+            continue;
+        }
+
+        rows.resize(ids);
+        if(ids > 0 && std::fread(&rows[0], sizeof(nid_t), ids, fp) != ids)
+            break;
+        found = true;
+
+        // Mark entry as used; failure to do so is harmless.
+        long pos = std::ftell(fp) - long(ENTRY_SIZE + k.size() + ids * sizeof(nid_t));
+        ++clock;
+        if( std::fseek(fp, HEADER_SIZE - 8, SEEK_SET) == 0 && write(fp, clock) &&
+            std::fseek(fp, pos, SEEK_SET) == 0 )
+        {
+            write(fp, clock);
+        }
+    }
+
+    std::fclose(fp);
+    return found;
+}
+
+void ResultCache::store(const std::string &key, const std::vector<nid_t> &rows)
+{
+    Entry entry;
+    entry.key = key;
+    entry.ids = rows.size();
+    if(HEADER_SIZE + entry.size() > capacity)
+        return;
+
+    // Read entries of the current generation
+    unsigned long long clock = 0;
+    std::vector<Entry> entries;
+    FILE *in = open("rb", clock);
+    while(in != NULL)
+    {
+        Entry e;
+        if(!read_entry(in, e.used, e.key, e.ids))
+            break;
+        e.offset = std::ftell(in);
+        if(e.key != key)
+            entries.push_back(e);
+        if(std::fseek(in, e.ids * sizeof(nid_t), SEEK_CUR) != 0)
+            break;
+    }
+
+    // Keep the most recently used entries that fit
+    std::stable_sort(entries.begin(), entries.end());
+    size_t size = HEADER_SIZE + entry.size(), n = 0;
+    while(n < entries.size() && size + entries[n].size() <= capacity)
+        size += entries[n++].size();
+    entries.resize(n);
+
+    // Write new file and replace the old one
+    std::ostringstream tmp;
+    tmp << path << '.' << getpid();
+    FILE *out = std::fopen(tmp.str().c_str(), "wb");
+    if(out == NULL)
+    {
+        if(in != NULL)
+            std::fclose(in);
+        return;
+    }
+
+    ++clock;
+    bool ok = std::fwrite(magic, 4, 1, out) == 1 && write(out, generation_) &&
+              write(out, clock) && write_entry(out, clock, key, entry.ids) &&
+              (rows.empty() || std::fwrite(&rows[0], sizeof(nid_t),
+                                           rows.size(), out) == rows.size());
+    std::vector<nid_t> ids;
+    for(size_t n = 0; ok && n < entries.size(); ++n)
+    {
+        const Entry &e = entries[n];
+        ids.resize(e.ids);
+        ok = write_entry(out, e.used, e.key, e.ids) &&
+             std::fseek(in, e.offset, SEEK_SET) == 0 &&
+             (e.ids == 0 || (std::fread(&ids[0], sizeof(nid_t), e.ids, in) == e.ids &&
+                             std::fwrite(&ids[0], sizeof(nid_t), e.ids, out) == e.ids));
+    }
+
+    if(in != NULL)
+        std::fclose(in);
+    if(std::fclose(out) != 0 || !ok ||
+       std::rename(tmp.str().c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.str().c_str());
+    }
+}
+
+
+bool ResultCollector::wants_ids() const
+{
+    return true;
+}
+
+void ResultCollector::head(const std::vector<std::string> &vars)
+{
+    columns = vars.size();
+    rows.clear();
+}
+
+void ResultCollector::result(const Term *terms)
+{
+    for(size_t n = 0; n < columns; ++n)
+        rows.push_back(terms[n].id);
+}
+
+void ResultCollector::end()
+{
+}
+
+void ResultCollector::error(const char *)
+{
+}
@@ -0,0 +1,73 @@
+#ifndef RESULT_CACHE_H_INCLUDED
+#define RESULT_CACHE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "result_writer.h"
+
+typedef long long int nid_t;
+
+/*
+Keeps the results of queries in a sidecar file, as rows of node identifiers
+indexed by a key that identifies the query. Repeated queries are then
+answered by decoding the stored identifiers instead of evaluating the query.
+
+All entries belong to a single generation of the database, as returned by
+generation(), which is the user_version of the database (import increments
+it whenever it commits changes to the Quad table). Entries of an earlier
+generation are discarded. If storing a result would make the file larger than
+'capacity' bytes, the least recently used entries are discarded first.
+
+The file is replaced atomically when entries are added, so concurrent
+processes can share a cache, although some updates may be lost. It is laid
+out as follows (in native byte order, as it is not meant to be portable):
+
+    "SRC1"          magic
+    i64             database generation
+    u64             use counter
+    entries, each:
+        u64         value of the use counter when last used
+        u32         key size
+        u64         number of identifiers
+        char[]      key
+        i64[]       node identifiers, row by row (-1 for unbound values)
+*/
+class ResultCache
+{
+    ResultCache(const ResultCache&);
+    ResultCache &operator=(const ResultCache&);
+
+    struct Entry;
+
+    std::string path;
+    size_t capacity;
+    long long generation_;
+
+    FILE *open(const char *mode, unsigned long long &clock) const;
+
+public:
+    ResultCache(const std::string &path, size_t capacity, long long generation);
+
+    static long long generation(sqlite3 *db);
+
+    bool lookup(const std::string &key, std::vector<nid_t> &rows);
+    void store(const std::string &key, const std::vector<nid_t> &rows);
+};
+
+/* Collects the node identifiers of all results, row by row. */
+class ResultCollector : public ResultWriter
+{
+    size_t columns;
+
+public:
+    std::vector<nid_t> rows;
+
+    bool wants_ids() const;
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+};
+
+#endif /* ndef RESULT_CACHE_H_INCLUDED */
@@ -0,0 +1,720 @@
+#include <set>
+#include "result_writer.h"
+#include "term_decoder.h"
+#include "libxml/xmlwriter.h"
+
+/*
+    Writers for the SPARQL Query Results XML, JSON, TSV and CSV formats, and
+    for a binary columnar format (see BinaryResultWriter below).
+
+    Except for XML (which is generated with libxml2's xmlTextWriter) output is
+    produced directly into an OutputBuffer, which escapes strings by copying
+    runs of characters that need no escaping in bulk.
+*/
+
+ResultWriter::~ResultWriter()
+{
+}
+
+bool ResultWriter::wants_ids() const
+{
+    return false;
+}
+
+void ResultWriter::link(const std::string &href)
+{
+    std::fprintf(stderr, "Link: %s\n", href.c_str());
+}
+
+void ResultWriter::boolean(bool value)
+{
+    head(std::vector<std::string>());
+    if(value)
+        result(NULL);
+    end();
+}
+
+
+static const char *json_escape(char c)
+{
+    static const char * const control[0x20] = {
+        "\\u0000", "\\u0001", "\\u0002", "\\u0003",
+        "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+        "\\b",     "\\t",     "\\n",     "\\u000b",
+        "\\f",     "\\r",     "\\u000e", "\\u000f",
+        "\\u0010", "\\u0011", "\\u0012", "\\u0013",
+        "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+        "\\u0018", "\\u0019", "\\u001a", "\\u001b",
+        "\\u001c", "\\u001d", "\\u001e", "\\u001f" };
+
+    if((unsigned char)c < 0x20)
+        return control[(unsigned char)c];
+    if(c == '"')
+        return "\\\"";
+    if(c == '\\')
+        return "\\\\";
+    return NULL;
+}
+
+static const char *tsv_escape(char c)
+{
+    switch(c)
+    {
+    case 0x09: return "\\t";
+    case 0x0A: return "\\n";
+    case 0x0D: return "\\r";
+    case '"':  return "\\\"";
+    case '\\': return "\\\\";
+    }
+    return NULL;
+}
+
+static const char *csv_escape(char c)
+{
+    return c == '"' ? "\"\"" : NULL;
+}
+
+
+class XMLResultWriter : public ResultWriter
+{
+    xmlTextWriterPtr writer;
+    std::vector<std::string> vars, links;
+    bool started;
+
+public:
+    XMLResultWriter(xmlTextWriterPtr writer);
+    ~XMLResultWriter();
+
+    void link(const std::string &href);
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+    void boolean(bool value);
+};
+
+XMLResultWriter::XMLResultWriter(xmlTextWriterPtr writer)
+    : writer(writer), started(false)
+{
+    xmlTextWriterStartDocument(writer, NULL, NULL, "yes");
+    xmlTextWriterStartElement(writer, (xmlChar*)"sparql");
+    xmlTextWriterWriteAttribute( writer, (xmlChar*)"xmlns",
+        (xmlChar*)"http://www.w3.org/2005/sparql-results#" );
+}
+
+XMLResultWriter::~XMLResultWriter()
+{
+    xmlFreeTextWriter(writer);
+}
+
+void XMLResultWriter::link(const std::string &href)
+{
+    links.push_back(href);
+}
+
+void XMLResultWriter::head(const std::vector<std::string> &vars)
+{
+    this->vars = vars;
+
+    xmlTextWriterStartElement(writer, (xmlChar*)"head");
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+        i != vars.end(); ++i )
+    {
+        xmlTextWriterStartElement(writer, (xmlChar*)"variable");
+        xmlTextWriterWriteAttribute( writer,
+            (xmlChar*)"name", (xmlChar*)i->c_str() );
+        xmlTextWriterEndElement(writer);
+    }
+    for( std::vector<std::string>::const_iterator i = links.begin();
+        i != links.end(); ++i )
+    {
+        xmlTextWriterStartElement(writer, (xmlChar*)"link");
+        xmlTextWriterWriteAttribute( writer,
+            (xmlChar*)"href", (xmlChar*)i->c_str() );
+        xmlTextWriterEndElement(writer);
+    }
+    xmlTextWriterEndElement(writer);
+
+    xmlTextWriterStartElement(writer, (xmlChar*)"results");
+    started = true;
+}
+
+void XMLResultWriter::result(const Term *terms)
+{
+    xmlTextWriterStartElement(writer, (xmlChar*)"result");
+    for(size_t n = 0; n < vars.size(); ++n)
+    {
+        const Term &term = terms[n];
+        if(term.kind == Term::unbound)
+            continue;
+
+        xmlTextWriterStartElement(writer, (xmlChar*)"binding");
+        xmlTextWriterWriteAttribute( writer,
+            (xmlChar*)"name", (xmlChar*)vars[n].c_str() );
+
+        if(term.kind == Term::literal)
+        {
+            xmlTextWriterStartElement(writer, (xmlChar*)"literal");
+            if(*term.datatype)
+            {
+                xmlTextWriterWriteAttribute( writer,
+                    (xmlChar*)"datatype", (xmlChar*)term.datatype );
+            }
+            xmlTextWriterWriteString(writer, (xmlChar*)term.lexical);
+            xmlTextWriterEndElement(writer);
+        }
+        else
+        {
+            // TODO: support blank nodes in addition to uri's
+            xmlTextWriterStartElement(writer, (xmlChar*)"uri");
+            xmlTextWriterWriteString(writer, (xmlChar*)term.lexical);
+            xmlTextWriterEndElement(writer);
+        }
+
+        xmlTextWriterEndElement(writer);
+    }
+    xmlTextWriterEndElement(writer);
+}
+
+void XMLResultWriter::end()
+{
+    xmlTextWriterEndDocument(writer);
+}
+
+void XMLResultWriter::boolean(bool value)
+{
+    xmlTextWriterStartElement(writer, (xmlChar*)"head");
+    xmlTextWriterEndElement(writer);
+    xmlTextWriterWriteElement( writer, (xmlChar*)"boolean",
+        (xmlChar*)(value ? "true" : "false") );
+    xmlTextWriterEndDocument(writer);
+}
+
+void XMLResultWriter::error(const char *msg)
+{
+    // Errors after the head follow the results written so far
+    if(started)
+        xmlTextWriterEndElement(writer);
+    else
+        xmlTextWriterStartElement(writer, (xmlChar*)"head");
+    xmlTextWriterStartElement(writer, (xmlChar*)"error");
+    xmlTextWriterWriteCDATA(writer, (xmlChar*)msg);
+    xmlTextWriterEndDocument(writer);
+}
+
+
+class JSONResultWriter : public ResultWriter
+{
+    OutputBuffer out;
+    std::vector<std::string> vars, links;
+    enum { initial, results, finished } state;
+    bool first;
+
+public:
+    JSONResultWriter();
+
+    void link(const std::string &href);
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+    void boolean(bool value);
+};
+
+JSONResultWriter::JSONResultWriter()
+    : out(stdout), state(initial)
+{
+}
+
+void JSONResultWriter::link(const std::string &href)
+{
+    links.push_back(href);
+}
+
+void JSONResultWriter::head(const std::vector<std::string> &vars)
+{
+    this->vars = vars;
+
+    out.write("{\"head\":{\"vars\":[");
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+        i != vars.end(); ++i )
+    {
+        if(i != vars.begin())
+            out.put(',');
+        out.put('"');
+        out.write_escaped(i->c_str(), '"', json_escape);
+        out.put('"');
+    }
+    if(!links.empty())
+    {
+        out.write("],\"link\":[");
+        for( std::vector<std::string>::const_iterator i = links.begin();
+            i != links.end(); ++i )
+        {
+            if(i != links.begin())
+                out.put(',');
+            out.put('"');
+            out.write_escaped(i->c_str(), '"', json_escape);
+            out.put('"');
+        }
+    }
+    out.write("]},\n\"results\":{\"bindings\":[\n");
+    state = results;
+    first = true;
+}
+
+void JSONResultWriter::result(const Term *terms)
+{
+    out.write(first ? "{" : ",\n{");
+    first = false;
+
+    bool first_binding = true;
+    for(size_t n = 0; n < vars.size(); ++n)
+    {
+        const Term &term = terms[n];
+        if(term.kind == Term::unbound)
+            continue;
+
+        if(!first_binding)
+            out.put(',');
+        first_binding = false;
+
+        out.put('"');
+        out.write_escaped(vars[n].c_str(), '"', json_escape);
+        out.write(term.kind == Term::literal
+            ? "\":{\"type\":\"literal\",\"value\":\""
+            : "\":{\"type\":\"uri\",\"value\":\"");
+        out.write_escaped(term.lexical, '"', json_escape);
+        if(term.kind == Term::literal && *term.datatype)
+        {
+            out.write("\",\"datatype\":\"");
+            out.write_escaped(term.datatype, '"', json_escape);
+        }
+        out.write("\"}");
+    }
+    out.put('}');
+    out.row();
+}
+
+void JSONResultWriter::end()
+{
+    out.write("\n]}}\n");
+    state = finished;
+}
+
+void JSONResultWriter::boolean(bool value)
+{
+    out.write(value ? "{\"head\":{},\"boolean\":true}\n"
+                    : "{\"head\":{},\"boolean\":false}\n");
+    state = finished;
+}
+
+void JSONResultWriter::error(const char *msg)
+{
+    if(state == results)
+        out.write("\n]},\n");
+    else
+        out.put('{');
+    out.write("\"error\":\"");
+    out.write_escaped(msg, '"', json_escape);
+    out.write("\"}\n");
+    state = finished;
+}
+
+
+class TSVResultWriter : public ResultWriter
+{
+    OutputBuffer out;
+    size_t columns;
+
+public:
+    TSVResultWriter();
+
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+    void boolean(bool value);
+};
+
+TSVResultWriter::TSVResultWriter()
+    : out(stdout), columns(0)
+{
+}
+
+void TSVResultWriter::head(const std::vector<std::string> &vars)
+{
+    columns = vars.size();
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+        i != vars.end(); ++i )
+    {
+        if(i != vars.begin())
+            out.put('\t');
+        out.put('?');
+        out.write(i->data(), i->size());
+    }
+    out.put('\n');
+}
+
+void TSVResultWriter::result(const Term *terms)
+{
+    for(size_t n = 0; n < columns; ++n)
+    {
+        const Term &term = terms[n];
+        if(n > 0)
+            out.put('\t');
+
+        if(term.kind == Term::uri)
+        {
+            out.put('<');
+            out.write_escaped(term.lexical, '"', tsv_escape);
+            out.put('>');
+        }
+        else
+        if(term.kind == Term::literal)
+        {
+            out.put('"');
+            out.write_escaped(term.lexical, '"', tsv_escape);
+            out.put('"');
+            if(*term.datatype)
+            {
+                out.write("^^<");
+                out.write_escaped(term.datatype, '"', tsv_escape);
+                out.put('>');
+            }
+        }
+    }
+    out.put('\n');
+    out.row();
+}
+
+void TSVResultWriter::end()
+{
+}
+
+void TSVResultWriter::boolean(bool value)
+{
+    out.write(value ? "true\n" : "false\n");
+}
+
+void TSVResultWriter::error(const char *msg)
+{
+    // TSV has no way to report errors in-band.
+    out.flush();
+    std::fprintf(stderr, "%s\n", msg);
+}
+
+
+class CSVResultWriter : public ResultWriter
+{
+    OutputBuffer out;
+    size_t columns;
+
+    void write_field(const char *str);
+
+public:
+    CSVResultWriter();
+
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+    void boolean(bool value);
+};
+
+CSVResultWriter::CSVResultWriter()
+    : out(stdout), columns(0)
+{
+}
+
+void CSVResultWriter::write_field(const char *str)
+{
+    if(std::strpbrk(str, "\",\r\n") == NULL)
+    {
+        out.write(str);
+    }
+    else
+    {
+        out.put('"');
+        out.write_escaped(str, '"', csv_escape);
+        out.put('"');
+    }
+}
+
+void CSVResultWriter::head(const std::vector<std::string> &vars)
+{
+    columns = vars.size();
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+        i != vars.end(); ++i )
+    {
+        if(i != vars.begin())
+            out.put(',');
+        write_field(i->c_str());
+    }
+    out.write("\r\n", 2);
+}
+
+void CSVResultWriter::result(const Term *terms)
+{
+    for(size_t n = 0; n < columns; ++n)
+    {
+        if(n > 0)
+            out.put(',');
+        if(terms[n].kind != Term::unbound)
+            write_field(terms[n].lexical);
+    }
+    out.write("\r\n", 2);
+    out.row();
+}
+
+void CSVResultWriter::end()
+{
+}
+
+void CSVResultWriter::boolean(bool value)
+{
+    out.write(value ? "true\r\n" : "false\r\n");
+}
+
+void CSVResultWriter::error(const char *msg)
+{
+    // CSV has no way to report errors in-band.
+    out.flush();
+    std::fprintf(stderr, "%s\n", msg);
+}
+
+
+/*
+    The binary result format consists of a header followed by batches of
+    results. All integers are little-endian; strings are written as a 32-bit
+    length followed by that many bytes of UTF-8 data (not zero-terminated).
+
+    Header:
+        "SRB1"                      magic
+        u32     variable count
+        string  variable name       (once for each variable)
+
+    Batch:
+        u32     row count           (0 marks the end of the stream)
+        u32     dictionary size
+        (dictionary entries)
+        i64     node id             (row count times for each variable,
+                                     column by column; -1 if unbound)
+
+    Dictionary entry:
+        i64     node id
+        u8      kind                (0: uri, 1: plain literal, 2: typed literal,
+                                     3: computed literal)
+        i64     datatype id         (typed literals only)
+        string  datatype URI        (computed literals only)
+        string  lexical value
+
+    Every node is described in the dictionary of the first batch that refers
+    to it, either as a value or as a datatype, and is not repeated in later
+    batches. Computed values (such as aggregates) are not nodes; each is
+    given a unique negative id below -1 and described in its own batch.
+    Consumers that only join or group on values can therefore work on node
+    ids without decoding strings.
+
+    An error aborts the stream with a row count of 0xFFFFFFFF followed by
+    an error message string.
+*/
+class BinaryResultWriter : public ResultWriter
+{
+    enum { batch_size = 4096 };
+
+    struct Computed
+    {
+        long long id;
+        std::string datatype, lexical;
+    };
+
+    OutputBuffer out;
+    TermDecoder decoder;
+    std::set<long long> described;
+    std::vector<long long> ids;
+    std::vector<Computed> computed;
+    long long next_computed;
+    size_t columns, rows;
+    bool started;
+
+    void write_u32(unsigned long i);
+    void write_i64(long long i);
+    void write_string(const std::string &str);
+    void describe(long long id, std::vector<long long> &entries);
+    void flush_batch();
+
+public:
+    BinaryResultWriter(sqlite3 *db);
+
+    bool wants_ids() const;
+    void head(const std::vector<std::string> &vars);
+    void result(const Term *terms);
+    void end();
+    void error(const char *msg);
+};
+
+BinaryResultWriter::BinaryResultWriter(sqlite3 *db)
+    : out(stdout), decoder(db), next_computed(-2), columns(0), rows(0),
+      started(false)
+{
+}
+
+bool BinaryResultWriter::wants_ids() const
+{
+    return true;
+}
+
+void BinaryResultWriter::write_u32(unsigned long i)
+{
+    char buf[4] = { char(i), char(i >> 8), char(i >> 16), char(i >> 24) };
+    out.write(buf, 4);
+}
+
+void BinaryResultWriter::write_i64(long long i)
+{
+    unsigned long long u = i;
+    char buf[8];
+    for(int n = 0; n < 8; ++n, u >>= 8)
+        buf[n] = char(u);
+    out.write(buf, 8);
+}
+
+void BinaryResultWriter::write_string(const std::string &str)
+{
+    write_u32(str.size());
+    out.write(str.data(), str.size());
+}
+
+/* Adds 'id' to 'entries' unless it has been described before. */
+void BinaryResultWriter::describe(long long id, std::vector<long long> &entries)
+{
+    if(id < 0 || !described.insert(id).second)
+        return;
+    entries.push_back(id);
+}
+
+void BinaryResultWriter::flush_batch()
+{
+    // Collect nodes to be described in the dictionary
+    std::vector<long long> entries;
+    for(size_t n = 0; n < ids.size(); ++n)
+        describe(ids[n], entries);
+
+    std::vector<std::string> lexicals;
+    std::vector<nid_t> datatypes;
+    for(size_t n = 0; n < entries.size(); ++n)
+    {
+        std::string lexical;
+        nid_t datatype;
+        if(!decoder.decode(entries[n], lexical, datatype))
+            throw "Unable to decode node!";
+        lexicals.push_back(lexical);
+        datatypes.push_back(datatype);
+        if(datatype > 1)
+            describe(datatype, entries);
+    }
+
+    // Write batch
+    write_u32(rows);
+    write_u32(entries.size() + computed.size());
+    for(size_t n = 0; n < computed.size(); ++n)
+    {
+        write_i64(computed[n].id);
+        out.put(3);
+        write_string(computed[n].datatype);
+        write_string(computed[n].lexical);
+    }
+    for(size_t n = 0; n < entries.size(); ++n)
+    {
+        write_i64(entries[n]);
+        if(datatypes[n] > 1)
+        {
+            out.put(2);
+            write_i64(datatypes[n]);
+        }
+        else
+        {
+            out.put(char(datatypes[n]));
+        }
+        write_string(lexicals[n]);
+    }
+    for(size_t c = 0; c < columns; ++c)
+        for(size_t r = 0; r < rows; ++r)
+            write_i64(ids[r*columns + c]);
+    out.row();
+
+    ids.clear();
+    computed.clear();
+    rows = 0;
+}
+
+void BinaryResultWriter::head(const std::vector<std::string> &vars)
+{
+    columns = vars.size();
+    out.write("SRB1", 4);
+    write_u32(columns);
+    for( std::vector<std::string>::const_iterator i = vars.begin();
+        i != vars.end(); ++i )
+    {
+        write_string(*i);
+    }
+    started = true;
+}
+
+void BinaryResultWriter::result(const Term *terms)
+{
+    for(size_t n = 0; n < columns; ++n)
+    {
+        if(terms[n].id < 0 && terms[n].kind != Term::unbound)
+        {
+            Computed c;
+            c.id = next_computed--;
+            c.datatype = terms[n].datatype ? terms[n].datatype : "";
+            c.lexical = terms[n].lexical;
+            computed.push_back(c);
+            ids.push_back(c.id);
+            continue;
+        }
+        ids.push_back(terms[n].id);
+    }
+    if(++rows == batch_size)
+        flush_batch();
+}
+
+void BinaryResultWriter::end()
+{
+    if(rows > 0)
+        flush_batch();
+    write_u32(0);
+}
+
+void BinaryResultWriter::error(const char *msg)
+{
+    if(!started)
+    {
+        out.write("SRB1", 4);
+        write_u32(0);
+    }
+    write_u32(0xFFFFFFFFul);
+    write_string(msg);
+}
+
+
+ResultWriter *create_result_writer(const std::string &format, sqlite3 *db)
+{
+    if(format == "xml")
+    {
+        xmlTextWriterPtr writer = xmlNewTextWriterFilename("-", 0);
+        return writer ? new XMLResultWriter(writer) : NULL;
+    }
+    if(format == "json")
+        return new JSONResultWriter;
+    if(format == "tsv")
+        return new TSVResultWriter;
+    if(format == "csv")
+        return new CSVResultWriter;
+    if(format == "binary")
+        return new BinaryResultWriter(db);
+    return NULL;
+}
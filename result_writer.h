@@ -0,0 +1,57 @@
+#ifndef RESULT_WRITER_H_INCLUDED
+#define RESULT_WRITER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "output_buffer.h"
+
+/* A single value in a query solution, as passed to ResultWriter::result().
+   For literals, 'datatype' is the datatype URI, or an empty string for plain
+   literals. Strings are zero-terminated and UTF-8 encoded.
+
+   Writers for which wants_ids() returns true are passed only the node
+   identifier of each value in 'id' (or -1 for unbound values) and decode
+   values themselves; for other writers, 'id' is undefined. Computed values
+   (such as aggregates) are not nodes in the database, and are always passed
+   as literals with an 'id' of -1. */
+struct Term
+{
+    enum Kind { unbound, uri, literal } kind;
+    const char *lexical, *datatype;
+    long long id;
+};
+
+/* Serializes query results in a particular format. Calls are made in the
+   following order: head(), result() once for each solution, and end().
+   error() may be called at any time (instead of end()) to abort output.
+   The result of an ASK query is written with a single call to boolean()
+   instead; by default, it is written as zero or one solution without
+   variables.
+
+   link() may be called before head() with a link to related results, such as
+   the continuation token of a paginated query. The XML and JSON formats
+   include links in their head; by default, they are written to standard
+   error. */
+class ResultWriter
+{
+public:
+    virtual ~ResultWriter();
+
+    virtual bool wants_ids() const;
+    virtual void link(const std::string &href);
+
+    virtual void head(const std::vector<std::string> &vars) = 0;
+    virtual void result(const Term *terms) = 0;
+    virtual void end() = 0;
+    virtual void error(const char *msg) = 0;
+    virtual void boolean(bool value);
+};
+
+/* Creates a result writer for the given format ("xml", "json", "tsv", "csv"
+   or "binary") writing to standard output, or returns NULL if the format is
+   not supported. 'db' is used to decode node identifiers if necessary. */
+ResultWriter *create_result_writer(const std::string &format, sqlite3 *db);
+
+
+#endif /* ndef RESULT_WRITER_H_INCLUDED */
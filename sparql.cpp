@@ -1,271 +1,574 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <string>
 #include <libgen.h>
+#include <sys/time.h>
 #include "sqlite3.h"
-#include "sparql_parser.h"
+#include "sparql_mapper.h"
+#include "result_writer.h"
+#include "native_engine.h"
+#include "parallel_query.h"
+#include "batch_runner.h"
+#include "query_budget.h"
+#include "result_cache.h"
+#include "term_decoder.h"
+#include "turtle_writer.h"
+#include "construct_writer.h"
 
 static sqlite3 *db;
+static const char *database_path;
+static int jobs = 1;
+static bool explain = false, analyze = false;
+static QueryBudget *budget;
+
+/* Statistics collected with --analyze; times are in seconds. Unless
+   'decoded' or 'serialized' is set, terms were decoded or results were
+   written during evaluation, and the time this took is included in
+   'evaluate'. */
+static struct Statistics
+{
+    long long rows;
+    double evaluate, decode, serialize;
+    bool decoded, serialized;
+} stats;
 
-typedef long long int nid_t;
-
-/* Built-in datatypes */
-#define TYPE_URI        (0ll)
-#define TYPE_LITERAL    (1ll)
-#define TYPE_BOOLEAN    (2ll)
-#define TYPE_INTEGER    (3ll)
-#define TYPE_DATE_TIME  (4ll)
-#define TYPE_FLOAT      (5ll)
-#define TYPE_DOUBLE     (6ll)
+static double now()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
 
-class SQLMapper
+/* Writes the query plan that SQLite chooses for a query to standard output. */
+static void explain_query_plan( const std::string &sql, SQLMapper &mapper,
+                                const std::map<std::string, Node> &values )
 {
-    typedef std::map<std::pair<std::string, nid_t>, nid_t> nodes_t;
-    typedef std::map<std::string, std::pair<int, char> > bindings_t;
+    std::string explain = "EXPLAIN QUERY PLAN " + sql;
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, explain.data(), explain.size(), &stmt, NULL) != SQLITE_OK)
+        throw std::string("Unable to prepare statement: \"") + explain + "\"!";
+    for( std::map<std::string, Node>::const_iterator i = values.begin();
+         i != values.end(); ++i )
+    {
+        mapper.bind(stmt, i->first, i->second);
+    }
 
-    std::ostringstream os;
-    int tables;
-    bindings_t bindings;
-    std::set<std::string> resources;
+    // Rows consist of an id, the id of the parent row and a description
+    std::map<int, int> depth;
+    int result;
+    while((result = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        int id = sqlite3_column_int(stmt, 0), parent = sqlite3_column_int(stmt, 1);
+        depth[id] = depth.count(parent) ? depth[parent] + 1 : 1;
+        std::cout << std::string(2*depth[id], ' ')
+                  << (const char*)sqlite3_column_text(stmt, 3) << '\n';
+    }
+    sqlite3_finalize(stmt);
+    if(result != SQLITE_DONE)
+        throw "Unable to retrieve query plan!";
+}
 
-    void generate_joins(const Pattern &p, bool optional);
-    void write_expression(const Expr &expr);
+/* Writes the counters that SQLite keeps for a statement to standard error. */
+static void write_statement_status(sqlite3_stmt *stmt)
+{
+    std::cerr << "VM steps:          "
+              << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0) << '\n'
+              << "Full scan steps:   "
+              << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0) << '\n'
+              << "Sort operations:   "
+              << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0) << '\n'
+              << "Automatic indexes: "
+              << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0) << '\n';
+
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+    // Rows examined by each loop of the query plan
+    for(int n = 0; ; ++n)
+    {
+        sqlite3_int64 loops, visits;
+        const char *explain;
+        if(sqlite3_stmt_scanstatus(stmt, n, SQLITE_SCANSTAT_NLOOP, &loops) != 0)
+            break;
+        sqlite3_stmt_scanstatus(stmt, n, SQLITE_SCANSTAT_NVISIT, &visits);
+        sqlite3_stmt_scanstatus(stmt, n, SQLITE_SCANSTAT_EXPLAIN, &explain);
+        std::cerr << "  " << explain << " (" << loops << " loops, "
+                  << visits << " rows)\n";
+    }
+#else
+    std::cerr << "Rows per pattern:  not available (build with"
+                 " -DSQLITE_ENABLE_STMT_SCANSTATUS)\n";
+#endif
+}
 
-public:
-    SQLMapper(const Query &query);
+/* Writes the statistics collected with --analyze to standard error. */
+static void write_statistics()
+{
+    std::cerr << "Rows:              " << stats.rows << '\n'
+              << "Evaluation:        " << stats.evaluate*1000 << " ms\n";
+    if(stats.decoded)
+        std::cerr << "Decoding:          " << stats.decode*1000 << " ms\n";
+    else
+        std::cerr << "Decoding:          included in evaluation\n";
+    if(stats.serialized)
+        std::cerr << "Serialization:     " << stats.serialize*1000 << " ms";
+    else
+        std::cerr << "Serialization:     included in evaluation";
+    std::cerr << std::endl;
+}
 
-    bool resource(const std::string &var) const;
-    std::string sql() const;
-};
+/* Decodes a term from its node identifier. The term refers to the entry in
+   'cache', which remains valid until the cache is trimmed. */
+static void decode_term(TermCache &cache, Term &term)
+{
+    if(term.id < 0)
+    {
+        term.kind = Term::unbound;
+        return;
+    }
+    const TermCache::Entry &entry = cache.lookup(term.id);
+    term.kind = entry.literal ? Term::literal : Term::uri;
+    term.lexical = entry.lexical.c_str();
+    term.datatype = entry.datatype.c_str();
+}
 
-static nid_t nid(const std::string &lexical, nid_t datatype);
+/*
+    Restricties:
+        - minstens 1 verplichte quad vereist
+        - twee gescheiden optionele subgroups mogen geen variabelen delen
+*/
 
 
-void SQLMapper::generate_joins(const Pattern &p, bool optional)
+/* Executes the SQL query generated by 'mapper' and writes its results, or
+   writes the SQL query to standard output if 'writer' is NULL. With more than
+   one job, the query is evaluated in partitions by a ParallelQuery. With
+   --analyze, node identifiers are selected and decoded separately, so that
+   the time spent decoding can be measured. */
+static void execute_sql( const Query &q, SQLMapper &mapper,
+                         const std::map<std::string, Node> &values,
+                         ResultWriter *writer )
 {
-    for( std::vector<Quad>::const_iterator i = p.mandatory_quads.begin();
-         i != p.mandatory_quads.end(); ++i )
+    if( writer && jobs > 1 && q.form == Query::select &&
+        !mapper.partition_variable().empty() )
+    {
+        std::map<std::string, nid_t> parameters;
+        for( std::map<std::string, Node>::const_iterator i = values.begin();
+             i != values.end(); ++i )
+        {
+            parameters[i->first] = mapper.resolve(i->second);
+        }
+
+        double start = now();
+        stats.rows =
+            ParallelQuery(db, database_path, q, mapper, parameters, jobs, budget)
+                .execute(*writer);
+        stats.evaluate = now() - start;
+        return;
+    }
+
+    bool ids = writer && writer->wants_ids(),
+         decode = analyze && writer && !ids;
+    std::string sql = ids || decode ? mapper.id_sql() : mapper.sql();
+    std::auto_ptr<TermCache> cache(decode ? new TermCache(db) : NULL);
+    stats.decoded = decode;
+    stats.serialized = true;
+
+    // Determine types of variables
+    std::vector<bool> is_resource, is_computed;
+    for( std::vector<std::string>::const_iterator i = q.projection.begin();
+         i != q.projection.end(); ++i )
     {
-        const Quad &q = *i;
-        const int table = tables++;
-        os << (optional ? " LEFT JOIN" : " JOIN") << " Quad q" << table;
+        is_resource.push_back(mapper.resource(*i));
+        is_computed.push_back(mapper.computed(*i));
+    }
+
+    // Prepare generated query
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+    {
+        throw std::string("Unable to prepare generated SQL query: \"")
+            + sql + "\"!";
+    }
+
+    // Bind parameters
+    for( std::map<std::string, Node>::const_iterator i = values.begin();
+         i != values.end(); ++i )
+    {
+        mapper.bind(stmt, i->first, i->second);
+    }
 
-        int constraint = 0;
-        static const char field[4] = { 'g', 's', 'p', 'o' };
-        for(int f = 0; f < 4; ++f)
+    if(writer == NULL)
+    {
+        std::cout << sql << std::endl;
+        if(explain)
         {
-            const Node &node = q[f];
-            if(node.type == Node::variable)
+            std::cout << "\nPatterns:\n";
+            for(size_t n = 0; n < mapper.pattern_text().size(); ++n)
+                std::cout << "  " << mapper.pattern_text()[n] << '\n';
+            std::cout << "\nQuery plan:\n";
+            explain_query_plan(sql, mapper, values);
+            std::cout << std::flush;
+        }
+    }
+    else
+    {
+        double time = analyze ? now() : 0;
+        int result = sqlite3_step(stmt);
+        if(result == SQLITE_BUSY)
+        {
+            sqlite3_finalize(stmt);
+            throw "Database is busy!";
+        }
+
+        if(q.form == Query::ask)
+        {
+            // A single solution answers the query
+            sqlite3_finalize(stmt);
+            if(result != SQLITE_ROW && result != SQLITE_DONE)
+                throw "Unable to retrieve query results!";
+            if(analyze)
+                stats.evaluate = now() - time;
+            writer->boolean(result == SQLITE_ROW);
+            return;
+        }
+
+        // Write header
+        writer->head(q.projection);
+
+        // Write results
+        std::vector<Term> terms(q.projection.size());
+        while(result == SQLITE_ROW)
+        {
+            int col = 0;
+            for(size_t n = 0; n < terms.size() && (ids || decode); ++n)
             {
-                if(f != 3)
-                    resources.insert(node.lexical);
-    
-                bindings_t::const_iterator j = bindings.find(node.lexical);
-                if(j == bindings.end())
+                if(is_computed[n])
                 {
-                    bindings[node.lexical] = std::make_pair(table, field[f]);
-                }
-                else
-                {
-                    os << (constraint++ == 0 ? " ON" : " AND")
-                        << " q" << table << '.' << field[f] << '='
-                        << 'q' << j->second.first << '.' << j->second.second;
+                    // Computed values have no node identifier
+                    terms[n].datatype = (const char*)sqlite3_column_text(stmt, col++);
+                    terms[n].lexical = (const char*)sqlite3_column_text(stmt, col++);
+                    terms[n].kind = Term::literal;
+                    terms[n].id = -1;
+                    continue;
                 }
+                terms[n].id = sqlite3_column_type(stmt, col) == SQLITE_NULL
+                    ? -1 : sqlite3_column_int64(stmt, col);
+                ++col;
             }
-            else
-            if(node.type == Node::resource)
+            for(size_t n = 0; n < terms.size() && !ids && !decode; ++n)
             {
-                os << (constraint++ == 0 ? (" ON") : " AND")
-                    << " q" << table << '.' << field[f] << '='
-                    << nid(node.lexical.c_str(), TYPE_URI);
-                    ++constraint;
+                const char *datatype = NULL;
+                if(!is_resource[n])
+                    datatype = (const char*)sqlite3_column_text(stmt, col++);
+                terms[n].lexical = (const char*)sqlite3_column_text(stmt, col++);
+                terms[n].datatype = datatype;
+                terms[n].kind = terms[n].lexical == NULL ? Term::unbound :
+                                datatype ? Term::literal : Term::uri;
+            }
+            if(analyze)
+            {
+                double t = now();
+                stats.evaluate += t - time;
+                if(decode)
+                {
+                    for(size_t n = 0; n < terms.size(); ++n)
+                        if(!is_computed[n])
+                            decode_term(*cache, terms[n]);
+                    time = now();
+                    stats.decode += time - t;
+                    t = time;
+                }
+                writer->result(terms.empty() ? NULL : &terms[0]);
+                if(decode)
+                    cache->trim();
+                time = now();
+                stats.serialize += time - t;
+                ++stats.rows;
             }
             else
-            if(node.type == Node::literal)
             {
-                nid_t datatype = node.datatype.empty() ? TYPE_LITERAL
-                    : nid(node.datatype.c_str(), TYPE_URI);
-                os << (constraint++ == 0 ? (" ON") : " AND")
-                    << " q" << table << '.' << field[f] << '='
-                    << nid(node.lexical.c_str(), datatype);
+                writer->result(terms.empty() ? NULL : &terms[0]);
             }
+
+            result = sqlite3_step(stmt);
         }
-    }
+        if(analyze)
+            stats.evaluate += now() - time;
+        if(result != SQLITE_DONE)
+        {
+            sqlite3_finalize(stmt);
+            throw "Unable to retrieve query results!";
+        }
+        writer->end();
 
-    for( std::vector<Pattern*>::const_iterator i = p.optional_patterns.begin();
-         i != p.optional_patterns.end(); ++i )
-    {
-        generate_joins(**i, true);
+        if(analyze)
+            write_statement_status(stmt);
     }
+
+    // Clean up
+    sqlite3_finalize(stmt);
 }
 
-void SQLMapper::write_expression(const Expr &expr)
+/* Writes rows of node identifiers, decoding them unless the writer wants
+   identifiers. */
+static void write_ids( ResultWriter &writer, const std::vector<std::string> &vars,
+                       const std::vector<nid_t> &rows )
 {
-    switch(expr.op)
+    TermCache cache(db);
+    bool ids = writer.wants_ids();
+    double time = analyze ? now() : 0;
+    stats.decoded = stats.serialized = true;
+
+    writer.head(vars);
+    std::vector<Term> terms(vars.size());
+    for(size_t r = 0; r < rows.size(); r += vars.size())
     {
-    case Expr::value:
-        switch(expr.node->type)
+        for(size_t n = 0; n < terms.size(); ++n)
         {
-        case Node::variable:
-            {
-                bindings_t::const_iterator j = bindings.find(expr.node->lexical);
-                if(j == bindings.end())
-                {
-                    throw std::string("Variable \"") + expr.node->lexical +
-                        "\" not used in graph pattern!";
-                }
-        
-                os << " (SELECT l FROM Node WHERE oid=q" << j->second.first
-                << '.' << j->second.second << ")";
-            }
-            break;
-
-        default:
-            throw "unsupported node type";
+            Term &term = terms[n];
+            term.id = rows[r + n];
+            if(!ids)
+                decode_term(cache, term);
+        }
+        if(analyze)
+        {
+            double t = now();
+            stats.decode += t - time;
+            writer.result(&terms[0]);
+            time = now();
+            stats.serialize += time - t;
+            ++stats.rows;
         }
-        break;
-
-    case Expr::and:
-    case Expr::or:
-    case Expr::mult:
-    case Expr::div:
-    case Expr::plus:
-    case Expr::min:
-    case Expr::neg:
-    case Expr::inv:
-    case Expr::equal:
-    case Expr::not_equal:
-    case Expr::greater:
-    case Expr::greater_equal:
-    case Expr::less:
-    case Expr::less_equal:
-    default:
-        throw "unsupported expression operator";
+        else
+        {
+            writer.result(&terms[0]);
+        }
+        cache.trim();
     }
+    writer.end();
 }
 
-bool SQLMapper::resource(const std::string &var) const
-{
-    return resources.find(var) != resources.end();
-}
-
-SQLMapper::SQLMapper(const Query &query)
+/* Evaluates a page of the results of a paginated query, and writes them with
+   a continuation token for the next page if the page is full. The page is
+   evaluated before anything is written, as the token goes in the head. */
+static void execute_page( const Query &q, SQLMapper &mapper,
+                          const std::map<std::string, Node> &values,
+                          ResultWriter &writer )
 {
-    // Generate joins
-    tables = 0;
-    generate_joins(*query.pattern, false);
-    std::string joins = os.str();
-    os.str(std::string());
-
-    os << "SELECT";
-
-    if(query.distinct)
-        os << " DISTINCT";
+    std::string sql = mapper.id_sql();
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+    {
+        throw std::string("Unable to prepare generated SQL query: \"")
+            + sql + "\"!";
+    }
+    for( std::map<std::string, Node>::const_iterator i = values.begin();
+         i != values.end(); ++i )
+    {
+        mapper.bind(stmt, i->first, i->second);
+    }
 
-    // Generate projection
-    for( std::vector<std::string>::const_iterator i = query.projection.begin();
-         i != query.projection.end(); ++i )
+    // Collect node identifiers, and the cursor of the last row
+    double start = now();
+    size_t columns = q.projection.size();
+    std::vector<nid_t> rows;
+    std::vector<long long> cursor(mapper.cursor_columns());
+    long long count = 0;
+    int result;
+    while((result = sqlite3_step(stmt)) == SQLITE_ROW)
     {
-        bindings_t::const_iterator j = bindings.find(*i);
-        if(j == bindings.end())
+        for(size_t n = 0; n < columns; ++n)
         {
-            throw std::string("Variable \"") + *i + "\" not used in graph pattern!";
+            rows.push_back(sqlite3_column_type(stmt, n) == SQLITE_NULL
+                ? -1 : sqlite3_column_int64(stmt, n));
         }
-
-        if(resources.find(*i) == resources.end())
+        for(size_t n = 0; n < cursor.size(); ++n)
         {
-            // Select datatype as well
-            os << " (SELECT d.l FROM Node n JOIN Node d ON n.d = d.oid"
-                  " WHERE n.oid=q" << j->second.first << '.' << j->second.second
-               << "),";
+            cursor[n] = sqlite3_column_type(stmt, columns + n) == SQLITE_NULL
+                ? -1 : sqlite3_column_int64(stmt, columns + n);
         }
+        ++count;
+    }
+    if(analyze)
+        write_statement_status(stmt);
+    sqlite3_finalize(stmt);
+    stats.evaluate = now() - start;
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_DONE)
+        throw "Unable to retrieve query results!";
+
+    if(count > 0 && count == q.limit)
+        writer.link(mapper.continuation(cursor));
+    write_ids(writer, q.projection, rows);
+}
 
-        os << " (SELECT l FROM Node WHERE oid=q" << j->second.first
-           << '.' << j->second.second << ")" << ',';
+/* Evaluates the query with the native engine and writes its results, or
+   writes the query plan to standard output if 'writer' is NULL. */
+static void execute_native( const Query &q, SQLMapper &mapper,
+                            const std::map<std::string, Node> &values,
+                            ResultWriter *writer )
+{
+    std::map<std::string, nid_t> parameters;
+    for( std::map<std::string, Node>::const_iterator i = values.begin();
+         i != values.end(); ++i )
+    {
+        parameters[i->first] = mapper.resolve(i->second);
     }
-    os << " NULL FROM (SELECT NULL)" << joins;
 
-    // Solution modifier: ORDER BY
-    if(!query.order.empty())
+    NativeEngine engine(db, q, mapper, parameters);
+    if(writer == NULL)
     {
-        for( std::vector<OrderCond*>::const_iterator i = query.order.begin();
-             i != query.order.end(); ++i )
+        if(explain)
+        {
+            std::cout << "Patterns:\n";
+            for(size_t n = 0; n < mapper.pattern_text().size(); ++n)
+                std::cout << "  " << mapper.pattern_text()[n] << '\n';
+            std::cout << "\nQuery plan:\n";
+        }
+        std::cout << engine.plan() << std::flush;
+    }
+    else
+    {
+        std::vector<nid_t> rows;
+        double start = now();
+        size_t count = engine.execute(rows);
+        stats.evaluate = now() - start;
+        if(q.form == Query::ask)
+            writer->boolean(count > 0);
+        else
         {
-            os << (i == query.order.begin() ? " ORDER BY" : ",");
-            write_expression(*(*i)->expr);
-            if((*i)->desc)
-                os << " DESC";
+            if(q.projection.empty())
+                rows.clear();
+            write_ids(*writer, q.projection, rows);
         }
+        if(analyze)
+            std::cerr << engine.plan();
     }
+}
 
-    // Solution modifier: LIMIT
-    if(query.limit >= 0)
-        os << " LIMIT " << query.limit;
+/* Returns the key under which results of a query are cached: its tokens
+   separated by single spaces, followed by the variable bindings. */
+static std::string cache_key( const char *query,
+                              std::vector<std::string> bindings )
+{
+    std::string key;
+    Tokenizer t(query, query + std::strlen(query));
+    while(t.type() > 0)
+    {
+        if(!key.empty())
+            key += ' ';
+        key.append(t.begin(), t.size());
+        t.advance();
+    }
+    if(t.type() != Tokenizer::done)
+        key = query;
 
-    // Solution modifier: OFFSET
-    if(query.offset >= 0)
-        os << (query.limit >= 0 ? " OFFSET " : " LIMIT -1 OFFSET ") << query.offset;
+    std::sort(bindings.begin(), bindings.end());
+    for( std::vector<std::string>::const_iterator i = bindings.begin();
+         i != bindings.end(); ++i )
+    {
+        key += '\n';
+        key += *i;
+    }
+    return key;
 }
 
-std::string SQLMapper::sql() const
+/* Returns whether results are written in an RDF serialization, which is the
+   case for (and only for) CONSTRUCT queries. */
+static bool graph_format(const std::string &format)
 {
-    return os.str();
+    return format == "turtle" || format == "ntriples";
 }
 
-
-nid_t nid(const std::string &lexical, nid_t datatype)
+/* Reports an error in the result format if possible, or on standard error
+   otherwise (which is where errors go when no results are written). */
+static void report_error( ResultWriter *&writer, const std::string &format,
+                          bool output_sql, const char *msg )
 {
-    static sqlite3_stmt *stmt = NULL;
+    if(!output_sql && writer == NULL && !graph_format(format))
+        writer = create_result_writer(format.empty() ? "xml" : format, db);
+    if(output_sql || writer == NULL)
+        std::cerr << msg << std::endl;
+    else
+        writer->error(msg);
+}
 
-    if(!stmt)
+/* Parses variable bindings given with --bind; their values are interned in
+   'arena'. */
+static void parse_bindings( const std::vector<std::string> &bindings,
+                            std::map<std::string, Node> &values,
+                            std::set<std::string> &parameters, Arena &arena )
+{
+    for( std::vector<std::string>::const_iterator i = bindings.begin();
+         i != bindings.end(); ++i )
     {
-        // Prepare statement
-        const char *sql = "SELECT oid FROM Node WHERE l=?1 AND d=?2";
-        int result = sqlite3_prepare(db, sql, -1, &stmt, NULL);
-        if(result == SQLITE_BUSY)
-            throw "Database is busy!";
-        else
-        if(result != SQLITE_OK)
-        {
-            throw std::string() +
-                "Unable to prepare statement: \"" + sql + "\"!";
-        }
+        std::string::size_type eq = i->find('=');
+        if(eq == std::string::npos)
+            throw std::string("Invalid variable binding \"") + *i + "\"!";
+        std::string var(*i, 0, eq);
+        if(!var.empty() && (var[0] == '?' || var[0] == '$'))
+            var.erase(0, 1);
+
+        const char *term = i->c_str() + eq + 1;
+        if(!Parser(term, term + std::strlen(term)).parse_term(values[var], arena))
+            throw std::string("Invalid term bound to variable \"") + var + "\"!";
+        parameters.insert(var);
     }
-
-    nid_t id = -1;
-    sqlite3_bind_text (stmt, 1, lexical.data(), lexical.size(), SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 2, datatype);
-    int result = sqlite3_step(stmt);
-    if(result == SQLITE_ROW)
-        id = sqlite3_column_int64(stmt, 0);
-    else
-    if(result == SQLITE_BUSY)
-        throw "Database is busy!";
-    else
-    if(result != SQLITE_DONE)
-        throw "Unable to retrieve node identifier!";
-
-    sqlite3_reset(stmt);
-
-    return id;
 }
 
+/* Runs the queries in a batch file and reports their performance. */
+static int run_batch( const char *path, int threads, int repeat,
+                      const std::vector<std::string> &bindings )
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cerr << "Unable to open batch file \"" << path << "\"!" << std::endl;
+        return 1;
+    }
 
-/*
-    Restricties:
-        - minstens 1 verplichte quad vereist
-        - twee gescheiden optionele subgroups mogen geen variabelen delen
-*/
-
-#include "libxml/xmlwriter.h"
-
+    try {
+        Arena arena;
+        std::map<std::string, Node> values;
+        std::set<std::string> parameters;
+        parse_bindings(bindings, values, parameters, arena);
+
+        BatchRunner runner(database_path, threads, repeat, values, parameters);
+        runner.read(file);
+        runner.run();
+        runner.report(std::cout);
+    } catch(const char *str) {
+        std::cerr << str << std::endl;
+        return 1;
+    } catch(const std::string &str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
 static char *argv0;
 
 void usage(bool fatal = true)
 {
-    std::cout << "Usage: " << basename(argv0) << " [-s|--sql] <database> <query>" << std::endl;
+    std::cout << "Usage: " << basename(argv0) << " [-s|--sql]\n"
+                 "\t[-f|--format xml|json|tsv|csv|binary|turtle|ntriples]\n"
+                 "\t[-x|--explain] [-a|--analyze]\n"
+                 "\t[-e|--engine sql|native] [-j|--jobs <threads>]\n"
+                 "\t[-c|--cache <file>] [-C|--cache-size <megabytes>]\n"
+                 "\t[-b|--bind <variable>=<term>]...\n"
+                 "\t[-p|--paginate] [-r|--resume <token>]\n"
+                 "\t[--timeout <seconds>] [--max-steps <n>] [--max-rows <n>]\n"
+                 "\t[--max-memory <megabytes>]\n"
+                 "\t<database> <query>\n"
+                 "   or: " << basename(argv0) << " --batch <file>"
+                 " [-t|--threads <n>] [-n|--repeat <count>]\n"
+                 "\t[-b|--bind <variable>=<term>]... <database>" << std::endl;
     exit(fatal ? 1 : 0);
 }
 
@@ -275,17 +578,92 @@ int main(int argc, char *argv[])
         usage(argc != 1);
 
     // Parse command line options
-    bool output_sql = false;
-    const char *database_path, *query;
+    bool output_sql = false, paginate = false;
+    std::string format, engine = "sql", token;
+    std::vector<std::string> bindings;
+    const char *query = NULL, *cache_path = NULL, *batch = NULL;
+    size_t cache_size = 64;
+    int threads = 1, repeat = 1;
+    double timeout = 0;
+    long long max_steps = 0, max_rows = 0, max_memory = 0;
     argv0 = *(argv++), --argc;
-    if(std::string("-s") == *argv || std::string("--sql") == *argv)
+    while(argc > (batch ? 1 : 2) && **argv == '-')
     {
-        output_sql = true;
-        ++argv, --argc;
+        std::string opt = *(argv++);
+        --argc;
+        if(opt == "-s" || opt == "--sql")
+            output_sql = true;
+        else
+        if(opt == "-x" || opt == "--explain")
+            output_sql = explain = true;
+        else
+        if(opt == "-a" || opt == "--analyze")
+            analyze = true;
+        else
+        if(opt == "-b" || opt == "--bind")
+            bindings.push_back(*(argv++)), --argc;
+        else
+        if(opt == "-p" || opt == "--paginate")
+            paginate = true;
+        else
+        if(opt == "-r" || opt == "--resume")
+            token = *(argv++), --argc, paginate = true;
+        else
+        if(opt == "-f" || opt == "--format")
+            format = *(argv++), --argc;
+        else
+        if(opt == "-e" || opt == "--engine")
+            engine = *(argv++), --argc;
+        else
+        if(opt == "-c" || opt == "--cache")
+            cache_path = *(argv++), --argc;
+        else
+        if(opt == "-C" || opt == "--cache-size")
+            cache_size = std::strtoul(*(argv++), NULL, 10), --argc;
+        else
+        if(opt == "-j" || opt == "--jobs")
+        {
+            jobs = std::atoi(*(argv++)), --argc;
+            if(jobs < 1)
+                usage();
+        }
+        else
+        if(opt == "--timeout")
+            timeout = std::strtod(*(argv++), NULL), --argc;
+        else
+        if(opt == "--max-steps")
+            max_steps = std::strtoll(*(argv++), NULL, 10), --argc;
+        else
+        if(opt == "--max-rows")
+            max_rows = std::strtoll(*(argv++), NULL, 10), --argc;
+        else
+        if(opt == "--max-memory")
+            max_memory = std::strtoll(*(argv++), NULL, 10), --argc;
+        else
+        if(opt == "--batch")
+            batch = *(argv++), --argc;
+        else
+        if(opt == "-t" || opt == "--threads")
+        {
+            threads = std::atoi(*(argv++)), --argc;
+            if(threads < 1)
+                usage();
+        }
+        else
+        if(opt == "-n" || opt == "--repeat")
+        {
+            repeat = std::atoi(*(argv++)), --argc;
+            if(repeat < 1)
+                usage();
+        }
+        else
+            usage();
     }
-    if(argc != 2)
+    if(argc != (batch ? 1 : 2))
         usage();
     database_path = *(argv++), --argc;
+    if(batch)
+        return run_batch(batch, threads, repeat, bindings);
     query         = *(argv++), --argc;
 
     // Initialize sqlite
@@ -295,11 +673,19 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Initialize XML writer
-    xmlTextWriterPtr writer = xmlNewTextWriterFilename("-", 0);
-    if(writer == NULL)
+    // Limit the resources the query may use
+    QueryBudget limits(timeout, max_steps, max_rows, max_memory << 20);
+    budget = &limits;
+    limits.watch(db);
+    limits.start();
+
+    // Initialize result writer; its format may depend on the query form
+    ResultWriter *writer = NULL;
+    if( !output_sql && !format.empty() && !graph_format(format) &&
+        (writer = create_result_writer(format, db)) == NULL )
     {
-        std::cerr << "Unable to create XML text writer!" << std::endl;
+        std::cerr << "Unable to create result writer for format \""
+                  << format << "\"!" << std::endl;
         return 1;
     }
 
@@ -315,147 +701,103 @@ int main(int argc, char *argv[])
     }
     */
 
-    // Write header
-    if(!output_sql)
-    {
-        xmlTextWriterStartDocument(writer, NULL, NULL, "yes");
-        xmlTextWriterStartElement(writer, (xmlChar*)"sparql");
-        xmlTextWriterWriteAttribute( writer, (xmlChar*)"xmlns",
-            (xmlChar*)"http://www.w3.org/2005/sparql-results#" );
-    }
-
     try {
         // Parse query
         Parser p(query, query + std::strlen(query));
-        Query *q = p.parse();
+        std::auto_ptr<Query> q(p.parse());
         if(!p.full())
         {
             throw "Extra characters at end of SPARQL query!";
         }
 
-        // Map to SQL
-        SQLMapper mapper(*q);
-        std::string sql = mapper.sql();
-
-        // Determine types of variables
-        std::vector<bool> is_resource;
-        for( std::vector<std::string>::const_iterator i = q->projection.begin();
-             i != q->projection.end(); ++i )
+        // Determine output format
+        if(format.empty())
+            format = q->form == Query::construct ? "turtle" : "xml";
+        if(graph_format(format) != (q->form == Query::construct))
         {
-            is_resource.push_back(mapper.resource(*i));
+            throw graph_format(format)
+                ? "Only results of CONSTRUCT queries can be written as RDF!"
+                : "Results of CONSTRUCT queries can only be written as RDF!";
         }
-
-        // Prepare generated query
-        sqlite3_stmt *stmt;
-        if(sqlite3_prepare(db, sql.data(), sql.size(), &stmt, NULL) != SQLITE_OK)
+        if(!output_sql && writer == NULL)
         {
-            throw std::string("Unable to prepare generated SQL query: \"")
-                + sql + "\"!";
+            if(q->form == Query::construct)
+            {
+                writer = new ConstructWriter( db, q->construct_template,
+                    create_triple_writer(format, stdout) );
+            }
+            else
+                writer = create_result_writer(format, db);
         }
+        if(writer && limits.limited())
+            writer = new BudgetWriter(writer, limits);
+
+        // Parse bound variables
+        std::map<std::string, Node> values;
+        std::set<std::string> parameters;
+        parse_bindings(bindings, values, parameters, q->arena);
 
-        if(output_sql)
+        // Map to SQL
+        SQLMapper mapper(db, *q, parameters);
+        for(size_t n = 0; n < mapper.warning_text().size(); ++n)
+            std::cerr << "Warning: " << mapper.warning_text()[n] << std::endl;
+
+        if(engine != "native" && engine != "sql")
+            throw std::string("Unknown engine \"") + engine + "\"!";
+
+        if(paginate)
         {
-            std::cout << sql << std::endl;
+            if(q->form != Query::select)
+                throw "Only results of SELECT queries can be paginated!";
+            if(engine == "native")
+                throw "The native engine does not support pagination!";
+            mapper.paginate(*q, token);
         }
+
+        if(paginate && writer)
+            execute_page(*q, mapper, values, *writer);
         else
+        if( cache_path && writer && q->form == Query::select &&
+            q->aggregates.empty() )
         {
-            int result = sqlite3_step(stmt);
-            if(result != SQLITE_DONE && result != SQLITE_ROW)
-            {
-                sqlite3_finalize(stmt);
-                if(result == SQLITE_BUSY)
-                    throw "Database is busy!";
-            }
-
-            // Write header
-            xmlTextWriterStartElement(writer, (xmlChar*)"head");
-            for( std::vector<std::string>::const_iterator i = q->projection.begin();
-                i != q->projection.end(); ++i )
+            // Look up results in cache, or evaluate and store them
+            ResultCache cache( cache_path, cache_size << 20,
+                               ResultCache::generation(db) );
+            std::string key = cache_key(query, bindings);
+            std::vector<nid_t> rows;
+            if(!cache.lookup(key, rows))
             {
-                xmlTextWriterStartElement(writer, (xmlChar*)"variable");
-                xmlTextWriterWriteAttribute( writer,
-                    (xmlChar*)"name", (xmlChar*)i->c_str() );
-                xmlTextWriterEndElement(writer);
-            }
-            xmlTextWriterEndElement(writer);
-    
-            // Write results
-            xmlTextWriterStartElement(writer, (xmlChar*)"results");
-            while(result == SQLITE_ROW)
-            {
-                xmlTextWriterStartElement(writer, (xmlChar*)"result");
-                int col = 0;
-                for(size_t n = 0; n < q->projection.size(); ++n)
-                {
-                    xmlTextWriterStartElement(writer, (xmlChar*)"binding");
-                    xmlTextWriterWriteAttribute( writer,
-                        (xmlChar*)"name", (xmlChar*)(q->projection[n].c_str()) );
-    
-                    const unsigned char *datatype = NULL;
-                    if(!is_resource[n])
-                        datatype = sqlite3_column_text(stmt, col++);
-    
-                    if(datatype)
-                    {
-                        xmlTextWriterStartElement(writer, (xmlChar*)"literal");
-                        if(*datatype)
-                        {
-                            xmlTextWriterWriteAttribute(
-                                writer, (xmlChar*)"datatype", datatype );
-                        }
-                        xmlTextWriterWriteString(
-                            writer, sqlite3_column_text(stmt, col++) );
-                        xmlTextWriterEndElement(writer);
-                    }
-                    else
-                    {
-                        // TODO: support blank nodes in addition to uri's
-                        xmlTextWriterStartElement(writer, (xmlChar*)"uri");
-                        xmlTextWriterWriteString(writer, sqlite3_column_text(stmt, col++));
-                        xmlTextWriterEndElement(writer);
-                    }
-    
-                    xmlTextWriterEndElement(writer);
-                }
-    
-                result = sqlite3_step(stmt);
-                xmlTextWriterEndElement(writer);
+                ResultCollector collector;
+                if(engine == "native")
+                    execute_native(*q, mapper, values, &collector);
+                else
+                    execute_sql(*q, mapper, values, &collector);
+                rows.swap(collector.rows);
+                cache.store(key, rows);
             }
-            xmlTextWriterEndElement(writer);
+            stats.rows = 0;
+            stats.serialize = 0;
+            write_ids(*writer, q->projection, rows);
         }
+        else
+        if(engine == "native")
+            execute_native(*q, mapper, values, writer);
+        else
+            execute_sql(*q, mapper, values, writer);
 
-        // Clean up
-        sqlite3_finalize(stmt);
+        if(analyze && writer)
+            write_statistics();
 
     } catch(const char *str) {
-        if(output_sql)
-        {
-            std::cerr << str;
-        }
-        else
-        {
-            xmlTextWriterStartElement(writer, (xmlChar*)"head");
-            xmlTextWriterStartElement(writer, (xmlChar*)"error");
-            xmlTextWriterWriteCDATA(writer, (xmlChar*)str);
-        }
+        // Errors of interrupted statements are due to the budget
+        report_error( writer, format, output_sql,
+                      limits.exceeded() ? limits.exceeded() : str );
     } catch(const std::string &str) {
-        if(output_sql)
-        {
-            std::cerr << str;
-        }
-        else
-        {
-            xmlTextWriterStartElement(writer, (xmlChar*)"head");
-            xmlTextWriterStartElement(writer, (xmlChar*)"error");
-            xmlTextWriterWriteCDATA(writer, (xmlChar*)str.c_str());
-        }
+        report_error( writer, format, output_sql,
+                      limits.exceeded() ? limits.exceeded() : str.c_str() );
     }
 
-    if(!output_sql)
-    {
-        xmlTextWriterEndDocument(writer);
-        xmlFreeTextWriter(writer);
-    }
+    delete writer;
 
     return 0;
 }
@@ -0,0 +1,1240 @@
+#include <algorithm>
+#include <cstdlib>
+#include "sparql_mapper.h"
+#include "typed_value.h"
+
+static void write_path(std::ostream &os, const Path &path)
+{
+    switch(path.op)
+    {
+    case Path::link:
+        os << '<' << path.iri << '>';
+        break;
+
+    case Path::inverse:
+        os << '^';
+        write_path(os, *path.lhs);
+        break;
+
+    case Path::sequence:
+    case Path::alternative:
+        os << '(';
+        write_path(os, *path.lhs);
+        os << (path.op == Path::sequence ? '/' : '|');
+        write_path(os, *path.rhs);
+        os << ')';
+        break;
+
+    case Path::zero_or_more:
+    case Path::one_or_more:
+    case Path::zero_or_one:
+        write_path(os, *path.lhs);
+        os << (path.op == Path::zero_or_more ? '*' :
+               path.op == Path::one_or_more  ? '+' : '?');
+        break;
+    }
+}
+
+/* Returns an SQL expression for the node identifier of a constant or query
+   parameter, or an empty string for other nodes. */
+std::string SQLMapper::constant(const Node &node)
+{
+    std::ostringstream sql;
+    if(node.type == Node::variable)
+    {
+        if(int k = parameter(node.lexical))
+            sql << '?' << k;
+    }
+    else
+    if(node.type == Node::resource || node.type == Node::literal)
+    {
+        sql << resolve(node);
+    }
+    return sql.str();
+}
+
+/* Generates a query that selects the pairs of nodes (s, o) connected by
+   'path', or by its inverse if 'inverse' is set. If 'start' is not empty, only
+   pairs in which s equals this SQL expression are selected, so that closures
+   are computed from a single node rather than from every node in the graph.
+   Sequences and alternatives keep duplicate pairs, while the closures of the
+   '*' and '+' modifiers are computed by a recursive common table expression
+   with UNION, which discards pairs that were found before, so that evaluation
+   ends on cycles. */
+std::string SQLMapper::path_sql( const Path &path, bool inverse,
+                                 const std::string &start )
+{
+    std::ostringstream sql, zero_length;
+
+    // Pairs of each node with itself, for '*' and '?'
+    if(start.empty())
+    {
+        zero_length << "SELECT n AS s, n AS o FROM"
+                       " (SELECT s AS n FROM Quad UNION SELECT o FROM Quad)";
+    }
+    else
+    {
+        // Nodes that do not occur in the database have no identifier
+        zero_length << "SELECT " << start << " AS s, " << start << " AS o"
+                       " WHERE " << start << ">=0";
+    }
+
+    switch(path.op)
+    {
+    case Path::link:
+        {
+            const char *s = inverse ? "o" : "s", *o = inverse ? "s" : "o";
+            sql << "SELECT " << s << " AS s, " << o << " AS o FROM Quad WHERE p="
+                << nid(path.iri, TYPE_URI);
+            if(!start.empty())
+                sql << " AND " << s << '=' << start;
+        }
+        break;
+
+    case Path::inverse:
+        return path_sql(*path.lhs, !inverse, start);
+
+    case Path::sequence:
+        {
+            const Path &first  = inverse ? *path.rhs : *path.lhs,
+                       &second = inverse ? *path.lhs : *path.rhs;
+            sql << "SELECT a.s AS s, b.o AS o FROM ("
+                << path_sql(first, inverse, start) << ") a JOIN ("
+                << path_sql(second, inverse, "") << ") b ON b.s=a.o";
+        }
+        break;
+
+    case Path::alternative:
+        sql << "SELECT s, o FROM (" << path_sql(*path.lhs, inverse, start)
+            << ") UNION ALL SELECT s, o FROM ("
+            << path_sql(*path.rhs, inverse, start) << ')';
+        break;
+
+    case Path::zero_or_one:
+        sql << zero_length.str() << " UNION SELECT s, o FROM ("
+            << path_sql(*path.lhs, inverse, start) << ')';
+        break;
+
+    case Path::zero_or_more:
+    case Path::one_or_more:
+        {
+            std::ostringstream name;
+            name << 'r' << closures++;
+            const std::string r = name.str();
+
+            sql << "WITH RECURSIVE " << r << "(s, o) AS (";
+            if(path.op == Path::zero_or_more)
+                sql << zero_length.str();
+            else
+                sql << "SELECT s, o FROM (" << path_sql(*path.lhs, inverse, start) << ')';
+            sql << " UNION SELECT " << r << ".s, x.o FROM " << r << " JOIN ("
+                << path_sql(*path.lhs, inverse, "") << ") x ON x.s=" << r << ".o)"
+                   " SELECT s, o FROM " << r;
+        }
+        break;
+    }
+
+    return sql.str();
+}
+
+/* Records that a field of the Quad table 'table' is a constant. */
+void SQLMapper::add_constant(int table, char field, nid_t id)
+{
+    std::map<int, std::string>::iterator i = constants.find(table);
+    if(i != constants.end())
+    {
+        std::ostringstream sql;
+        sql << (i->second.empty() ? " WHERE " : " AND ") << field << '=' << id;
+        i->second += sql.str();
+    }
+}
+
+/* Returns whether the first node in the database that matches the triple
+   pattern binding a variable has a native value, which suggests that the
+   nodes bound to it generally have one. */
+bool SQLMapper::sample_value(const std::string &var)
+{
+    bindings_t::const_iterator j = bindings.find(var);
+    if(j == bindings.end() || !constants.count(j->second.first))
+        return false;
+
+    std::string sql = std::string("SELECT 1 FROM Value WHERE n=(SELECT ") +
+        j->second.second + " FROM Quad" + constants[j->second.first] + " LIMIT 1)";
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+        throw std::string() + "Unable to prepare statement: \"" + sql + "\"!";
+    int result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    return result == SQLITE_ROW;
+}
+
+/* Returns the first table joined on shared variables with 'table'. */
+int SQLMapper::component(int table)
+{
+    int &parent = components[table];
+    if(parent != table)
+        parent = component(parent);
+    return parent;
+}
+
+void SQLMapper::generate_joins(const Pattern &p, bool optional)
+{
+    int constraint = 0;
+    for( Pattern::Quads::const_iterator i = p.mandatory_quads.begin();
+         i != p.mandatory_quads.end(); ++i )
+    {
+        const Quad &q = *i;
+        const int table = tables++;
+        char field[4] = { 'g', 's', 'p', 'o' };
+        bool variables = false;
+        components.push_back(table);
+        os << (optional ? " LEFT JOIN" : " JOIN");
+        if(q.predicate.type == Node::path)
+        {
+            /* Join the pairs of nodes connected by the path, starting from a
+               constant subject, or else from a constant object by following
+               the path in reverse. */
+            std::string start = constant(q.subject);
+            bool inverse = start.empty() && !(start = constant(q.object)).empty();
+            if(inverse)
+                std::swap(field[1], field[3]);
+            os << " (" << path_sql(*q.predicate.property_path, inverse, start)
+               << ") q" << table;
+            std::ostringstream s, o;
+            s << 'q' << table << ".s";
+            o << 'q' << table << ".o";
+            tie_breakers.push_back(s.str());
+            tie_breakers.push_back(o.str());
+        }
+        else
+        {
+            os << " Quad q" << table;
+            constants[table];
+            std::ostringstream rowid;
+            rowid << 'q' << table << ".rowid";
+            tie_breakers.push_back(rowid.str());
+        }
+        std::ostringstream text;
+        text << 'q' << table << (optional ? " (optional):" : ":");
+
+        constraint = 0;
+        for(int f = 0; f < 4; ++f)
+        {
+            const Node &node = q[f];
+            if(node.type == Node::path)
+            {
+                text << ' ';
+                write_path(text, *node.property_path);
+            }
+            else
+            if(node.type == Node::variable)
+            {
+                text << " ?" << node.lexical;
+                if(f != 3 && q.predicate.type != Node::path)
+                    resources.insert(node.lexical);
+
+                parameters_t::const_iterator k = parameters.find(node.lexical);
+                if(k != parameters.end())
+                {
+                    text << "=?" << k->second;
+                    os << (constraint++ == 0 ? " ON" : " AND")
+                        << " q" << table << '.' << field[f] << "=?" << k->second;
+                    continue;
+                }
+
+                if(table == 0 && !optional && partition_var.empty())
+                    partition_var = node.lexical;
+
+                variables = true;
+                bindings_t::const_iterator j = bindings.find(node.lexical);
+                if(j == bindings.end())
+                {
+                    bindings[node.lexical] = std::make_pair(table, field[f]);
+                }
+                else
+                {
+                    os << (constraint++ == 0 ? " ON" : " AND")
+                        << " q" << table << '.' << field[f] << '='
+                        << 'q' << j->second.first << '.' << j->second.second;
+                    int a = component(table), b = component(j->second.first);
+                    components[std::max(a, b)] = std::min(a, b);
+                }
+            }
+            else
+            if(node.type == Node::resource)
+            {
+                nid_t id = nid(node.lexical.c_str(), TYPE_URI);
+                text << " <" << node.lexical << ">=" << id;
+                os << (constraint++ == 0 ? (" ON") : " AND")
+                    << " q" << table << '.' << field[f] << '=' << id;
+                    ++constraint;
+                add_constant(table, field[f], id);
+            }
+            else
+            if(node.type == Node::literal)
+            {
+                nid_t datatype = node.datatype.empty() ? TYPE_LITERAL
+                    : nid(node.datatype.c_str(), TYPE_URI);
+                nid_t id = nid(node.lexical.c_str(), datatype);
+                text << " \"" << node.lexical << '"';
+                if(!node.datatype.empty())
+                    text << "^^<" << node.datatype << '>';
+                text << '=' << id;
+                os << (constraint++ == 0 ? (" ON") : " AND")
+                    << " q" << table << '.' << field[f] << '=' << id;
+                add_constant(table, field[f], id);
+            }
+        }
+        patterns.push_back(text.str());
+        if(!variables)
+            components[table] = -1;
+
+        if(table == 0)
+            first_join = os.str();
+    }
+
+    // Filters of optional patterns restrict the last join
+    if(optional && !p.filters.empty() && p.mandatory_quads.empty())
+        throw "FILTER in OPTIONAL pattern without triple patterns!";
+    for( Pattern::Exprs::const_iterator i = p.filters.begin();
+         i != p.filters.end() && optional; ++i )
+    {
+        os << (constraint++ == 0 ? " ON " : " AND ") << filter_sql(**i, true);
+    }
+
+    for( Pattern::Patterns::const_iterator i = p.optional_patterns.begin();
+         i != p.optional_patterns.end(); ++i )
+    {
+        generate_joins(**i, true);
+    }
+
+    // Other filters restrict the solutions, once all variables are bound
+    for( Pattern::Exprs::const_iterator i = p.filters.begin();
+         i != p.filters.end() && !optional; ++i )
+    {
+        filters += (filters.empty() ? " WHERE " : " AND ") + filter_sql(**i, true);
+    }
+}
+
+std::string SQLMapper::column(const std::string &var) const
+{
+    std::ostringstream col;
+
+    std::map<std::string, std::string>::const_iterator s = substitutions.find(var);
+    if(s != substitutions.end())
+        return s->second;
+
+    aggregates_t::const_iterator a = aggregates.find(var);
+    if(a != aggregates.end())
+        return a->second.value;
+
+    std::map<std::string, std::string>::const_iterator g = groups.find(var);
+    if(g != groups.end())
+        return g->second;
+    if(grouped && parameters.find(var) == parameters.end())
+        throw std::string("Variable \"") + var + "\" must be grouped or aggregated!";
+
+    parameters_t::const_iterator k = parameters.find(var);
+    if(k != parameters.end())
+    {
+        col << '?' << k->second;
+        return col.str();
+    }
+
+    bindings_t::const_iterator j = bindings.find(var);
+    if(j == bindings.end())
+    {
+        throw std::string("Variable \"") + var + "\" not used in graph pattern!";
+    }
+    col << 'q' << j->second.first << '.' << j->second.second;
+    return col.str();
+}
+
+/* Warns about tables that share no variables with the tables before them,
+   so that their solutions are combined as a cartesian product. */
+void SQLMapper::check_joins()
+{
+    int first = -1;
+    for(int table = 0; table < tables; ++table)
+    {
+        if(components[table] != table)
+            continue;   // joined to an earlier table, or without variables
+        if(first < 0)
+        {
+            first = table;
+            continue;
+        }
+        std::ostringstream text;
+        text << "Cartesian product of q" << first << " and q" << table
+             << ", which share no variables!";
+        warnings.push_back(text.str());
+    }
+}
+
+/* Returns SQL for a text key of a number that sorts like the number (to 16
+   significant digits): a sign class, the biased decimal exponent and the
+   digits of the mantissa, both inverted for negative numbers. */
+static std::string number_key(const std::string &number)
+{
+    std::string r = "(1.0 * " + number + ")",
+                s = "printf('%.16e', abs(" + r + "))",
+                exponent = "(CAST(substr(" + s + ", 20) AS INTEGER) + 400)",
+                mantissa = "CAST(substr(" + s + ", 1, 1) || substr(" + s +
+                           ", 3, 16) AS INTEGER)";
+    return "CASE WHEN " + r + " = 0 THEN '2'"
+           " WHEN " + r + " > 1.7976931348623157e308 THEN '4'"
+           " WHEN " + r + " < -1.7976931348623157e308 THEN '0'"
+           " WHEN " + r + " > 0 THEN '3' || printf('%03d', " + exponent +
+           ") || printf('%017d', " + mantissa + ")"
+           " ELSE '1' || printf('%03d', 999 - " + exponent +
+           ") || printf('%017d', 99999999999999999 - " + mantissa + ") END";
+}
+
+/* Generates SQL for an aggregate in the grouping subquery, which is computed
+   on node identifiers where possible, and returns it.
+
+   MIN and MAX order nodes like ORDER BY: nodes without a native value first,
+   then on the class and the native value, and then on lexical values. They
+   are computed on a text key with this order, followed by the identifier of
+   the node, which is what they yield. SUM and AVG only add numeric values.
+   The aggregate is selected as column 'name' of the subquery. */
+std::string SQLMapper::generate_aggregate( const Aggregate &aggregate,
+                                           const std::string &name )
+{
+    static const char * const functions[] = { "COUNT", "SUM", "MIN", "MAX", "AVG" };
+
+    if(aggregates.count(aggregate.alias) || bindings.count(aggregate.alias))
+    {
+        throw std::string("Variable \"") + aggregate.alias +
+            "\" is bound more than once!";
+    }
+
+    Aggregation &a = aggregates[aggregate.alias];
+    a.value = "g." + name;
+    if(aggregate.var.empty())
+    {
+        a.datatype = "'" XSD_INTEGER "'";
+        return "COUNT(*)";
+    }
+
+    std::string function = functions[aggregate.function],
+                distinct = aggregate.distinct ? "DISTINCT " : "",
+                col = column(aggregate.var), number, key;
+    switch(aggregate.function)
+    {
+    case Aggregate::count:
+        a.datatype = "'" XSD_INTEGER "'";
+        return "COUNT(" + distinct + col + ")";
+
+    case Aggregate::sum:
+    case Aggregate::avg:
+        a.datatype = "CASE typeof(" + a.value + ") WHEN 'integer' THEN '"
+                     XSD_INTEGER "' ELSE '" XSD_DECIMAL "' END";
+        if(typed_values)
+        {
+            std::ostringstream sql;
+            sql << "(SELECT v FROM Value WHERE n=" << col << " AND t="
+                << VALUE_NUMERIC << ")";
+            number = sql.str();
+        }
+        else
+        {
+            number = "(SELECT CAST(n.l AS NUMERIC) FROM Node n JOIN Node d ON"
+                     " n.d=d.oid WHERE n.oid=" + col + " AND d.l IN (" +
+                     numeric_datatypes_sql() + "))";
+        }
+        return "COALESCE(" + function + "(" + distinct + number + "), 0)";
+
+    case Aggregate::min:
+    case Aggregate::max:
+    default:
+        if(resource(aggregate.var))
+            resources.insert(aggregate.alias);
+        if(typed_values)
+        {
+            key = "(SELECT CASE WHEN x.t IS NULL THEN '0' ELSE x.t || " +
+                  number_key("x.v") + " END || COALESCE(n.l, '') ||"
+                  " char(1) || printf('%020d', n.oid) FROM Node n LEFT JOIN"
+                  " Value x ON x.n=n.oid WHERE n.oid=" + col + ")";
+        }
+        else
+        {
+            key = "(SELECT COALESCE(l, '') || char(1) || printf('%020d', oid)"
+                  " FROM Node WHERE oid=" + col + ")";
+        }
+        return "CAST(substr(" + function + "(" + key + "), -20) AS INTEGER)";
+    }
+}
+
+/* Returns the class of the native value of an expression, if it is known to
+   have one: for typed constants and arithmetic. Returns 0 otherwise. */
+static int value_type(const Expr &expr)
+{
+    TypedValue value;
+    switch(expr.op)
+    {
+    case Expr::value:
+        if( expr.node->type == Node::literal &&
+            parse_typed_value( expr.node->datatype.c_str(),
+                               expr.node->lexical.c_str(), value ) )
+        {
+            return value.type;
+        }
+        return 0;
+
+    case Expr::mult:
+    case Expr::div:
+    case Expr::plus:
+    case Expr::min:
+    case Expr::neg:
+        return VALUE_NUMERIC;
+
+    default:
+        return 0;
+    }
+}
+
+static std::string quote(const std::string &str)
+{
+    std::string sql = "'";
+    for(std::string::size_type n = 0; n < str.size(); ++n)
+    {
+        if(str[n] == '\'')
+            sql += '\'';
+        sql += str[n];
+    }
+    return sql + '\'';
+}
+
+static bool is_variable(const Expr &expr)
+{
+    return expr.op == Expr::value && expr.node->type == Node::variable;
+}
+
+/* Returns SQL for the native value of an expression, in the given value
+   class (or any class if 'type' is 0), or NULL if it has none. Without a
+   Value table, lexical values are converted to numbers instead. */
+std::string SQLMapper::value_sql(const Expr &expr, int type)
+{
+    static const char * const operators[] = { "*", "/", "+", "-" };
+    std::ostringstream sql;
+    TypedValue value;
+
+    switch(expr.op)
+    {
+    case Expr::value:
+        if(expr.node->type == Node::variable)
+        {
+            if(computed(expr.node->lexical))
+                return column(expr.node->lexical);
+            if(!typed_values)
+            {
+                return "CAST((SELECT l FROM Node WHERE oid=" +
+                    column(expr.node->lexical) + ") AS NUMERIC)";
+            }
+            sql << "(SELECT v FROM Value WHERE n=" << column(expr.node->lexical);
+            if(type != 0)
+                sql << " AND t=" << type;
+            sql << ')';
+            return sql.str();
+        }
+        if( expr.node->type == Node::literal &&
+            parse_typed_value( expr.node->datatype.c_str(),
+                               expr.node->lexical.c_str(), value ) &&
+            (type == 0 || value.type == type) )
+        {
+            return typed_value_sql(value);
+        }
+        return "NULL";
+
+    case Expr::mult:
+    case Expr::plus:
+    case Expr::min:
+        return "(" + value_sql(*expr.lhs, VALUE_NUMERIC) + ' ' +
+            operators[expr.op - Expr::mult] + ' ' +
+            value_sql(*expr.rhs, VALUE_NUMERIC) + ")";
+
+    case Expr::div:
+        // Division of integers yields a decimal
+        return "(1.0 * " + value_sql(*expr.lhs, VALUE_NUMERIC) + " / " +
+            value_sql(*expr.rhs, VALUE_NUMERIC) + ")";
+
+    case Expr::neg:
+        return "(-" + value_sql(*expr.lhs, VALUE_NUMERIC) + ")";
+
+    default:
+        throw "Unsupported operator in numeric expression!";
+    }
+}
+
+/* Returns SQL for the lexical value of a variable or constant. */
+std::string SQLMapper::lexical_sql(const Expr &expr)
+{
+    if(expr.op != Expr::value)
+        throw "Unsupported operator in comparison!";
+    if(expr.node->type == Node::variable)
+        return "(SELECT l FROM Node WHERE oid=" + column(expr.node->lexical) + ")";
+    return quote(expr.node->lexical);
+}
+
+/* Returns SQL for the node identifier of a variable or constant. */
+std::string SQLMapper::node_sql(const Expr &expr)
+{
+    if(expr.op != Expr::value)
+        throw "Unsupported operator in comparison!";
+    if(expr.node->type == Node::variable)
+        return column(expr.node->lexical);
+    return constant(*expr.node);
+}
+
+/* Generates an SQL condition for a FILTER expression. Comparisons of a
+   variable with a typed constant select the matching nodes from the index on
+   the Value table, and other comparisons involving numbers or dates compare
+   native values. Otherwise, (in)equality compares nodes, and the ordering
+   operators compare strings lexically, and variables on their native values
+   if both have one, or else lexically.
+
+   Comparisons of values that can not be compared are NULL, so that they are
+   not true even when negated. As a range scan is false instead, it is only
+   used where the condition is not negated ('positive'). */
+std::string SQLMapper::filter_sql(const Expr &expr, bool positive)
+{
+    static const char * const operators[] = { "=", "!=", ">", ">=", "<", "<=" };
+    static const Expr::Op reversed[] = { Expr::equal, Expr::not_equal,
+        Expr::less, Expr::less_equal, Expr::greater, Expr::greater_equal };
+
+    switch(expr.op)
+    {
+    case Expr::and:
+    case Expr::or:
+        return "(" + filter_sql(*expr.lhs, positive) +
+            (expr.op == Expr::and ? " AND " : " OR ") +
+            filter_sql(*expr.rhs, positive) + ")";
+
+    case Expr::inv:
+        return "(NOT " + filter_sql(*expr.lhs, !positive) + ")";
+
+    case Expr::equal:
+    case Expr::not_equal:
+    case Expr::greater:
+    case Expr::greater_equal:
+    case Expr::less:
+    case Expr::less_equal:
+        break;
+
+    default:
+        throw "Unsupported operator in FILTER expression!";
+    }
+
+    const Expr *lhs = expr.lhs, *rhs = expr.rhs;
+    Expr::Op op = expr.op;
+    int type = value_type(*lhs) ? value_type(*lhs) : value_type(*rhs);
+    if(type != 0)
+    {
+        if(is_variable(*rhs))
+        {
+            std::swap(lhs, rhs);
+            op = reversed[op - Expr::equal];
+        }
+        if( positive && typed_values && is_variable(*lhs) &&
+            !computed(lhs->node->lexical) && rhs->op == Expr::value )
+        {
+            /* Range scan on the index of native values. The identifiers
+               are selected without affinity (as Quad columns have none), so
+               that they can be looked up in the indexes on Quad. */
+            std::ostringstream sql;
+            sql << column(lhs->node->lexical) << " IN (SELECT +n FROM Value WHERE t="
+                << type << " AND v" << operators[op - Expr::equal]
+                << value_sql(*rhs, type) << ')';
+            return sql.str();
+        }
+        return value_sql(*lhs, type) + operators[op - Expr::equal] +
+            value_sql(*rhs, type);
+    }
+
+    if(op == Expr::equal || op == Expr::not_equal)
+        return node_sql(*lhs) + operators[op - Expr::equal] + node_sql(*rhs);
+
+    std::string lexical = lexical_sql(*lhs) + operators[op - Expr::equal] +
+        lexical_sql(*rhs);
+    if(!is_variable(*lhs) || !is_variable(*rhs) || !typed_values)
+        return lexical;
+
+    // Values of different classes, or of one node only, are not comparable
+    return "COALESCE((SELECT CASE WHEN a.t=b.t THEN a.v" +
+        std::string(operators[op - Expr::equal]) + "b.v END"
+        " FROM Value a, Value b WHERE a.n=" + column(lhs->node->lexical) +
+        " AND b.n=" + column(rhs->node->lexical) + "), CASE WHEN " +
+        value_sql(*lhs, 0) + " IS NULL AND " + value_sql(*rhs, 0) +
+        " IS NULL THEN " + lexical + " END)";
+}
+
+bool SQLMapper::resource(const std::string &var) const
+{
+    return resources.find(var) != resources.end();
+}
+
+bool SQLMapper::computed(const std::string &var) const
+{
+    aggregates_t::const_iterator a = aggregates.find(var);
+    return a != aggregates.end() && !a->second.datatype.empty();
+}
+
+int SQLMapper::parameter(const std::string &var) const
+{
+    parameters_t::const_iterator k = parameters.find(var);
+    return k == parameters.end() ? 0 : k->second;
+}
+
+SQLMapper::SQLMapper( sqlite3 *db, const Query &query,
+                      const std::set<std::string> &parameters )
+    : db(db), find_node(NULL), closures(0), typed_values(has_value_table(db)),
+      grouped(false), limit(query.limit), offset(query.offset),
+      distinct(query.distinct), cursor_size(0)
+{
+    // Number parameters
+    for( std::set<std::string>::const_iterator i = parameters.begin();
+         i != parameters.end(); ++i )
+    {
+        int index = this->parameters.size() + 1;
+        this->parameters[*i] = index;
+    }
+
+    // Generate joins
+    tables = 0;
+    generate_joins(*query.pattern, false);
+    check_joins();
+    joins = os.str();
+    os.str(std::string());
+
+    select = query.distinct ? "SELECT DISTINCT" : "SELECT";
+
+    if(!query.aggregates.empty() || !query.group_by.empty())
+    {
+        /* Evaluate groups and aggregates in a subquery, so their node
+           identifiers can be decoded by the enclosing query. */
+        std::ostringstream inner, name;
+        inner << "SELECT";
+        for(size_t n = 0; n < query.group_by.size(); ++n)
+        {
+            const std::string &var = query.group_by[n];
+            name.str(std::string());
+            name << 'k' << n;
+            inner << (n == 0 ? " " : ", ") << column(var) << " AS " << name.str();
+            group += (n == 0 ? " GROUP BY " : ", ") + column(var);
+            groups[var] = "g." + name.str();
+        }
+        for(size_t n = 0; n < query.aggregates.size(); ++n)
+        {
+            name.str(std::string());
+            name << 'a' << n;
+            inner << (n == 0 && query.group_by.empty() ? " " : ", ")
+                  << generate_aggregate(query.aggregates[n], name.str())
+                  << " AS " << name.str();
+        }
+        inner << " FROM (SELECT NULL)" << joins << filters << group;
+        from = "(" + inner.str() + ") g";
+        filters.clear();
+        grouped = true;
+
+        // Groups can not be evaluated in partitions
+        partition_var.clear();
+    }
+    else
+    {
+        from = "(SELECT NULL)" + joins;
+    }
+
+    /* Generate projection, both on the joined tables and on the columns
+       of the sorted subquery (see sorted_sql()). */
+    for( std::vector<std::string>::const_iterator i = query.projection.begin();
+         i != query.projection.end(); ++i )
+    {
+        if(computed(*i))
+        {
+            // Select datatype URI and value of computed aggregate
+            const Aggregation &a = aggregates[*i];
+            values += ' ' + a.datatype + ", " + a.value + ',';
+            ids    += ' ' + a.datatype + ", " + a.value + ',';
+            std::string datatype = sorted_column(a.datatype),
+                        value    = sorted_column(a.value);
+            sorted_values += ' ' + datatype + ", " + value + ',';
+            sorted_ids    += ' ' + datatype + ", " + value + ',';
+            continue;
+        }
+
+        std::string id = sorted_column(column(*i));
+        if(resources.find(*i) == resources.end())
+        {
+            // Select datatype as well
+            values += " (SELECT d.l FROM Node n JOIN Node d ON n.d = d.oid"
+                      " WHERE n.oid=" + column(*i) + "),";
+            sorted_values += " (SELECT d.l FROM Node n JOIN Node d ON"
+                             " n.d = d.oid WHERE n.oid=" + id + "),";
+        }
+
+        values += " (SELECT l FROM Node WHERE oid=" + column(*i) + "),";
+        ids += ' ' + column(*i) + ',';
+        sorted_values += " (SELECT l FROM Node WHERE oid=" + id + "),";
+        sorted_ids += ' ' + id + ',';
+    }
+
+    // Solution modifier: ORDER BY
+    for( Query::OrderConds::const_iterator i = query.order.begin();
+         i != query.order.end(); ++i )
+    {
+        const Expr &expr = *(*i)->expr;
+        size_t keys = order.size();
+        if( order.empty() && limit >= 0 && typed_values && !grouped &&
+            !distinct && is_variable(expr) && sample_value(expr.node->lexical) )
+        {
+            seek_column = column(expr.node->lexical);
+        }
+        order_keys(expr, keys == 0 && !seek_column.empty(), order, order_numeric);
+        if(order.size() == keys)
+            throw "Unsupported ORDER BY expression!";
+        order_desc.resize(order.size(), (*i)->desc);
+    }
+}
+
+/* Generates the keys for an ORDER BY expression. Variables are ordered on
+   their native values (where nodes without one sort first) and then on
+   lexical values. If the first variable is sorted on the index on Value
+   ('seek'), it is ordered on the class of its values first, like the index. */
+void SQLMapper::order_keys( const Expr &expr, bool seek,
+                            std::vector<std::string> &keys,
+                            std::vector<bool> &numeric )
+{
+    if(seek)
+    {
+        keys.push_back(" (SELECT t FROM Value WHERE n=" +
+                       column(expr.node->lexical) + ")");
+        numeric.push_back(true);
+    }
+    if( value_type(expr) != 0 || (is_variable(expr) &&
+        (typed_values || computed(expr.node->lexical))) )
+    {
+        keys.push_back(' ' + value_sql(expr, value_type(expr)));
+        numeric.push_back(true);
+    }
+    if(is_variable(expr) && !computed(expr.node->lexical))
+    {
+        keys.push_back(' ' + lexical_sql(expr));
+        numeric.push_back(false);
+    }
+}
+
+/* Appends the variables that occur in an expression to 'vars'. */
+static void expression_variables(const Expr &expr, std::vector<std::string> &vars)
+{
+    if(expr.op == Expr::value)
+    {
+        if( expr.node->type == Node::variable &&
+            std::find(vars.begin(), vars.end(), expr.node->lexical) == vars.end() )
+        {
+            vars.push_back(expr.node->lexical);
+        }
+        return;
+    }
+    if(expr.lhs)
+        expression_variables(*expr.lhs, vars);
+    if(expr.rhs)
+        expression_variables(*expr.rhs, vars);
+}
+
+/* Returns a hash of the ordering and projection of the query, which tokens
+   include so that they are not used to continue a different query. */
+unsigned long SQLMapper::page_hash() const
+{
+    std::string text = values;
+    for(size_t n = 0; n < order.size(); ++n)
+        text += order[n] + (order_desc[n] ? " DESC," : ",");
+
+    // FNV-1a
+    unsigned long hash = 2166136261ul;
+    for(size_t n = 0; n < text.size(); ++n)
+        hash = ((hash ^ (unsigned char)text[n]) * 16777619ul) & 0xfffffffful;
+    return hash;
+}
+
+void SQLMapper::paginate(const Query &query, const std::string &token)
+{
+    if(limit < 0)
+        throw "Pagination requires a LIMIT!";
+    if(grouped)
+        throw "Grouped results can not be paginated!";
+
+    /* Solutions are ordered on the ORDER BY keys and then on the rows of the
+       tables joined, or on the projected variables if there are no
+       duplicates, so that every solution has a unique position. */
+    for(size_t n = 0; n < query.order.size(); ++n)
+        expression_variables(*query.order[n]->expr, cursor_vars);
+    std::vector<std::string> ties;
+    if(distinct)
+    {
+        for(size_t n = 0; n < cursor_vars.size(); ++n)
+        {
+            if( std::find( query.projection.begin(), query.projection.end(),
+                           cursor_vars[n] ) == query.projection.end() )
+            {
+                throw "Only projected variables can be ordered on in "
+                      "paginated DISTINCT queries!";
+            }
+        }
+        for(size_t n = 0; n < query.projection.size(); ++n)
+            ties.push_back(column(query.projection[n]));
+    }
+    else
+        ties = tie_breakers;
+    for(size_t n = 0; n < ties.size(); ++n)
+    {
+        order.push_back(' ' + ties[n]);
+        order_desc.push_back(false);
+        order_numeric.push_back(true);
+    }
+    unsigned long hash = page_hash();
+
+    // Select the identifiers of the ORDER BY variables and the tie breakers
+    std::vector<std::string> cursor = ties;
+    for(size_t n = cursor_vars.size(); n-- > 0; )
+        cursor.insert(cursor.begin(), column(cursor_vars[n]));
+    for(size_t n = 0; n < cursor.size(); ++n)
+    {
+        ids += ' ' + cursor[n] + ',';
+        sorted_ids += ' ' + sorted_column(cursor[n]) + ',';
+    }
+    cursor_size = cursor.size();
+    if(token.empty())
+        return;
+
+    // Decode token
+    std::vector<std::string> values;
+    char *end;
+    unsigned long token_hash = std::strtoul(token.c_str(), &end, 16);
+    while(*end == '.')
+    {
+        const char *begin = end + 1;
+        long long id = std::strtoll(begin, &end, 16);
+        if(end == begin)
+            values.push_back("NULL");
+        else
+        {
+            std::ostringstream value;
+            value << id;
+            values.push_back(value.str());
+        }
+    }
+    if(*end != '\0' || token_hash != hash || values.size() != cursor.size())
+        throw "Invalid continuation token!";
+
+    /* Generate the keys of the last solution of the previous page, by
+       substituting the identifiers in the token for the variables. */
+    std::vector<std::string> last;
+    std::vector<bool> numeric;
+    for(size_t n = 0; n < cursor_vars.size(); ++n)
+        substitutions[cursor_vars[n]] = values[n];
+    for(size_t n = 0; n < query.order.size(); ++n)
+        order_keys(*query.order[n]->expr, n == 0 && !seek_column.empty(), last, numeric);
+    substitutions.clear();
+    last.insert(last.end(), values.begin() + cursor_vars.size(), values.end());
+
+    /* Select only solutions that follow it: for some key, the keys before it
+       are equal and the key itself comes after it (where NULL comes first). */
+    std::string condition;
+    for(size_t n = 0; n < order.size(); ++n)
+    {
+        std::string k = order[n].substr(1), c = last[n];
+        condition += n == 0 ? "((" : " OR (";
+        for(size_t m = 0; m < n; ++m)
+            condition += order[m].substr(1) + " IS " + last[m] + " AND ";
+        condition += order_desc[n]
+            ? "(" + k + '<' + c + " OR (" + k + " IS NULL AND " + c + " IS NOT NULL)))"
+            : "(" + k + '>' + c + " OR (" + k + " IS NOT NULL AND " + c + " IS NULL)))";
+    }
+    this->cursor = condition + ')';
+
+    /* Solutions with native values, which are generated in the order of the
+       index on Value, start at the keys of the last solution, unless it had
+       no native value (which come first). */
+    if(!seek_column.empty())
+    {
+        std::string bound = "(x.t, x.v)" + std::string(order_desc[0] ? "<=" : ">=") +
+            "(" + last[0] + ", " + last[1] + ")";
+        seek_cursor = order_desc[0] ? last[0] + " IS NOT NULL AND " + bound
+                                    : "(" + last[0] + " IS NULL OR " + bound + ")";
+    }
+    offset = -1;
+}
+
+SQLMapper::~SQLMapper()
+{
+    sqlite3_finalize(find_node);
+}
+
+/* Adds an expression to the columns of the sorted subquery, and returns
+   the column of the enclosing query that selects it. */
+std::string SQLMapper::sorted_column(const std::string &expr)
+{
+    std::ostringstream col;
+    col << "t.c" << sorted_columns.size();
+    sorted_columns.push_back(expr);
+    return col.str();
+}
+
+/* Generates a subquery that selects the projected node identifiers (as c0,
+   c1, etc.) and the ORDER BY keys (as k0, k1, etc.) of the first 'rows'
+   solutions from 'tables', for which SQLite keeps no more than 'rows' rows
+   in its sorter.
+
+   If 'seek' is set, only the solutions in which the first ORDER BY variable
+   has a native value are selected, by joining the Value table first, so that
+   the solutions are generated in the order of its index and evaluation ends
+   after the first rows. Otherwise, if there is such a variable, only the
+   solutions in which it has no native value are selected. */
+std::string SQLMapper::sorted_sql( const std::string &tables,
+                                   const std::string &where, bool seek,
+                                   long long rows ) const
+{
+    std::ostringstream sql;
+    sql << "SELECT";
+    for(size_t n = 0; n < sorted_columns.size(); ++n)
+        sql << (n == 0 ? " " : ", ") << sorted_columns[n] << " AS c" << n;
+    for(size_t n = 0; n < order.size(); ++n)
+    {
+        sql << (n == 0 && sorted_columns.empty() ? " " : ", ");
+        if(!seek_column.empty() && n < 2)
+            sql << (!seek ? "NULL" : n == 0 ? "x.t" : "x.v");
+        else
+            sql << order[n].substr(1);
+        sql << " AS k" << n;
+    }
+    sql << " FROM " << tables << filters;
+
+    std::string condition = where;
+    if(!seek_column.empty())
+    {
+        condition += condition.empty() ? "" : " AND ";
+        if(seek)
+            condition += seek_column + "=+x.n" +
+                (seek_cursor.empty() ? "" : " AND " + seek_cursor);
+        else
+            condition += "NOT EXISTS (SELECT 1 FROM Value WHERE n=" + seek_column + ")";
+    }
+    if(!condition.empty())
+        sql << (filters.empty() ? " WHERE " : " AND ") << condition;
+
+    for(size_t n = 0; n < order.size(); ++n)
+        sql << (n == 0 ? " ORDER BY k" : ", k") << n << (order_desc[n] ? " DESC" : "");
+    sql << " LIMIT " << rows;
+    return sql.str();
+}
+
+/* Generates the query for sql() (or id_sql() if 'ids' is set), selecting
+   the ORDER BY keys as well if 'keys' is set. */
+std::string SQLMapper::compose( bool ids, bool keys, const std::string &condition,
+                                long long limit, long long offset ) const
+{
+    std::string where = cursor.empty() ? condition
+                      : condition.empty() ? cursor : condition + " AND " + cursor;
+    std::ostringstream sql;
+    if(limit >= 0 && !order.empty() && !distinct)
+    {
+        /* Sort node identifiers in a subquery, and decode the selected rows
+           only. Solutions with native values of the first ORDER BY variable
+           are sorted apart from the others (which sort first), so that the
+           subquery that comes first ends evaluation if it has enough rows. */
+        long long rows = offset > 0 ? limit + offset : limit;
+        std::string sorted = sorted_sql(from, where, false, rows);
+        if(!seek_column.empty())
+        {
+            std::string seek = sorted_sql("Value x CROSS JOIN " + from, where, true, rows);
+            std::ostringstream compound;
+            compound << "SELECT * FROM (" << (order_desc[0] ? seek : sorted)
+                     << ") UNION ALL SELECT * FROM ("
+                     << (order_desc[0] ? sorted : seek) << ") LIMIT " << rows;
+            sorted = compound.str();
+        }
+        sql << "SELECT" << (ids ? sorted_ids : sorted_values);
+        for(size_t n = 0; n < order.size() && keys; ++n)
+            sql << " t.k" << n << ',';
+        sql << " NULL FROM (" << sorted << ") t";
+        for(size_t n = 0; n < order.size(); ++n)
+            sql << (n == 0 ? " ORDER BY t.k" : ", t.k") << n << (order_desc[n] ? " DESC" : "");
+    }
+    else
+    {
+        std::string projection = ids ? this->ids : values;
+        for(size_t n = 0; n < order.size() && keys; ++n)
+            projection += order[n] + ',';
+
+        sql << select << projection << " NULL FROM " << from << filters;
+        if(!where.empty())
+            sql << (filters.empty() ? " WHERE " : " AND ") << where;
+
+        // Solution modifier: ORDER BY
+        for(size_t n = 0; n < order.size(); ++n)
+        {
+            sql << (n == 0 ? " ORDER BY" : ",") << order[n];
+            if(order_desc[n])
+                sql << " DESC";
+        }
+    }
+
+    // Solution modifier: LIMIT
+    if(limit >= 0)
+        sql << " LIMIT " << limit;
+
+    // Solution modifier: OFFSET
+    if(offset >= 0)
+        sql << (limit >= 0 ? " OFFSET " : " LIMIT -1 OFFSET ") << offset;
+
+    return sql.str();
+}
+
+std::string SQLMapper::sql() const
+{
+    return compose(false, false, "", limit, offset);
+}
+
+std::string SQLMapper::id_sql() const
+{
+    return compose(true, false, "", limit, offset);
+}
+
+const std::string &SQLMapper::partition_variable() const
+{
+    return partition_var;
+}
+
+std::string SQLMapper::partition_column() const
+{
+    return partition_var.empty() ? std::string() : column(partition_var);
+}
+
+std::string SQLMapper::range_sql() const
+{
+    std::string col = partition_column();
+    return "SELECT MIN(" + col + "), MAX(" + col + ") FROM (SELECT NULL)"
+        + first_join;
+}
+
+std::string SQLMapper::partition_sql(bool ids) const
+{
+    std::ostringstream where;
+    where << partition_column() << " BETWEEN ?"
+          << parameters.size() + 1 << " AND ?" << parameters.size() + 2;
+
+    long long rows = limit;
+    if(limit >= 0 && offset > 0)
+        rows += offset;
+    return compose(ids, true, where.str(), rows, -1);
+}
+
+const std::vector<std::string> &SQLMapper::pattern_text() const
+{
+    return patterns;
+}
+
+const std::vector<std::string> &SQLMapper::warning_text() const
+{
+    return warnings;
+}
+
+bool SQLMapper::numeric(size_t key) const
+{
+    return order_numeric[key];
+}
+
+size_t SQLMapper::order_keys() const
+{
+    return order.size();
+}
+
+bool SQLMapper::descending(size_t key) const
+{
+    return order_desc[key];
+}
+
+size_t SQLMapper::cursor_columns() const
+{
+    return cursor_size;
+}
+
+/* Encodes a cursor as the hash of the query followed by the identifiers, in
+   hexadecimal and separated by dots (with nothing for NULL, passed as -1). */
+std::string SQLMapper::continuation(const std::vector<long long> &cursor) const
+{
+    std::ostringstream token;
+    token << std::hex << page_hash();
+    for(size_t n = 0; n < cursor.size(); ++n)
+    {
+        token << '.';
+        if(cursor[n] >= 0)
+            token << cursor[n];
+    }
+    return token.str();
+}
+
+nid_t SQLMapper::nid(const std::string &lexical, nid_t datatype)
+{
+    if(!find_node)
+    {
+        // Prepare statement
+        const char *sql = "SELECT oid FROM Node WHERE l=?1 AND d=?2";
+        int result = sqlite3_prepare(db, sql, -1, &find_node, NULL);
+        if(result == SQLITE_BUSY)
+            throw "Database is busy!";
+        else
+        if(result != SQLITE_OK)
+        {
+            throw std::string() +
+                "Unable to prepare statement: \"" + sql + "\"!";
+        }
+    }
+
+    nid_t id = -1;
+    sqlite3_bind_text (find_node, 1, lexical.data(), lexical.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(find_node, 2, datatype);
+    int result = sqlite3_step(find_node);
+    if(result == SQLITE_ROW)
+        id = sqlite3_column_int64(find_node, 0);
+    else
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    else
+    if(result != SQLITE_DONE)
+        throw "Unable to retrieve node identifier!";
+
+    sqlite3_reset(find_node);
+
+    return id;
+}
+
+nid_t SQLMapper::resolve(const Node &value)
+{
+    nid_t datatype;
+    if(value.type == Node::resource)
+        datatype = TYPE_URI;
+    else
+    if(value.type == Node::literal)
+        datatype = value.datatype.empty() ? TYPE_LITERAL
+            : nid(value.datatype, TYPE_URI);
+    else
+        throw "Query parameters must be bound to an IRI or a literal!";
+
+    return nid(value.lexical, datatype);
+}
+
+void SQLMapper::bind(sqlite3_stmt *stmt, const std::string &var, const Node &value)
+{
+    int index = parameter(var);
+    if(index == 0)
+    {
+        throw std::string("Variable \"") + var + "\" is not a query parameter!";
+    }
+
+    // Unknown nodes are bound to -1, which never matches any quad.
+    sqlite3_bind_int64(stmt, index, resolve(value));
+}
@@ -0,0 +1,200 @@
+#ifndef SPARQL_MAPPER_H_INCLUDED
+#define SPARQL_MAPPER_H_INCLUDED
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "sparql_parser.h"
+
+typedef long long int nid_t;
+
+/* Built-in datatypes */
+#define TYPE_URI        (0ll)
+#define TYPE_LITERAL    (1ll)
+#define TYPE_BOOLEAN    (2ll)
+#define TYPE_INTEGER    (3ll)
+#define TYPE_DATE_TIME  (4ll)
+#define TYPE_FLOAT      (5ll)
+#define TYPE_DOUBLE     (6ll)
+
+#define XSD_INTEGER     "http://www.w3.org/2001/XMLSchema#integer"
+#define XSD_DECIMAL     "http://www.w3.org/2001/XMLSchema#decimal"
+
+/*
+Maps a parsed SPARQL query to an SQL statement on the Quad and Node tables.
+
+Variables named in 'parameters' are not bound by the graph pattern, but are
+compiled to SQL parameters (?1, ?2, etc.) instead. Their values must be set
+with bind() after the statement has been prepared. Since the values do not
+occur in the generated SQL, a prepared statement can be reset and bound again
+to execute the same query with different values.
+
+sql() returns a query that selects the lexical value of each projected
+variable, preceded by its datatype if the variable may be bound to a literal.
+id_sql() returns an equivalent query that selects only the node identifiers of
+the projected variables (or NULL for unbound variables).
+
+To evaluate a query in parts, the results can be partitioned on the node
+identifier of the first variable in the first triple pattern, which is
+returned by partition_variable() (or empty if there is no such variable).
+range_sql() returns a query for the smallest and largest identifier in this
+column, and partition_sql() returns a variant of sql() or id_sql() that
+selects only rows with identifiers between two additional parameters (which
+follow the query parameters). These queries select the ORDER BY keys after
+the projected variables, and apply LIMIT (including OFFSET rows) but not
+OFFSET itself, so that the partial results can be merged by the caller.
+
+Aggregates are evaluated by SQL in a subquery that groups on node
+identifiers; only the resulting group keys are decoded. COUNT, SUM and
+AVG compute values that are not nodes in the database; computed() returns
+true for variables bound to such values, for which both sql() and id_sql()
+select the datatype URI and the value, so these have no node identifier.
+MIN and MAX yield (the identifier of) one of the aggregated nodes.
+
+Property paths are joined as subqueries that select the pairs of nodes they
+connect (see path_sql()). Closures are computed by recursive queries in a
+single statement; if the subject or object of the path is a constant, the
+recursion starts from that node only.
+
+FILTER conditions compare native values of numbers and dates, which import
+keeps in the Value table (see typed_value.h). A comparison of a variable with
+a constant number or date selects the matching nodes through the index on
+this table. ORDER BY sorts variables on the class and the value of their
+native values first, so the ORDER BY keys are numeric (see numeric()) or
+lexical values.
+
+With both ORDER BY and LIMIT, the solutions are sorted in a subquery that
+selects only node identifiers and ORDER BY keys, so that SQLite keeps the
+first rows in a bounded sorter and only these rows are decoded. If the first
+ORDER BY key is a variable that is bound to nodes with native values, the
+solutions in which it has a native value are selected in the order of the
+index on the Value table, so that evaluation stops after the first rows (see
+sorted_sql()).
+
+To page through the results of a query with LIMIT, paginate() orders the
+solutions completely and selects the columns of a cursor after the projected
+variables (in id_sql() only): the node identifiers of the variables in the
+ORDER BY expressions, and the row identifiers of the tables joined (or the
+projected variables of DISTINCT queries). continuation() encodes the cursor
+of the last solution as a token, and paginate() with this token selects only
+the solutions that follow it, with a condition on the ORDER BY keys rather
+than an OFFSET, so that each page takes about as long to evaluate.
+
+pattern_text() describes the triple pattern joined as each table (q0, q1,
+etc.), with the node identifiers that constants were resolved to (or -1 for
+constants that do not occur in the database).
+warning_text() describes problems found while mapping the query, such as
+triple patterns that share no variables with the others: their solutions
+are combined as a cartesian product, which is rarely intended and can take
+very long to evaluate.
+*/
+class SQLMapper
+{
+    typedef std::map<std::pair<std::string, nid_t>, nid_t> nodes_t;
+    typedef std::map<std::string, std::pair<int, char> > bindings_t;
+    typedef std::map<std::string, int> parameters_t;
+
+    struct Aggregation
+    {
+        std::string value;      // SQL expression
+        std::string datatype;   // SQL expression for the datatype URI of a
+                                // computed value; empty for node identifiers
+    };
+    typedef std::map<std::string, Aggregation> aggregates_t;
+
+    sqlite3 *db;
+    sqlite3_stmt *find_node;
+    std::ostringstream os;
+    int tables, closures;
+    bool typed_values;
+    bindings_t bindings;
+    parameters_t parameters;
+    std::set<std::string> resources;
+    aggregates_t aggregates;
+    std::map<std::string, std::string> groups;
+    bool grouped;
+    std::string partition_var;
+    std::map<int, std::string> constants;
+
+    // Parts of the generated query
+    std::string select, values, ids, joins, first_join, filters, group, from;
+    std::vector<std::string> order;
+    std::vector<bool> order_desc, order_numeric;
+    long long limit, offset;
+    bool distinct;
+
+    // Parts of the query for ORDER BY with LIMIT
+    std::vector<std::string> sorted_columns;
+    std::string sorted_values, sorted_ids, seek_column;
+
+    // Pagination (see paginate())
+    std::vector<std::string> tie_breakers, cursor_vars;
+    std::map<std::string, std::string> substitutions;
+    std::string cursor, seek_cursor;
+    size_t cursor_size;
+    std::vector<std::string> patterns, warnings;
+
+    // Tables joined on shared variables, as a union-find forest (-1 for
+    // tables without variables)
+    std::vector<int> components;
+
+    std::string constant(const Node &node);
+    std::string path_sql( const Path &path, bool inverse,
+                          const std::string &start );
+    void add_constant(int table, char field, nid_t id);
+    bool sample_value(const std::string &var);
+    int component(int table);
+    void generate_joins(const Pattern &p, bool optional);
+    void check_joins();
+    std::string generate_aggregate( const Aggregate &aggregate,
+                                    const std::string &name );
+    void order_keys( const Expr &expr, bool seek, std::vector<std::string> &keys,
+                     std::vector<bool> &numeric );
+    unsigned long page_hash() const;
+    std::string value_sql(const Expr &expr, int type);
+    std::string lexical_sql(const Expr &expr);
+    std::string node_sql(const Expr &expr);
+    std::string filter_sql(const Expr &expr, bool positive);
+    std::string column(const std::string &var) const;
+    std::string partition_column() const;
+    std::string sorted_column(const std::string &expr);
+    std::string sorted_sql( const std::string &tables, const std::string &where,
+                            bool seek, long long rows ) const;
+    std::string compose( bool ids, bool keys, const std::string &where,
+                         long long limit, long long offset ) const;
+
+public:
+    SQLMapper( sqlite3 *db, const Query &query,
+               const std::set<std::string> &parameters =
+                    std::set<std::string>() );
+    ~SQLMapper();
+
+    bool resource(const std::string &var) const;
+    bool computed(const std::string &var) const;
+    int parameter(const std::string &var) const;
+    std::string sql() const;
+    std::string id_sql() const;
+
+    const std::string &partition_variable() const;
+    std::string range_sql() const;
+    std::string partition_sql(bool ids) const;
+    const std::vector<std::string> &pattern_text() const;
+    const std::vector<std::string> &warning_text() const;
+    size_t order_keys() const;
+    bool descending(size_t key) const;
+    bool numeric(size_t key) const;
+
+    void paginate(const Query &query, const std::string &token);
+    size_t cursor_columns() const;
+    std::string continuation(const std::vector<long long> &cursor) const;
+
+    nid_t nid(const std::string &lexical, nid_t datatype);
+    nid_t resolve(const Node &value);
+    void bind(sqlite3_stmt *stmt, const std::string &var, const Node &value);
+};
+
+#endif /* ndef SPARQL_MAPPER_H_INCLUDED */
@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <iterator>
 #include <memory>
 #include "sparql_parser.h"
+#include "typed_value.h"
+
+static const char xsd_integer[] = "http://www.w3.org/2001/XMLSchema#integer",
+                  xsd_decimal[] = "http://www.w3.org/2001/XMLSchema#decimal";
 
 void Parser::accumulate_variables(const Pattern &p, std::set<std::string> &vars)
 {
-    for( std::vector<Quad>::const_iterator i = p.mandatory_quads.begin();
+    for( Pattern::Quads::const_iterator i = p.mandatory_quads.begin();
          i != p.mandatory_quads.end(); ++i )
     {
         for(int f = 0; f < 4; ++f)
@@ -14,7 +20,7 @@ void Parser::accumulate_variables(const Pattern &p, std::set<std::string> &vars)
         }
     }
 
-    for( std::vector<Pattern*>::const_iterator i = p.optional_patterns.begin();
+    for( Pattern::Patterns::const_iterator i = p.optional_patterns.begin();
          i != p.optional_patterns.end(); ++i )
     {
         accumulate_variables(**i, vars);
@@ -23,7 +29,7 @@ void Parser::accumulate_variables(const Pattern &p, std::set<std::string> &vars)
 
 
 Parser::Parser(const char *begin, const char *end)
-    : tok(begin, end)
+    : tok(begin, end), arena(NULL)
 {
 }
 
@@ -61,7 +67,7 @@ bool Parser::accept_keyword(const char *keyword)
     return false;
 }
 
-bool Parser::parse_iri(std::string &str)
+bool Parser::parse_iri(Symbol &iri)
 {
     if(tok.type() == Tokenizer::relative_iri)
     {
@@ -75,14 +81,15 @@ bool Parser::parse_iri(std::string &str)
             throw std::string("Undeclared namespace prefix \"")
                 + std::string(tok.begin(), cur) + "\" used!";
         }
-        str = i->second;
-        str.append(cur + 1, tok.end());
+        buffer = i->second;
+        buffer.append(cur + 1, tok.end());
+        iri = arena->intern(buffer);
     }
     else
     if(tok.type() == Tokenizer::absolute_iri)
     {
         // FIXME: escaping?
-        str.assign(tok.begin() + 1, tok.end() - 1);
+        iri = arena->intern(tok.begin() + 1, tok.size() - 2);
     }
     else
     {
@@ -102,22 +109,25 @@ bool Parser::parse_node(Node &node)
         if(!parse_iri(node.lexical))
             return false;
         node.type = Node::resource;
-        node.datatype.clear();
+        node.datatype = Symbol();
         return true;
 
+    case Tokenizer::integer:
+        return parse_number(node);
+
     case Tokenizer::literal:
         {
             // FIXME: escaping
-            // FIXME: support for plain integers etc.
             node.type = Node::literal;
-            node.lexical.assign(tok.begin() + 1, tok.end() - 1);
-            node.datatype.clear();
+            node.lexical = arena->intern(tok.begin() + 1, tok.size() - 2);
+            node.datatype = Symbol();
             tok.advance();
 
             if(accept(Tokenizer::operator_datatype))
             {
                 if(!parse_iri(node.datatype))
                     syntax_error("datatype IRI expected after '^^' token");
+                canonicalize(node);
             }
             else
             if(accept(Tokenizer::language_tag))
@@ -129,7 +139,7 @@ bool Parser::parse_node(Node &node)
             }
             else
             {
-                node.datatype.clear();  // No datatype given.
+                node.datatype = Symbol();   // No datatype given.
             }
         }
         return true;
@@ -137,7 +147,7 @@ bool Parser::parse_node(Node &node)
     case Tokenizer::variable:
         {
             node.type = Node::variable;
-            node.lexical.assign(tok.begin() + 1, tok.end());
+            node.lexical = arena->intern(tok.begin() + 1, tok.size() - 1);
             tok.advance();
         }
         return true;
@@ -146,14 +156,157 @@ bool Parser::parse_node(Node &node)
     return false;
 }
 
-bool Parser::parse_basic_graph_pattern(std::vector<Quad> &quads)
+/* Parses the predicate of a triple pattern: a variable or a property path.
+   Paths that consist of a single IRI are stored as resources, and other paths
+   are added to 'pattern'. */
+bool Parser::parse_verb(Node &node, Pattern &pattern)
+{
+    if(tok.type() == Tokenizer::variable)
+        return parse_node(node);
+
+    Path *path = parse_path_alternative();
+    if(path == NULL)
+        return false;
+
+    node.datatype = Symbol();
+    if(path->op == Path::link)
+    {
+        node.type = Node::resource;
+        node.lexical = path->iri;
+    }
+    else
+    {
+        node.type = Node::path;
+        node.lexical = Symbol();
+        node.property_path = path;
+        pattern.paths.push_back(path);
+    }
+    return true;
+}
+
+Path *Parser::parse_path_alternative()
+{
+    Path *p = parse_path_sequence();
+    if(!p)
+        return NULL;
+
+    while(accept('|'))
+    {
+        Path *q = parse_path_sequence();
+        if(!q)
+            syntax_error("path expected after '|' token");
+        p = new (*arena) Path(Path::alternative, p, q);
+    }
+
+    return p;
+}
+
+Path *Parser::parse_path_sequence()
 {
+    Path *p = parse_path_element();
+    if(!p)
+        return NULL;
+
+    while(accept('/'))
+    {
+        Path *q = parse_path_element();
+        if(!q)
+            syntax_error("path expected after '/' token");
+        p = new (*arena) Path(Path::sequence, p, q);
+    }
+
+    return p;
+}
+
+Path *Parser::parse_path_element()
+{
+    bool inverse = accept('^');
+
+    Path *p = parse_path_primary();
+    if(!p)
+    {
+        if(inverse)
+            syntax_error("path expected after '^' token");
+        return NULL;
+    }
+
+    if(accept('*'))
+        p = new (*arena) Path(Path::zero_or_more, p);
+    else
+    if(accept('+'))
+        p = new (*arena) Path(Path::one_or_more, p);
+    else
+    if(accept('?'))
+        p = new (*arena) Path(Path::zero_or_one, p);
+
+    return inverse ? new (*arena) Path(Path::inverse, p) : p;
+}
+
+Path *Parser::parse_path_primary()
+{
+    Symbol iri;
+    if(parse_iri(iri))
+        return new (*arena) Path(iri);
+
+    if(!accept('('))
+        return NULL;
+
+    Path *p = parse_path_alternative();
+    if(!p)
+        syntax_error("path expected after '(' token");
+
+    if(!accept(')'))
+        syntax_error("')' token expected after path");
+
+    return p;
+}
+
+/* Parses an unsigned integer or decimal number as a typed literal. */
+bool Parser::parse_number(Node &node)
+{
+    if(tok.type() != Tokenizer::integer)
+        return false;
+
+    node.type = Node::literal;
+    node.lexical = arena->intern(tok.begin(), tok.size());
+    node.datatype = arena->intern(xsd_integer, sizeof(xsd_integer) - 1);
+
+    // A fraction must follow the integer part immediately
+    Tokenizer t = tok;
+    if(t.advance() == '.' && t.begin() == tok.end())
+    {
+        const char *dot = t.begin();
+        if(t.advance() == Tokenizer::integer && t.begin() == dot + 1)
+        {
+            node.lexical = arena->intern(tok.begin(), t.end() - tok.begin());
+            node.datatype = arena->intern(xsd_decimal, sizeof(xsd_decimal) - 1);
+            tok = t;
+        }
+    }
+
+    tok.advance();
+    canonicalize(node);
+    return true;
+}
+
+/* Replaces the lexical value of a typed literal with its canonical form, as
+   import does, so that it matches the node in the database. */
+void Parser::canonicalize(Node &node)
+{
+    std::string canonical;
+    if(canonical_lexical(node.datatype.c_str(), node.lexical.c_str(), canonical))
+        node.lexical = arena->intern(canonical);
+}
+
+bool Parser::parse_basic_graph_pattern(Pattern &pattern)
+{
+    Pattern::Quads &quads = pattern.mandatory_quads;
     Quad t = { Node::unbound };
 
     if(!parse_node(t.subject))
         return false;
 
-    if(!parse_node(t.predicate))
+    if(!parse_verb(t.predicate, pattern))
         syntax_error("predicate expected while reading triple");
 
     if(!parse_node(t.object))
@@ -171,7 +324,7 @@ bool Parser::parse_basic_graph_pattern(std::vector<Quad> &quads)
             if(!parse_node(t.subject))
                 return true;
 
-            if(!parse_node(t.predicate))
+            if(!parse_verb(t.predicate, pattern))
                 syntax_error("predicate expected while reading triple");
 
             if(!parse_node(t.object))
@@ -183,7 +336,7 @@ bool Parser::parse_basic_graph_pattern(std::vector<Quad> &quads)
         case ';':
             tok.advance();
 
-            if(!parse_node(t.predicate))
+            if(!parse_verb(t.predicate, pattern))
                 syntax_error("predicate expected while reading triple");
         
             if(!parse_node(t.object))
@@ -214,7 +367,7 @@ bool Parser::parse_group_graph_pattern(Pattern &pattern)
 
     while(true)
     {
-        parse_basic_graph_pattern(pattern.mandatory_quads);
+        parse_basic_graph_pattern(pattern);
 
         if(parse_group_graph_pattern(pattern))
         {
@@ -222,22 +375,21 @@ bool Parser::parse_group_graph_pattern(Pattern &pattern)
             continue;
         }
         else
-/*
-        if(parse_value_constraint())
+        if(accept_keyword("FILTER"))
         {
+            Expr *e = parse_bracketted_expression();
+            if(!e)
+                syntax_error("bracketted expression expected after FILTER keyword");
+            pattern.filters.push_back(e);
             accept('.');
             continue;
         }
         else
-*/
         if(accept_keyword("OPTIONAL"))
         {
-            Pattern *p = new Pattern;
+            Pattern *p = new (*arena) Pattern(*arena);
             if(!parse_group_graph_pattern(*p))
-            {
-                delete p;
                 throw "group pattern expected after OPTIONAL keyword";
-            }
             accept('.');
             pattern.optional_patterns.push_back(p);
             continue;
@@ -285,6 +437,48 @@ bool Parser::parse_integer(long long &i)
     return true;
 }
 
+/* Parses an aggregate in the projection: '(' function '(' [DISTINCT]
+   (variable | '*') ')' AS variable ')', where '*' is only allowed for COUNT. */
+bool Parser::parse_aggregate(Aggregate &aggregate)
+{
+    static const char * const functions[] = { "COUNT", "SUM", "MIN", "MAX", "AVG" };
+
+    if(!accept('('))
+        return false;
+
+    int f = 0;
+    while(f < 5 && !accept_keyword(functions[f]))
+        ++f;
+    if(f == 5)
+        syntax_error("aggregate function expected after '(' token");
+    aggregate.function = Aggregate::Function(f);
+
+    if(!accept('('))
+        syntax_error("'(' expected after aggregate function");
+    aggregate.distinct = accept_keyword("DISTINCT");
+    if(tok.type() == Tokenizer::variable)
+    {
+        aggregate.var.assign(tok.begin() + 1, tok.end());
+        tok.advance();
+    }
+    else
+    if(aggregate.function != Aggregate::count || !accept('*'))
+        syntax_error("variable expected as argument of aggregate function");
+    if(!accept(')'))
+        syntax_error("')' expected after argument of aggregate function");
+
+    if(!accept_keyword("AS"))
+        syntax_error("AS keyword expected after aggregate function");
+    if(tok.type() != Tokenizer::variable)
+        syntax_error("variable expected after AS keyword");
+    aggregate.alias.assign(tok.begin() + 1, tok.end());
+    tok.advance();
+
+    if(!accept(')'))
+        syntax_error("')' expected after aggregate");
+    return true;
+}
+
 OrderCond *Parser::parse_order_condition()
 {
     bool desc = false;
@@ -292,9 +486,9 @@ OrderCond *Parser::parse_order_condition()
 
     if(tok.type() == Tokenizer::variable)
     {
-        Node *var = new Node;
+        Node *var = new (*arena) Node;
         parse_node(*var);
-        expr = new Expr(var);
+        expr = new (*arena) Expr(var);
     }
     else
     if(accept_keyword("ASC"))
@@ -316,7 +510,7 @@ OrderCond *Parser::parse_order_condition()
         expr = parse_bracketted_expression();
     }
 
-    return expr ? new OrderCond(desc, expr) : NULL;
+    return expr ? new (*arena) OrderCond(desc, expr) : NULL;
 }
 
 
@@ -330,10 +524,7 @@ Expr *Parser::parse_bracketted_expression()
         syntax_error("expression expected after '(' token");
 
     if(!accept(')'))
-    {
-        delete e;
         syntax_error("')' token expected after expression");
-    }
 
     return e;
 }
@@ -344,15 +535,12 @@ Expr *Parser::parse_or_expression()
     if(!e)
         return false;
 
-    while(accept(Tokenizer::operator_and))
+    while(accept(Tokenizer::operator_or))
     {
         Expr *f = parse_and_expression();
         if(!f)
-        {
-            delete e;
             syntax_error("expression expected after '||' token");
-        }
-        e = new Expr(Expr::and, e, f);
+        e = new (*arena) Expr(Expr::or, e, f);
     }
 
     return e;
@@ -368,11 +556,8 @@ Expr *Parser::parse_and_expression()
     {
         Expr *f = parse_relational_expression();
         if(!f)
-        {
-            delete e;
             syntax_error("expression expected after '&&' token");
-        }
-        e = new Expr(Expr::and, e, f);
+        e = new (*arena) Expr(Expr::and, e, f);
     }
 
     return e;
@@ -408,12 +593,9 @@ Expr *Parser::parse_relational_expression()
 
     Expr *f = parse_additive_expression();
     if(!f)
-    {
-        delete e;
         syntax_error("expression expected after relational token");
-    }
 
-    return new Expr(op, e, f);
+    return new (*arena) Expr(op, e, f);
 }
 
 Expr *Parser::parse_additive_expression()
@@ -435,11 +617,8 @@ Expr *Parser::parse_additive_expression()
 
         Expr *f = parse_multiplicative_expression();
         if(!f)
-        {
-            delete e;
             syntax_error("expression expected after additive token");
-        }
-        e = new Expr(op, e, f);
+        e = new (*arena) Expr(op, e, f);
     }
 
     return e;
@@ -464,11 +643,8 @@ Expr *Parser::parse_multiplicative_expression()
 
         Expr *f = parse_unary_expression();
         if(!f)
-        {
-            delete e;
             syntax_error("expression expected after additive token");
-        }
-        e = new Expr(op, e, f);
+        e = new (*arena) Expr(op, e, f);
     }
 
     return e;
@@ -482,7 +658,7 @@ Expr *Parser::parse_unary_expression()
         if(!e)
             syntax_error("primary expression expected after '!' token");
         else
-            return new Expr(Expr::inv, e);
+            return new (*arena) Expr(Expr::inv, e);
     }
     else
     if(accept('+'))
@@ -497,10 +673,10 @@ Expr *Parser::parse_unary_expression()
     if(accept('-'))
     {
         Expr *e = parse_primary_expression();
-        if(!parse_primary_expression())
+        if(!e)
             syntax_error("primary expression expected after '-' token");
         else
-            return new Expr(Expr::neg, e);
+            return new (*arena) Expr(Expr::neg, e);
     }
     else
     {
@@ -525,7 +701,7 @@ Expr *Parser::parse_primary_expression()
     // Value
     Node n;
     if(parse_node(n))
-        return new Expr(new Node(n));
+        return new (*arena) Expr(new (*arena) Node(n));
 
     return NULL;
 }
@@ -533,6 +709,7 @@ Expr *Parser::parse_primary_expression()
 Query *Parser::parse()
 {
     std::auto_ptr<Query> query(new Query());
+    arena = &query->arena;
 
     // Parse namespace abbreviations
     while(accept_keyword("PREFIX"))
@@ -554,32 +731,97 @@ Query *Parser::parse()
     }
 
     // Parse verb
-    if(!accept_keyword("SELECT"))
+    query->distinct = false;
+    if(accept_keyword("ASK"))
+    {
+        query->form = Query::ask;
+    }
+    else
+    if(accept_keyword("CONSTRUCT"))
+    {
+        query->form = Query::construct;
+
+        Pattern pattern(*arena);
+        if( !parse_group_graph_pattern(pattern) ||
+            !pattern.optional_patterns.empty() || !pattern.paths.empty() )
+        {
+            syntax_error("triple template expected after CONSTRUCT keyword");
+        }
+        query->construct_template = pattern.mandatory_quads;
+    }
+    else
+    if(accept_keyword("SELECT"))
+    {
+        query->form = Query::select;
+    }
+    else
         syntax_error("query verb expected");
 
     // Parse distinct
-    query->distinct = accept_keyword("DISTINCT");
+    if(query->form == Query::select)
+        query->distinct = accept_keyword("DISTINCT");
 
     // Parse projection
-    while(tok.type() == Tokenizer::variable)
+    while(query->form == Query::select)
     {
-        query->projection.push_back(std::string(tok.begin() + 1, tok.end()));
-        tok.advance();
+        Aggregate aggregate;
+        if(tok.type() == Tokenizer::variable)
+        {
+            query->projection.push_back(std::string(tok.begin() + 1, tok.end()));
+            tok.advance();
+        }
+        else
+        if(parse_aggregate(aggregate))
+        {
+            query->aggregates.push_back(aggregate);
+            query->projection.push_back(aggregate.alias);
+        }
+        else
+            break;
     }
-    if(query->projection.empty() && !accept('*'))
+    if( query->form == Query::select &&
+        query->projection.empty() && !accept('*') )
+    {
         syntax_error("list of variables or '*' expected after SELECT keyword");
+    }
 
     // Parse graph pattern
     accept_keyword("WHERE");
     if(!parse_group_graph_pattern(*query->pattern))
         syntax_error("group graph pattern expected after WHERE keyword");
 
-    if(query->projection.empty())
+    if(query->form == Query::select && query->projection.empty())
     {
         std::set<std::string> vars;
         accumulate_variables(*query->pattern, vars);
         query->projection.assign(vars.begin(), vars.end());
     }
+    else
+    if(query->form == Query::construct)
+    {
+        // Select the variables in the template that the pattern binds
+        std::set<std::string> vars;
+        accumulate_variables(*query->pattern, vars);
+        Pattern pattern(*arena);
+        pattern.mandatory_quads = query->construct_template;
+        std::set<std::string> used;
+        accumulate_variables(pattern, used);
+        std::set_intersection( vars.begin(), vars.end(), used.begin(), used.end(),
+                               std::back_inserter(query->projection) );
+    }
+
+    // Parse GROUP BY clause
+    if(accept_keyword("GROUP"))
+    {
+        if(!accept_keyword("BY"))
+            syntax_error("BY keyword expected after GROUP keyword");
+        if(tok.type() != Tokenizer::variable)
+            syntax_error("variable expected after 'GROUP BY'");
+        do {
+            query->group_by.push_back(std::string(tok.begin() + 1, tok.end()));
+            tok.advance();
+        } while(tok.type() == Tokenizer::variable);
+    }
 
     // Parse ORDER BY solution modifier
     if(accept_keyword("ORDER"))
@@ -608,9 +850,24 @@ Query *Parser::parse()
     if(accept_keyword("OFFSET") && !parse_integer(query->offset))
         syntax_error("non-negative integer expected after OFFSET keyword");
 
+    // Stop at the first solution of an ASK query
+    if(query->form == Query::ask)
+    {
+        if(!query->order.empty() || query->limit >= 0 || query->offset >= 0)
+            syntax_error("ASK queries take no solution modifiers");
+        query->limit = 1;
+    }
+
     return query.release();
 }
 
+// Parses input consisting of a single IRI or literal (e.g. a bound value)
+bool Parser::parse_term(Node &node, Arena &arena)
+{
+    this->arena = &arena;
+    return parse_node(node) && node.type != Node::variable && full();
+}
+
 bool Parser::full()
 {
     return tok.type() == Tokenizer::done;
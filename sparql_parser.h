@@ -1,15 +1,28 @@
 #ifndef SPARQL_PARSER_INCLUDED
+#define SPARQL_PARSER_INCLUDED
 
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
 #include "sparql_tokenizer.h"
+#include "arena.h"
+
+/*
+The syntax tree of a query is allocated in the arena of its Query: Expr, Path,
+Pattern and OrderCond objects, and the lists in patterns. Variable names,
+IRIs and literals are interned in the arena as well, so that nodes are cheap
+to copy. Nothing in the tree is destroyed individually; it is freed at once
+when the Query is deleted.
+*/
+
+class Path;
 
 struct Node
 {
-    enum Type { unbound, resource, literal, variable } type;
-    std::string lexical, datatype;
+    enum Type { unbound, resource, literal, variable, path } type;
+    Symbol lexical, datatype;
+    const Path *property_path;  // for paths
 };
 
 struct Quad
@@ -35,7 +48,24 @@ public:
 
     inline Expr(Op op, Expr *lhs, Expr *rhs = NULL);
     inline Expr(Node *node);
-    inline ~Expr();
+};
+
+/* A property path: an IRI (link), or an operator applied to one path (inverse
+   and the modifiers) or two paths (sequence and alternative). */
+class Path
+{
+private:
+    Path(const Path&);
+    Path &operator=(const Path&);
+
+public:
+    const enum Op { link, inverse, sequence, alternative,
+                    zero_or_more, one_or_more, zero_or_one } op;
+    Path *const lhs, *const rhs;
+    const Symbol iri;
+
+    inline Path(const Symbol &iri);
+    inline Path(Op op, Path *lhs, Path *rhs = NULL);
 };
 
 class Pattern
@@ -45,11 +75,17 @@ private:
     Pattern &operator=(const Pattern&);
 
 public:
-    inline Pattern();
-    inline ~Pattern();
+    typedef std::vector<Quad, ArenaAllocator<Quad> >         Quads;
+    typedef std::vector<Pattern*, ArenaAllocator<Pattern*> > Patterns;
+    typedef std::vector<Path*, ArenaAllocator<Path*> >       Paths;
+    typedef std::vector<Expr*, ArenaAllocator<Expr*> >       Exprs;
+
+    inline explicit Pattern(Arena &arena);
 
-    std::vector<Quad>     mandatory_quads;
-    std::vector<Pattern*> optional_patterns;
+    Quads    mandatory_quads;
+    Patterns optional_patterns;
+    Paths    paths;             // used as predicates in quads
+    Exprs    filters;
 };
 
 class OrderCond
@@ -59,12 +95,19 @@ class OrderCond
 
 public:
     inline OrderCond(bool desc, Expr *expr);
-    inline ~OrderCond();
 
     bool desc;
     Expr *expr;
 };
 
+struct Aggregate
+{
+    enum Function { count, sum, min, max, avg } function;
+    bool distinct;
+    std::string var;        // argument, or empty for COUNT(*)
+    std::string alias;      // variable that is bound to the result
+};
+
 class Query
 {
 private:
@@ -72,17 +115,24 @@ private:
     Query &operator=(const Query&);
 
 public:
+    typedef std::vector<OrderCond*, ArenaAllocator<OrderCond*> > OrderConds;
+
     inline Query();
-    inline ~Query();
+
+    Arena arena;
 
     // verb
+    enum Form { select, ask, construct } form;
+    Pattern::Quads construct_template;
     bool distinct;
     std::vector<std::string> projection;
     Pattern * const pattern;
     // from?
     // projection
     // distinct
-    std::vector<OrderCond*> order;
+    std::vector<Aggregate> aggregates;
+    std::vector<std::string> group_by;
+    OrderConds order;
     long long limit;
     long long offset;
 };
@@ -91,15 +141,27 @@ class Parser
 {
     Tokenizer tok;
 
+    Arena *arena;
     std::map<std::string, std::string> namespace_prefix;
+    std::string buffer;
 
     inline bool accept(int type);
     inline bool accept_keyword(const char *keyword);
-    bool parse_iri(std::string &str);
+    bool parse_iri(Symbol &iri);
     bool parse_node(Node &nr);
-    bool parse_basic_graph_pattern(std::vector<Quad> &quads);
+    bool parse_number(Node &node);
+    void canonicalize(Node &node);
+    bool parse_verb(Node &node, Pattern &pattern);
+    bool parse_basic_graph_pattern(Pattern &pattern);
     bool parse_group_graph_pattern(Pattern &pattern);
     bool parse_integer(long long &i);
+    bool parse_aggregate(Aggregate &aggregate);
+
+    // Parsing property paths
+    Path *parse_path_alternative();
+    Path *parse_path_sequence();
+    Path *parse_path_element();
+    Path *parse_path_primary();
 
     OrderCond *parse_order_condition();
 
@@ -121,6 +183,7 @@ public:
     Parser(const char *begin, const char *end);
 
     Query *parse();
+    bool parse_term(Node &node, Arena &arena);
     bool full();
 };
 
@@ -137,17 +200,12 @@ const Node &Quad::operator[] (int n) const
 }
 
 // Implementation of Pattern inline members
-Pattern::Pattern()
-{
-}
-
-Pattern::~Pattern()
+Pattern::Pattern(Arena &arena)
+    : mandatory_quads(ArenaAllocator<Quad>(arena)),
+      optional_patterns(ArenaAllocator<Pattern*>(arena)),
+      paths(ArenaAllocator<Path*>(arena)),
+      filters(ArenaAllocator<Expr*>(arena))
 {
-    for( std::vector<Pattern*>::const_iterator i = optional_patterns.begin();
-         i != optional_patterns.end(); ++i )
-    {
-        delete *i;
-    }
 }
 
 // Implementation of OrderCond inline members
@@ -156,28 +214,15 @@ OrderCond::OrderCond(bool desc, Expr *expr)
 {
 }
 
-OrderCond::~OrderCond()
-{
-    delete expr;
-}
-
 
 // Implementation of Query inline members
-Query::Query() : pattern(new Pattern)
+Query::Query()
+    : construct_template(ArenaAllocator<Quad>(arena)),
+      pattern(new (arena) Pattern(arena)),
+      order(ArenaAllocator<OrderCond*>(arena))
 {
 }
 
-Query::~Query()
-{
-    delete pattern;
-
-    for( std::vector<OrderCond*>::const_iterator i = order.begin();
-         i != order.end(); ++i )
-    {
-        delete *i;
-    }
-}
-
 
 // Implementation of Expr inline members
 Expr::Expr(Op op, Expr *lhs, Expr *rhs)
@@ -190,11 +235,16 @@ Expr::Expr(Node *node)
 {
 }
 
-Expr::~Expr()
+
+// Implementation of Path inline members
+Path::Path(const Symbol &iri)
+    : op(link), lhs(NULL), rhs(NULL), iri(iri)
+{
+}
+
+Path::Path(Op op, Path *lhs, Path *rhs)
+    : op(op), lhs(lhs), rhs(rhs)
 {
-    delete lhs;
-    delete rhs;
-    delete node;
 }
 
 #endif /* ndef SPARQL_PARSER_INCLUDED */
@@ -81,7 +81,13 @@ int Tokenizer::advance()
     case '|':
         token_begin = cur++;
         if(cur == eof || *cur != *token_begin)
-            break;
+        {
+            // Single '^' and '|' are property path operators
+            if(*token_begin == '&')
+                break;
+            token_end = cur;
+            return token_type = *token_begin;
+        }
         token_end = ++cur;
         switch(*token_begin)
         {
@@ -104,6 +110,7 @@ int Tokenizer::advance()
     case '*':
     case '-':
     case '/':
+    case '=':
         token_begin = cur;
         token_end   = ++cur;
         return token_type = *token_begin;
@@ -123,7 +130,8 @@ int Tokenizer::advance()
         token_begin = cur++;
         while(cur != eof && idchar(*cur)) ++cur;
         token_end = cur;
-        return token_type = variable;
+        // Without a name, '?' is a property path modifier
+        return token_type = token_end - token_begin > 1 ? variable : *token_begin;
 
     case '\'':
     case '\"':
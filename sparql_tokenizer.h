@@ -1,4 +1,4 @@
-#ifndef TOKENIZER_INCLUDED
+#ifndef SPARQL_TOKENIZER_INCLUDED
 #define SPARQL_TOKENIZER_INCLUDED
 
 class Tokenizer
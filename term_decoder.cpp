@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <sstream>
+#include "term_decoder.h"
+
+TermDecoder::TermDecoder(sqlite3 *db)
+{
+    const char *sql = "SELECT l, d FROM Node WHERE oid=?1";
+    if(sqlite3_prepare(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        throw std::string() +
+            "Unable to prepare statement: \"" + sql + "\"!";
+    }
+}
+
+TermDecoder::~TermDecoder()
+{
+    sqlite3_finalize(stmt);
+}
+
+bool TermDecoder::decode(nid_t id, std::string &lexical, nid_t &datatype)
+{
+    sqlite3_bind_int64(stmt, 1, id);
+    int result = sqlite3_step(stmt);
+    if(result == SQLITE_ROW)
+    {
+        const char *l = (const char*)sqlite3_column_text(stmt, 0);
+        lexical.assign(l ? l : "", sqlite3_column_bytes(stmt, 0));
+        datatype = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_reset(stmt);
+
+    if(result == SQLITE_BUSY)
+        throw "Database is busy!";
+    if(result != SQLITE_ROW && result != SQLITE_DONE)
+        throw "Unable to retrieve node!";
+    return result == SQLITE_ROW;
+}
+
+
+TermCache::TermCache(sqlite3 *db, size_t capacity)
+    : db(db), batch(NULL), decoder(db), capacity(capacity)
+{
+}
+
+TermCache::~TermCache()
+{
+    sqlite3_finalize(batch);
+}
+
+/* Returns the URI of a datatype; datatypes are never discarded. */
+const std::string &TermCache::datatype(nid_t id)
+{
+    std::map<nid_t, std::string>::iterator i = datatypes.find(id);
+    if(i != datatypes.end())
+        return i->second;
+
+    std::string uri;
+    nid_t dummy;
+    if(!decoder.decode(id, uri, dummy))
+        throw "Unable to decode datatype!";
+    return datatypes[id] = uri;
+}
+
+const TermCache::Entry &TermCache::lookup(nid_t id)
+{
+    std::map<nid_t, Entry>::iterator i = entries.find(id);
+    if(i != entries.end())
+        return i->second;
+
+    Entry entry;
+    nid_t datatype;
+    if(!decoder.decode(id, entry.lexical, datatype))
+        throw "Unable to decode node!";
+    entry.literal = datatype != 0;
+    if(datatype > 1)
+        entry.datatype = this->datatype(datatype);
+
+    return entries[id] = entry;
+}
+
+void TermCache::prefetch(const std::vector<nid_t> &ids)
+{
+    std::vector<nid_t> missing;
+    for(std::vector<nid_t>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+    {
+        if(*i >= 0 && entries.find(*i) == entries.end())
+            missing.push_back(*i);
+    }
+    if(missing.empty())
+        return;
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+    if(batch == NULL)
+    {
+        std::ostringstream sql;
+        sql << "SELECT oid, l, d FROM Node WHERE oid IN (";
+        for(int n = 1; n <= batch_size; ++n)
+            sql << (n == 1 ? "?" : ", ?") << n;
+        sql << ')';
+        if(sqlite3_prepare(db, sql.str().c_str(), -1, &batch, NULL) != SQLITE_OK)
+        {
+            throw std::string() +
+                "Unable to prepare statement: \"" + sql.str() + "\"!";
+        }
+    }
+
+    // Parameters that are not needed in the last batch are NULL
+    for(size_t first = 0; first < missing.size(); first += batch_size)
+    {
+        for(size_t n = 0; n < batch_size; ++n)
+        {
+            if(first + n < missing.size())
+                sqlite3_bind_int64(batch, n + 1, missing[first + n]);
+            else
+                sqlite3_bind_null(batch, n + 1);
+        }
+
+        int result;
+        while((result = sqlite3_step(batch)) == SQLITE_ROW)
+        {
+            Entry &entry = entries[sqlite3_column_int64(batch, 0)];
+            const char *l = (const char*)sqlite3_column_text(batch, 1);
+            entry.lexical.assign(l ? l : "", sqlite3_column_bytes(batch, 1));
+            nid_t datatype = sqlite3_column_int64(batch, 2);
+            entry.literal = datatype != 0;
+            if(datatype > 1)
+                entry.datatype = this->datatype(datatype);
+        }
+        sqlite3_reset(batch);
+
+        if(result == SQLITE_BUSY)
+            throw "Database is busy!";
+        if(result != SQLITE_DONE)
+            throw "Unable to retrieve nodes!";
+    }
+}
+
+void TermCache::trim()
+{
+    if(entries.size() > capacity)
+        entries.clear();
+}
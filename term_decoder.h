@@ -0,0 +1,68 @@
+#ifndef TERM_DECODER_H_INCLUDED
+#define TERM_DECODER_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+typedef long long int nid_t;
+
+/* Looks up the lexical value and datatype of nodes by their identifier.
+   The datatype is TYPE_URI (0) for resources, TYPE_LITERAL (1) for plain
+   literals and the node identifier of the datatype URI for typed literals. */
+class TermDecoder
+{
+    TermDecoder(const TermDecoder&);
+    TermDecoder &operator=(const TermDecoder&);
+
+    sqlite3_stmt *stmt;
+
+public:
+    TermDecoder(sqlite3 *db);
+    ~TermDecoder();
+
+    bool decode(nid_t id, std::string &lexical, nid_t &datatype);
+};
+
+/* Decodes nodes including the URI of their datatype, and keeps decoded
+   nodes in memory. References returned by lookup() remain valid until trim()
+   is called, which discards all nodes if more than 'capacity' are kept.
+
+   prefetch() decodes the nodes in a list of identifiers that are not kept
+   yet, with one query per 'batch_size' nodes (in order of identifier) instead
+   of a query per node, so that subsequent lookups of these nodes are served
+   from memory. */
+class TermCache
+{
+    TermCache(const TermCache&);
+    TermCache &operator=(const TermCache&);
+
+public:
+    struct Entry
+    {
+        bool literal;
+        std::string lexical, datatype;
+    };
+
+    enum { batch_size = 256 };
+
+    TermCache(sqlite3 *db, size_t capacity = 65536);
+    ~TermCache();
+
+    const Entry &lookup(nid_t id);
+    void prefetch(const std::vector<nid_t> &ids);
+    void trim();
+
+private:
+    sqlite3 *db;
+    sqlite3_stmt *batch;
+    TermDecoder decoder;
+    std::map<nid_t, Entry> entries;
+    std::map<nid_t, std::string> datatypes;
+    size_t capacity;
+
+    const std::string &datatype(nid_t id);
+};
+
+#endif /* ndef TERM_DECODER_H_INCLUDED */
@@ -1,14 +1,16 @@
 #include "turtle_parser.h"
+#include "typed_value.h"
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <cstdio>
 
 /*
-    TODO: support datatypes: integer, double, decimal, boolean
-
     CHECKME: test if using a terminating character (\0) is faster than checking for cur==eob
 */
+
 TurtleParser::TurtleParser(TurtleTokenizer::Reader reader, void *reader_arg) :
-    tok(reader, reader_arg), state(expecting_subject)
+    tok(reader, reader_arg), state(expecting_subject), has_value(false)
 {
     tok.advance();
 };
@@ -50,10 +52,59 @@ bool TurtleParser::parse_resource(std::string &uri)
     return false;
 }
 
+/* Replaces the lexical value of a literal of a built-in datatype with its
+   canonical form and decodes its value. */
+void TurtleParser::normalize_literal()
+{
+    has_value = false;
+    std::string canonical;
+    int kind = canonical_lexical(type.c_str(), lexical.c_str(), canonical);
+    if(kind == 0)
+        return;
+    lexical.swap(canonical);
+
+    switch(kind)
+    {
+    case CANONICAL_BOOLEAN:
+        value.type = TURTLE_VALUE_BOOLEAN;
+        value.integer = lexical == "true";
+        value.real = value.integer;
+        has_value = true;
+        return;
+
+    case CANONICAL_INTEGER:
+        errno = 0;
+        value.integer = std::strtoll(lexical.c_str(), NULL, 10);
+        value.type = TURTLE_VALUE_INTEGER;
+        value.real = (double)value.integer;
+        has_value = errno != ERANGE;
+        return;
+
+    case CANONICAL_DECIMAL:
+        value.type = TURTLE_VALUE_DECIMAL;
+        break;
+
+    default:
+        value.type = TURTLE_VALUE_DOUBLE;
+        break;
+    }
+
+    // Infinite values (including overflow) and NaN are not decoded
+    errno = 0;
+    value.real = std::strtod(lexical.c_str(), NULL);
+    value.integer = 0;
+    has_value = errno != ERANGE && lexical[lexical.size() - 1] != 'F' &&
+                lexical != "NaN";
+}
+
 bool TurtleParser::parse_literal()
 {
-    if(tok.type() == TurtleTokenizer::string)
+    lang.clear();
+    has_value = false;
+
+    switch(tok.type())
     {
+    case TurtleTokenizer::string:
         lexical.assign(tok.begin(), tok.end());
         tok.advance();
 
@@ -65,25 +116,51 @@ bool TurtleParser::parse_literal()
             if(*(tok.end() - 1) == '-')
                 return false;
             lang.assign(tok.begin(), tok.end());
+            type.clear();
         }
         else
+        if(tok.type() == TurtleTokenizer::carets)
         {
-            lang.clear();
-            if(tok.type() == TurtleTokenizer::carets)
-            {
-                tok.advance();
-                if(!parse_resource(type))
-                    return false;
-            }
-            else
-            {
-                type.clear();
-            }
+            tok.advance();
+            if(!parse_resource(type))
+                return false;
+            normalize_literal();
+        }
+        else
+        {
+            type.clear();
         }
         return true;
+
+    case TurtleTokenizer::integer:
+        type.assign(XSD "integer");
+        break;
+
+    case TurtleTokenizer::decimal:
+        type.assign(XSD "decimal");
+        break;
+
+    case TurtleTokenizer::floating:
+        type.assign(XSD "double");
+        break;
+
+    case TurtleTokenizer::name:
+        if( (tok.size() == 4 && std::strncmp(tok.begin(), "true", 4) == 0) ||
+            (tok.size() == 5 && std::strncmp(tok.begin(), "false", 5) == 0) )
+        {
+            type.assign(XSD "boolean");
+            break;
+        }
+        return false;
+
+    default:
+        return false;
     }
-    // TODO: other types (which must be normalized!)
-    return false;
+
+    lexical.assign(tok.begin(), tok.end());
+    tok.advance();
+    normalize_literal();
+    return true;
 }
 
 bool TurtleParser::parse_object()
@@ -93,6 +170,7 @@ bool TurtleParser::parse_object()
         lexical.clear();
         type.clear();
         lang.clear();
+        has_value = false;
         return true;
     }
     if(parse_literal())
@@ -191,12 +269,13 @@ bool TurtleParser::advance()
 }
 
 extern "C"
-int parse_turtle(
+int parse_turtle_values(
     size_t (*reader) (void *arg, char *buffer, size_t size),
     void *reader_arg,
     int (*callback) ( void *arg, const char *subject, const char *predicate,
                       const char *object, const char *lexical,
-                      const char *datatype, const char *language ),
+                      const char *datatype, const char *language,
+                      const struct turtle_value *value ),
     void *callback_arg )
 {
     TurtleParser tp(reader, reader_arg);
@@ -212,13 +291,45 @@ int parse_turtle(
                   (obj_res || tp.object_datatype().empty())
                         ? NULL : tp.object_datatype().c_str(),
                   (obj_res || tp.object_language().empty())
-                        ? NULL : tp.object_language().c_str() );
+                        ? NULL : tp.object_language().c_str(),
+                  tp.object_value() );
         if(r != 0)
             return r;
     }
     return tp.good() ? 0 : -1;
 }
 
+struct plain_handler
+{
+    int (*callback) ( void *arg, const char *subject, const char *predicate,
+                      const char *object, const char *lexical,
+                      const char *datatype, const char *language );
+    void *arg;
+};
+
+static int call_plain_handler( void *arg, const char *subject,
+    const char *predicate, const char *object, const char *lexical,
+    const char *datatype, const char *language, const struct turtle_value * )
+{
+    plain_handler *handler = (plain_handler*)arg;
+    return handler->callback( handler->arg, subject, predicate, object,
+                              lexical, datatype, language );
+}
+
+extern "C"
+int parse_turtle(
+    size_t (*reader) (void *arg, char *buffer, size_t size),
+    void *reader_arg,
+    int (*callback) ( void *arg, const char *subject, const char *predicate,
+                      const char *object, const char *lexical,
+                      const char *datatype, const char *language ),
+    void *callback_arg )
+{
+    plain_handler handler = { callback, callback_arg };
+    return parse_turtle_values( reader, reader_arg,
+                                call_plain_handler, (void*)&handler );
+}
+
 extern "C" 
 size_t fp_reader(void *arg, char *buffer, size_t size)
 {
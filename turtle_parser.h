@@ -51,6 +51,45 @@ int parse_turtle(
     void *callback_arg );
 
 
+/*
+Literals of the datatypes xsd:boolean, xsd:integer (and the types derived
+from it), xsd:decimal, xsd:float and xsd:double are normalized to their
+canonical lexical form (e.g. 007 becomes "7", 1.50 becomes "1.5", 1e3 becomes
+"1.0E3" and "1"^^xsd:boolean becomes "true"), so equal values always have
+the same lexical representation. Literals that are not valid for their
+datatype are passed unchanged.
+
+For these literals, parse_turtle_values() also passes the decoded value:
+    type:       TURTLE_VALUE_BOOLEAN, TURTLE_VALUE_INTEGER,
+                TURTLE_VALUE_DECIMAL or TURTLE_VALUE_DOUBLE
+    integer:    the value of an integer, or 0/1 for false/true
+    real:       the value of a number (approximate for decimals and integers)
+Integers that do not fit in 64 bits and infinite values are passed without a
+decoded value. Otherwise, the 'value' argument of the handler is NULL.
+*/
+
+#define TURTLE_VALUE_BOOLEAN    (1)
+#define TURTLE_VALUE_INTEGER    (2)
+#define TURTLE_VALUE_DECIMAL    (3)
+#define TURTLE_VALUE_DOUBLE     (4)
+
+struct turtle_value
+{
+    int type;
+    long long integer;
+    double real;
+};
+
+int parse_turtle_values(
+    size_t (*reader) (void *arg, char *buffer, size_t size),
+    void *reader_arg,
+    int (*callback) ( void *arg, const char *subject, const char *predicate,
+                      const char *object, const char *lexical,
+                      const char *datatype, const char *language,
+                      const struct turtle_value *value ),
+    void *callback_arg );
+
+
 /* Reader function for reading from FILE* objects.
    The argument should be (FILE*) cast to (void*). */
 size_t fp_reader(void *arg, char *buffer, size_t size);
@@ -70,9 +109,12 @@ class TurtleParser
     enum { expecting_subject, expecting_predicate, expecting_object, done } state;
     std::map<std::string, std::string> namespaces;
     std::string subj, pred, obj, lexical, type, lang;
+    turtle_value value;
+    bool has_value;
 
     bool parse_resource(std::string &uri);
     bool parse_literal();
+    void normalize_literal();
     inline bool parse_subject();
     inline bool parse_predicate();
     inline bool parse_object();
@@ -88,6 +130,7 @@ public:
     inline const std::string &object_lexical() const;
     inline const std::string &object_datatype() const;
     inline const std::string &object_language() const;
+    inline const turtle_value *object_value() const;
     inline bool object_is_resource() const;
     inline bool object_is_literal() const;
 };
@@ -127,6 +170,11 @@ const std::string &TurtleParser::object_language() const
     return lang;
 }
 
+const turtle_value *TurtleParser::object_value() const
+{
+    return has_value ? &value : NULL;
+}
+
 bool TurtleParser::object_is_resource() const
 {
     return !obj.empty();
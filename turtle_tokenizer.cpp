@@ -17,14 +17,24 @@
 TurtleTokenizer::TurtleTokenizer(Reader reader, void *reader_arg)
     : reader(reader), reader_arg(reader_arg)
 {
-    cur = eob = buffer = new char[buffer_size = 512];
+    cur = eob = buffer = new char[buffer_size = 65536];
     error = 0;
 }
 
+/* Reads into the buffer at 'eob'; a read error ends the input. */
+void TurtleTokenizer::read_buffer()
+{
+    size_t read = reader(reader_arg, eob, buffer + buffer_size - eob);
+    if(read == (size_t)-1)
+        error = 1;
+    else
+        eob += read;
+}
+
 bool TurtleTokenizer::refill_buffer()
 {
-    cur = buffer;
-    eob = buffer + reader(reader_arg, buffer, buffer_size);
+    cur = eob = buffer;
+    read_buffer();
     return cur != eob;
 }
 
@@ -55,7 +65,7 @@ bool TurtleTokenizer::extend_buffer()
         buffer_size = new_buffer_size;
     }
 
-    eob += reader(reader_arg, eob, buffer + buffer_size - eob);
+    read_buffer();
     return cur != eob;
 }
 
@@ -133,10 +143,71 @@ parse_directive:
 
 bool TurtleTokenizer::name_char(char c)
 {
-    return (c >= 'a' && *cur <= 'z') || (c >= 'A' && c <= 'Z') ||
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') ||
            (c == '_' || c == ':' || ((signed char)c) < 0);
 }
 
+/* Returns the current character, or 0 at the end of the input.
+   Note: requires that t_begin is set correctly! */
+char TurtleTokenizer::peek()
+{
+    if(cur == eob && !extend_buffer())
+        return '\0';
+    return *cur;
+}
+
+/* Parses an integer, a decimal (with a fraction) or a double (with an
+   exponent). A dot that is not followed by a digit ends a statement instead,
+   so it is not part of the number. Returns false if there are no digits. */
+bool TurtleTokenizer::parse_number()
+{
+    t_begin = cur;
+    t_type = integer;
+    if(*cur == '+' || *cur == '-')
+        ++cur;
+
+    size_t digits = 0;
+    while(peek() >= '0' && peek() <= '9')
+        ++cur, ++digits;
+
+    if(peek() == '.')
+    {
+        size_t fraction = 0;
+        ++cur;
+        while(peek() >= '0' && peek() <= '9')
+            ++cur, ++fraction;
+        if(fraction == 0)
+            --cur;
+        else
+            t_type = decimal;
+        digits += fraction;
+    }
+    if(digits == 0)
+    {
+        cur = t_begin;
+        return false;
+    }
+
+    if(peek() == 'e' || peek() == 'E')
+    {
+        size_t mark = cur - t_begin;
+        ++cur;
+        if(peek() == '+' || peek() == '-')
+            ++cur;
+        size_t exponent = 0;
+        while(peek() >= '0' && peek() <= '9')
+            ++cur, ++exponent;
+        if(exponent == 0)
+            cur = t_begin + mark;
+        else
+            t_type = floating;
+    }
+
+    t_end = cur;
+    return true;
+}
+
 TurtleTokenizer::token_type TurtleTokenizer::advance()
 {
     // Skip whitespace
@@ -185,6 +256,8 @@ skip_whitespace:
             return t_type = comma;
 
         case '.':
+            if(parse_number())
+                return t_type;
             t_begin = cur;
             t_end   = ++cur;
             return t_type = dot;
@@ -220,17 +293,10 @@ skip_whitespace:
 
         case '+': case '-': case '0': case '1': case '2': case '3':
         case '4': case '5': case '6': case '7': case '8': case '9':
-            // Parse integer;
-            t_begin = cur;
-        parse_integer:
-            do {
-                ++cur;
-            } while(cur != eob && *cur >= '0' && *cur <= '9');
-            if(cur == eob && extend_buffer())
-                goto parse_integer;
-            t_end = cur;
-            if(t_begin + 1 != t_end || (*t_begin != '+' && *t_begin != '-'))
-                return t_type = integer;
+            // Parse number
+            if(parse_number())
+                return t_type;
+            break;
 
         default:
             if(name_char(*cur))
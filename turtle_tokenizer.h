@@ -9,7 +9,7 @@ public:
     typedef size_t (*Reader) (void *arg, char *buffer, size_t size);
     static size_t istream_reader(void *arg, char *buffer, size_t size);
     enum token_type {
-        finished, directive, string, uri, name, integer,
+        finished, directive, string, uri, name, integer, decimal, floating,
         dot, semicolon, comma, carets };
 
 protected:
@@ -23,10 +23,13 @@ protected:
     int error;
 
 
+    void read_buffer();
     bool refill_buffer();
     bool extend_buffer();
     bool parse_string(char end_char);
     bool parse_directive();
+    bool parse_number();
+    inline char peek();
 
     inline bool name_char(char c);
 
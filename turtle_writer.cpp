@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstring>
+#include "turtle_writer.h"
+
+/* Escapes characters in URIs and strings; apart from the closing '>' or
+   '"', only tabs, line breaks and backslashes are escaped. */
+static const char *escape(char c)
+{
+    switch(c)
+    {
+    case 0x09: return "\\t";
+    case 0x0A: return "\\n";
+    case 0x0D: return "\\r";
+    case 0x5C: return "\\\\";
+    case '>':  return "\\>";
+    case '"':  return "\\\"";
+    }
+    return NULL;
+}
+
+void write_uri(OutputBuffer &out, const char *uri)
+{
+    out.put('<');
+    out.write_escaped(uri, '>', escape);
+    out.put('>');
+}
+
+void write_string(OutputBuffer &out, const char *str)
+{
+    out.put('"');
+    out.write_escaped(str, '"', escape);
+    out.put('"');
+}
+
+void write_statement( OutputBuffer &out, const char *subj, const char *pred,
+                      const char *obj, const char *type, const char *graph )
+{
+    write_uri(out, subj);
+    out.put(' ');
+    write_uri(out, pred);
+    out.put(' ');
+    if(type == NULL)
+        write_uri(out, obj);
+    else
+    {
+        write_string(out, obj);
+        if(*type)
+        {
+            out.write("^^", 2);
+            write_uri(out, type);
+        }
+    }
+    if(graph)
+    {
+        out.put(' ');
+        write_uri(out, graph);
+    }
+    out.write(".\n", 2);
+}
+
+
+TripleWriter::~TripleWriter()
+{
+}
+
+
+NTriplesWriter::NTriplesWriter(FILE *fp)
+    : out(fp)
+{
+}
+
+void NTriplesWriter::triple( const char *subj, const char *pred,
+                             const char *obj, const char *type )
+{
+    write_statement(out, subj, pred, obj, type);
+    out.row();
+}
+
+void NTriplesWriter::end()
+{
+    out.flush();
+}
+
+
+TurtleWriter::TurtleWriter( FILE *fp,
+                            const std::vector<std::string> &namespaces )
+    : out(fp), statement(NULL), slots(64)
+{
+    for(size_t n = 0; n < namespaces.size(); ++n)
+        prefix(namespaces[n].data(), namespaces[n].size());
+}
+
+/* FNV-1a */
+size_t TurtleWriter::hash(const char *ns, size_t len)
+{
+    size_t h = 2166136261u;
+    for(size_t n = 0; n < len; ++n)
+        h = (h ^ (unsigned char)ns[n]) * 16777619u;
+    return h;
+}
+
+/* Returns the prefix for a namespace, declaring a new one if necessary. */
+const TurtleWriter::Prefix &TurtleWriter::prefix(const char *ns, size_t len)
+{
+    size_t mask = slots.size() - 1, slot = hash(ns, len) & mask;
+    for(; slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const Prefix &p = prefixes[slots[slot] - 1];
+        if(p.ns.size() == len && std::memcmp(p.ns.data(), ns, len) == 0)
+            return p;
+    }
+
+    // Pick a new abbreviation
+    prefixes.push_back(Prefix());
+    Prefix &p = prefixes.back();
+    p.ns.assign(ns, len);
+    for(size_t id = prefixes.size(); id != 0; id /= 26)
+        p.abbr += char('a' + --id % 26);
+    std::reverse(p.abbr.begin(), p.abbr.end());
+    out.write("@prefix ", 8);
+    out.write(p.abbr.data(), p.abbr.size());
+    out.write(": ", 2);
+    write_uri(out, p.ns.c_str());
+    out.write(".\n", 2);
+
+    // Keep the table at most half full
+    if(2*prefixes.size() <= slots.size())
+        slots[slot] = prefixes.size();
+    else
+    {
+        slots.assign(2*slots.size(), 0);
+        mask = slots.size() - 1;
+        for(size_t n = 0; n < prefixes.size(); ++n)
+        {
+            slot = hash(prefixes[n].ns.data(), prefixes[n].ns.size()) & mask;
+            while(slots[slot] != 0)
+                slot = (slot + 1) & mask;
+            slots[slot] = n + 1;
+        }
+    }
+    return p;
+}
+
+void TurtleWriter::write_resource(const char *uri)
+{
+    const char *p = strchr(uri, '#');
+    if(p == NULL)
+        write_uri(statement, uri);
+    else
+    {
+        ++p;
+        const Prefix &ns = prefix(uri, p - uri);
+        statement.write(ns.abbr.data(), ns.abbr.size());
+        statement.put(':');
+        statement.write(p);
+    }
+}
+
+/* Writes the buffered statement, if any. */
+void TurtleWriter::end_statement()
+{
+    if(statement.size() == 0)
+        return;
+    out.write(statement.data(), statement.size());
+    out.write(".\n", 2);
+    out.row();
+    statement.clear();
+}
+
+void TurtleWriter::triple( const char *subj, const char *pred,
+                           const char *obj, const char *type )
+{
+    if(last_subj != subj)
+    {
+        end_statement();
+        last_subj.assign(subj);
+        last_pred.assign(pred);
+
+        // Write subject and predicate
+        write_resource(subj);
+        statement.put(' ');
+        write_resource(pred);
+    }
+    else
+    if(last_pred != pred)
+    {
+        statement.write(";\n\t", 3);
+        last_pred.assign(pred);
+
+        // Write predicate
+        write_resource(pred);
+    }
+    else
+    {
+        statement.put(',');
+    }
+
+    // Write object
+    statement.put(' ');
+    if(type == NULL)
+        write_resource(obj);
+    else
+    {
+        write_string(statement, obj);
+        if(*type)
+        {
+            statement.write("^^", 2);
+            write_resource(type);
+        }
+    }
+}
+
+void TurtleWriter::end()
+{
+    // Write final statement
+    end_statement();
+    out.flush();
+}
+
+
+TripleWriter *create_triple_writer(const std::string &format, FILE *fp)
+{
+    if(format == "turtle")
+        return new TurtleWriter(fp);
+    if(format == "ntriples")
+        return new NTriplesWriter(fp);
+    return NULL;
+}
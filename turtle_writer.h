@@ -0,0 +1,85 @@
+#ifndef TURTLE_WRITER_H_INCLUDED
+#define TURTLE_WRITER_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "output_buffer.h"
+
+void write_uri(OutputBuffer &out, const char *uri);
+void write_string(OutputBuffer &out, const char *str);
+
+/* Writes a triple as a line in N-Triples format, or a quad in N-Quads format
+   if 'graph' is not NULL. 'type' is as for TripleWriter::triple(). */
+void write_statement( OutputBuffer &out, const char *subj, const char *pred,
+                      const char *obj, const char *type,
+                      const char *graph = NULL );
+
+/* Serializes a stream of triples. The object is a resource if 'type' is
+   NULL, and a literal otherwise, with 'type' the datatype URI (or an empty
+   string for plain literals). end() must be called after the last triple. */
+class TripleWriter
+{
+public:
+    virtual ~TripleWriter();
+
+    virtual void triple( const char *subj, const char *pred,
+                         const char *obj, const char *type ) = 0;
+    virtual void end() = 0;
+};
+
+/* Writes triples in N-Triples format. */
+class NTriplesWriter : public TripleWriter
+{
+    OutputBuffer out;
+
+public:
+    NTriplesWriter(FILE *fp);
+
+    void triple( const char *subj, const char *pred,
+                 const char *obj, const char *type );
+    void end();
+};
+
+/* Writes triples in Turtle format, abbreviating URIs with a namespace
+   prefix up to the first '#' character, and grouping consecutive triples with
+   the same subject (and predicate).
+
+   Prefixes for 'namespaces' (if known in advance) are declared at the start
+   of the output. Other namespaces are declared as they are first used, so the
+   statement for a subject is buffered (in memory, in a second OutputBuffer
+   that is reused for all statements) until it is complete. Prefixes are found
+   in a hash table keyed by the namespace part of the URI, so abbreviating a
+   URI does not allocate memory. */
+class TurtleWriter : public TripleWriter
+{
+    struct Prefix
+    {
+        std::string ns, abbr;
+    };
+
+    OutputBuffer out, statement;
+    std::vector<Prefix> prefixes;
+    std::vector<size_t> slots;  // 1 + index in prefixes, or 0 if empty
+    std::string last_subj, last_pred;
+
+    static size_t hash(const char *ns, size_t len);
+    const Prefix &prefix(const char *ns, size_t len);
+    void write_resource(const char *uri);
+    void end_statement();
+
+public:
+    TurtleWriter( FILE *fp,
+                  const std::vector<std::string> &namespaces =
+                      std::vector<std::string>() );
+
+    void triple( const char *subj, const char *pred,
+                 const char *obj, const char *type );
+    void end();
+};
+
+/* Creates a triple writer for the given format ("turtle" or "ntriples")
+   writing to 'fp', or returns NULL if the format is not supported. */
+TripleWriter *create_triple_writer(const std::string &format, FILE *fp);
+
+#endif /* ndef TURTLE_WRITER_H_INCLUDED */
@@ -0,0 +1,394 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "typed_value.h"
+
+static const char * const integer_types[] = {
+    "integer", "long", "int", "short", "byte",
+    "nonNegativeInteger", "positiveInteger", "nonPositiveInteger",
+    "negativeInteger", "unsignedLong", "unsignedInt", "unsignedShort",
+    "unsignedByte", NULL };
+
+static const char * const digit_chars = "0123456789";
+
+/* Reads an optional sign and returns whether it was a minus sign. */
+static bool read_sign(const char *&p)
+{
+    if(*p == '+' || *p == '-')
+        return *p++ == '-';
+    return false;
+}
+
+/* Writes the canonical form of an xsd:integer to 'out'. */
+static bool canonical_integer(const char *p, std::string &out)
+{
+    bool negative = read_sign(p);
+    size_t n = std::strspn(p, digit_chars);
+    if(n == 0 || p[n] != '\0')
+        return false;
+    while(n > 1 && *p == '0')
+        ++p, --n;
+    out.assign(negative && *p != '0' ? "-" : "");
+    out.append(p, n);
+    return true;
+}
+
+/* Writes the canonical form of an xsd:decimal to 'out': no leading zeros in
+   the integer part, no trailing zeros in the fraction, but at least one digit
+   on both sides of the decimal point. */
+static bool canonical_decimal(const char *p, std::string &out)
+{
+    bool negative = read_sign(p);
+    size_t n = std::strspn(p, digit_chars), m = 0;
+    const char *fraction = p + n;
+    if(*fraction == '.')
+        m = std::strspn(++fraction, digit_chars);
+    if(n + m == 0 || fraction[m] != '\0')
+        return false;
+    while(n > 0 && *p == '0')
+        ++p, --n;
+    while(m > 0 && fraction[m - 1] == '0')
+        --m;
+    out.assign(negative && n + m > 0 ? "-" : "");
+    if(n > 0)
+        out.append(p, n);
+    else
+        out += '0';
+    out += '.';
+    if(m > 0)
+        out.append(fraction, m);
+    else
+        out += '0';
+    return true;
+}
+
+/* Writes the canonical form of an xsd:double (or xsd:float) to 'out': a
+   mantissa with a single non-zero digit before the decimal point, followed by
+   'E' and the exponent. */
+static bool canonical_double(const char *p, std::string &out)
+{
+    if( std::strcmp(p, "INF") == 0 || std::strcmp(p, "-INF") == 0 ||
+        std::strcmp(p, "NaN") == 0 )
+    {
+        out.assign(p);
+        return true;
+    }
+    if(std::strcmp(p, "+INF") == 0)
+    {
+        out.assign("INF");
+        return true;
+    }
+
+    bool negative = read_sign(p);
+    std::string digits(p, std::strspn(p, digit_chars));
+    long exponent = (long)digits.size();
+    p += digits.size();
+    if(*p == '.')
+    {
+        size_t m = std::strspn(++p, digit_chars);
+        digits.append(p, m);
+        p += m;
+    }
+    if(digits.empty())
+        return false;
+    if(*p == 'e' || *p == 'E')
+    {
+        ++p;
+        if(std::strspn(*p == '+' || *p == '-' ? p + 1 : p, digit_chars) == 0)
+            return false;
+        exponent += std::strtol(p, (char**)&p, 10);
+    }
+    if(*p != '\0')
+        return false;
+
+    // The value is now 0.<digits> * 10^exponent
+    size_t first = digits.find_first_not_of('0');
+    if(first == std::string::npos)
+    {
+        out.assign("0.0E0");
+        return true;
+    }
+    digits.erase(0, first);
+    exponent -= (long)first;
+    digits.erase(digits.find_last_not_of('0') + 1);
+
+    char buf[32];
+    std::sprintf(buf, "E%ld", exponent - 1);
+    out.assign(negative ? "-" : "");
+    out += digits[0];
+    out += '.';
+    if(digits.size() > 1)
+        out.append(digits, 1, std::string::npos);
+    else
+        out += '0';
+    out += buf;
+    return true;
+}
+
+/* Reads exactly 'n' digits (or at least 'n' if 'more' is set). */
+static bool read_digits(const char *&p, int n, bool more, long long &value)
+{
+    value = 0;
+    int count = 0;
+    while(*p >= '0' && *p <= '9' && (more || count < n))
+    {
+        value = 10*value + (*p++ - '0');
+        ++count;
+    }
+    return count >= n;
+}
+
+/* Reads an optional sign and a non-empty sequence of digits, optionally with
+   a fraction and (if 'exponent' is set) an exponent. */
+static bool is_number(const char *p, bool fraction, bool exponent)
+{
+    if(*p == '+' || *p == '-')
+        ++p;
+    size_t digits = std::strspn(p, "0123456789");
+    p += digits;
+    if(fraction && *p == '.')
+    {
+        size_t n = std::strspn(++p, "0123456789");
+        p += n;
+        digits += n;
+    }
+    if(digits == 0)
+        return false;
+    if(exponent && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if(*p == '+' || *p == '-')
+            ++p;
+        size_t n = std::strspn(p, "0123456789");
+        if(n == 0)
+            return false;
+        p += n;
+    }
+    return *p == '\0';
+}
+
+/* Returns the number of days from 1970-01-01 to a date in the proleptic
+   Gregorian calendar. */
+static long long days_from_civil(long long y, int m, int d)
+{
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static bool parse_date_time(const char *p, bool time, TypedValue &value)
+{
+    long long year, month, day, hour = 0, minute = 0, second = 0;
+    double fraction = 0;
+    bool negative = *p == '-';
+    if(negative)
+        ++p;
+    if( !read_digits(p, 4, true, year) || *p++ != '-' ||
+        !read_digits(p, 2, false, month) || *p++ != '-' ||
+        !read_digits(p, 2, false, day) ||
+        month < 1 || month > 12 || day < 1 || day > 31 )
+    {
+        return false;
+    }
+    if(negative)
+        year = -year;
+
+    if(time)
+    {
+        if( *p++ != 'T' || !read_digits(p, 2, false, hour) || *p++ != ':' ||
+            !read_digits(p, 2, false, minute) || *p++ != ':' ||
+            !read_digits(p, 2, false, second) ||
+            minute > 59 || second > 59 ||
+            (hour > 23 && !(hour == 24 && minute == 0 && second == 0)) )
+        {
+            return false;
+        }
+        if(*p == '.')
+        {
+            const char *q = p++;
+            if(std::strspn(p, "0123456789") == 0)
+                return false;
+            fraction = std::strtod(q, (char**)&p);
+        }
+    }
+
+    long long offset = 0;
+    if(*p == 'Z')
+        ++p;
+    else
+    if(*p == '+' || *p == '-')
+    {
+        long long tz_hour, tz_minute;
+        int sign = *p++ == '-' ? -1 : 1;
+        if( !read_digits(p, 2, false, tz_hour) || *p++ != ':' ||
+            !read_digits(p, 2, false, tz_minute) || tz_hour > 14 || tz_minute > 59 )
+        {
+            return false;
+        }
+        offset = sign * (60*tz_hour + tz_minute) * 60;
+    }
+    if(*p != '\0')
+        return false;
+
+    long long seconds = days_from_civil(year, month, day) * 86400 +
+                        hour * 3600 + minute * 60 + second - offset;
+    value.type = VALUE_DATE_TIME;
+    value.integer = fraction == 0;
+    value.i = seconds;
+    value.d = seconds + fraction;
+    return true;
+}
+
+bool parse_typed_value( const char *datatype, const char *lexical,
+                        TypedValue &value )
+{
+    if(std::strncmp(datatype, XSD, sizeof(XSD) - 1) != 0)
+        return false;
+    const char *type = datatype + sizeof(XSD) - 1;
+
+    // Values are collapsed, so leading and trailing whitespace is allowed
+    lexical += std::strspn(lexical, " \t\r\n");
+    std::string str(lexical);
+    str.erase(str.find_last_not_of(" \t\r\n") + 1);
+    const char *p = str.c_str();
+
+    value.type = VALUE_NUMERIC;
+    for(const char * const *t = integer_types; *t; ++t)
+    {
+        if(std::strcmp(type, *t) != 0)
+            continue;
+        if(!is_number(p, false, false))
+            return false;
+
+        errno = 0;
+        value.i = std::strtoll(p, NULL, 10);
+        value.integer = errno != ERANGE;
+        value.d = value.integer ? value.i : std::strtod(p, NULL);
+        return true;
+    }
+
+    if(std::strcmp(type, "decimal") == 0)
+    {
+        if(!is_number(p, true, false))
+            return false;
+        value.integer = false;
+        value.d = std::strtod(p, NULL);
+        return true;
+    }
+
+    if(std::strcmp(type, "float") == 0 || std::strcmp(type, "double") == 0)
+    {
+        value.integer = false;
+        if(str == "INF" || str == "+INF")
+            value.d = HUGE_VAL;
+        else
+        if(str == "-INF")
+            value.d = -HUGE_VAL;
+        else
+        if(is_number(p, true, true))
+            value.d = std::strtod(p, NULL);
+        else
+            return false;   // including NaN, which is not ordered
+        return true;
+    }
+
+    if(std::strcmp(type, "dateTime") == 0)
+        return parse_date_time(p, true, value);
+    if(std::strcmp(type, "date") == 0)
+        return parse_date_time(p, false, value);
+
+    return false;
+}
+
+int canonical_lexical( const char *datatype, const char *lexical,
+                       std::string &canonical )
+{
+    if(std::strncmp(datatype, XSD, sizeof(XSD) - 1) != 0)
+        return 0;
+    const char *name = datatype + sizeof(XSD) - 1;
+
+    // Values are collapsed, so leading and trailing whitespace is allowed
+    lexical += std::strspn(lexical, " \t\r\n");
+    std::string str(lexical);
+    str.erase(str.find_last_not_of(" \t\r\n") + 1);
+    if(str.empty())
+        return 0;
+
+    if(std::strcmp(name, "boolean") == 0)
+    {
+        if(str == "true" || str == "1")
+            canonical.assign("true");
+        else
+        if(str == "false" || str == "0")
+            canonical.assign("false");
+        else
+            return 0;
+        return CANONICAL_BOOLEAN;
+    }
+
+    for(const char * const *t = integer_types; *t; ++t)
+        if(std::strcmp(name, *t) == 0)
+            return canonical_integer(str.c_str(), canonical)
+                ? CANONICAL_INTEGER : 0;
+
+    if(std::strcmp(name, "decimal") == 0)
+        return canonical_decimal(str.c_str(), canonical) ? CANONICAL_DECIMAL : 0;
+
+    if(std::strcmp(name, "double") == 0 || std::strcmp(name, "float") == 0)
+        return canonical_double(str.c_str(), canonical) ? CANONICAL_DOUBLE : 0;
+
+    return 0;
+}
+
+void bind_typed_value(sqlite3_stmt *stmt, int index, const TypedValue &value)
+{
+    if(value.integer)
+        sqlite3_bind_int64(stmt, index, value.i);
+    else
+        sqlite3_bind_double(stmt, index, value.d);
+}
+
+std::string typed_value_sql(const TypedValue &value)
+{
+    std::ostringstream sql;
+    if(value.integer)
+        sql << value.i;
+    else
+    if(value.d == HUGE_VAL || value.d == -HUGE_VAL)
+        sql << (value.d < 0 ? "-9e999" : "9e999");
+    else
+    {
+        sql.precision(17);
+        sql << value.d;
+        if(sql.str().find_first_of(".e") == std::string::npos)
+            sql << ".0";
+    }
+    return sql.str();
+}
+
+std::string numeric_datatypes_sql()
+{
+    std::string sql = "'" XSD "decimal', '" XSD "float', '" XSD "double'";
+    for(const char * const *t = integer_types; *t; ++t)
+        sql += std::string(", '" XSD) + *t + "'";
+    return sql;
+}
+
+bool has_value_table(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare( db, "SELECT 1 FROM sqlite_master WHERE type='table'"
+                        " AND name='Value'", -1, &stmt, NULL ) != SQLITE_OK)
+    {
+        return false;
+    }
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return found;
+}
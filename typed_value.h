@@ -0,0 +1,74 @@
+#ifndef TYPED_VALUE_H_INCLUDED
+#define TYPED_VALUE_H_INCLUDED
+
+#include <string>
+#include <sqlite3.h>
+
+/*
+Native values of typed literals are kept in the Value table, so that range
+conditions and sorting can use an index instead of comparing lexical values:
+
+    n       node identifier of the literal (references Node.rowid)
+    t       value class: VALUE_NUMERIC or VALUE_DATE_TIME
+    v       value: an integer for xsd:integer and the types derived from it,
+            a real for xsd:decimal, xsd:float and xsd:double, and the number
+            of seconds since 1970-01-01T00:00:00Z for xsd:dateTime and
+            xsd:date (taken to be in UTC if they have no time zone)
+
+Values of the same class are comparable; the classes are numbered after the
+built-in datatype identifiers TYPE_INTEGER and TYPE_DATE_TIME.
+*/
+
+#define VALUE_NUMERIC       (3)
+#define VALUE_DATE_TIME     (4)
+
+/* Kinds of built-in datatypes with a canonical lexical form */
+#define CANONICAL_BOOLEAN   (1)
+#define CANONICAL_INTEGER   (2)
+#define CANONICAL_DECIMAL   (3)
+#define CANONICAL_DOUBLE    (4)
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* SQL script that creates the Value table and its index */
+#define VALUE_TABLE_SQL \
+    "CREATE TABLE Value (n INTEGER PRIMARY KEY, t, v);" \
+    "CREATE INDEX Value_tv ON Value (t, v);"
+
+struct TypedValue
+{
+    int type;           // VALUE_NUMERIC or VALUE_DATE_TIME
+    bool integer;       // true if the value is 'i', false if it is 'd'
+    long long i;
+    double d;
+};
+
+/* Determines the native value of a literal with the given datatype URI.
+   Returns false if the datatype has no native value, or if the lexical value
+   is not valid for the datatype. */
+bool parse_typed_value( const char *datatype, const char *lexical,
+                        TypedValue &value );
+
+/* Writes the canonical lexical form of a literal of xsd:boolean, xsd:integer
+   (or a type derived from it), xsd:decimal, xsd:float or xsd:double to
+   'canonical', so that equal values have the same lexical value both when
+   they are imported and when they occur in queries. Returns the kind of the
+   datatype (one of the CANONICAL_ constants), or 0 if it is another datatype
+   or the lexical value is not valid for it. */
+int canonical_lexical( const char *datatype, const char *lexical,
+                       std::string &canonical );
+
+/* Binds a native value to a parameter of an SQL statement. */
+void bind_typed_value(sqlite3_stmt *stmt, int index, const TypedValue &value);
+
+/* Returns an SQL literal for a native value. */
+std::string typed_value_sql(const TypedValue &value);
+
+/* Returns a list of SQL string literals, separated by commas, with the URIs
+   of the datatypes that have numeric values. */
+std::string numeric_datatypes_sql();
+
+/* Returns whether the database has a Value table. */
+bool has_value_table(sqlite3 *db);
+
+#endif /* ndef TYPED_VALUE_H_INCLUDED */